@@ -11,6 +11,8 @@
 #include <utility>
 #include <vector>
 
+#include "span.h"
+
 namespace utreexo {
 class ForestState;
 
@@ -20,6 +22,62 @@ template <typename T>
 using NodePtr = std::shared_ptr<T>;
 
 class BatchProof;
+class BatchProofView;
+class SwapBuffer;
+
+/**
+ * A view of the leaves to add to an accumulator, which does not copy them.
+ * It views either an array of Leafs or the hashes and the remember flags as separate arrays.
+ * The separate flags are packed: the flag of leaf i is bit i % 8 of byte i / 8. Without any
+ * flags no leaf is remembered.
+ */
+class LeafSpan
+{
+public:
+    LeafSpan(const std::vector<Leaf>& leaves) : m_leaves(leaves.data()), m_size(leaves.size()) {}
+    LeafSpan(Span<const Hash> hashes, Span<const uint8_t> remember = {})
+        : m_hashes(hashes.data()), m_remember(remember), m_size(hashes.size()) {}
+
+    size_t size() const { return m_size; }
+
+    const Hash& GetHash(size_t i) const { return m_leaves ? m_leaves[i].first : m_hashes[i]; }
+    bool GetRemember(size_t i) const
+    {
+        if (m_leaves) return m_leaves[i].second;
+        return i / 8 < m_remember.size() && ((m_remember[i / 8] >> (i % 8)) & 1);
+    }
+
+    /** Return whether there are no flags or a flag for every leaf. */
+    bool HasValidFlags() const { return m_leaves || m_remember.empty() || m_remember.size() * 8 >= m_size; }
+
+private:
+    const Leaf* m_leaves{nullptr};
+    const Hash* m_hashes{nullptr};
+    Span<const uint8_t> m_remember;
+    size_t m_size;
+};
+
+/**
+ * An estimate of the heap memory held by an accumulator, in bytes.
+ * Allocator overhead is not included.
+ */
+struct AccumulatorMemory {
+    // The hashes of the forest rows.
+    size_t m_forest_data{0};
+    // The position map from leaf hashes to positions.
+    size_t m_posmap{0};
+    // The node objects of the trees and the roots.
+    size_t m_nodes{0};
+    // The reference counts that are allocated along with every shared node.
+    size_t m_control_blocks{0};
+    // The pages and position maps of the latest published snapshot (see RamForest::EnableSnapshots).
+    // Older snapshots that are still held by readers are not included.
+    size_t m_snapshots{0};
+    // Scratch buffers and indexes: the swap buffer, the dirty page flags and the undo journal index.
+    size_t m_auxiliary{0};
+
+    size_t Total() const { return m_forest_data + m_posmap + m_nodes + m_control_blocks + m_snapshots + m_auxiliary; }
+};
 
 /** Provides an interface for a hash based dynamic accumulator. */
 class Accumulator
@@ -30,6 +88,7 @@ public:
 
     /**
      * Verify a batch proof.
+     * The target hashes are in the order of the sorted targets (proof.GetSortedTargets()).
      * Return whether or not the proof proved the target hashes.
      * The internal state of the accumulator might be mutated but the roots will not.
      */
@@ -38,6 +97,12 @@ public:
     /** Modify the accumulator by adding leaves and removing targets. */
     bool Modify(const std::vector<Leaf>& new_leaves, const std::vector<uint64_t>& targets);
 
+    /**
+     * Modify the accumulator like above, without copying the leaves or the targets.
+     * The remember flags are packed, one bit per leaf (see LeafSpan), and can be empty.
+     */
+    bool Modify(Span<const Hash> leaf_hashes, Span<const uint8_t> remember, Span<const uint64_t> targets);
+
     /**
      * Create a batch proof for a set of target hashes. (A target hash is the hash a leaf in the forest)
      * The target hashes are not required to be sorted by leaf position in the forest and
@@ -54,6 +119,26 @@ public:
      */
     bool Prove(BatchProof& proof, const std::vector<Hash>& target_hashes) const;
 
+    /**
+     * Create a batch proof for a peer that runs a pollard, leaving out the proof hashes
+     * the peer already has cached. The peer's cache is described by the positions of the
+     * leaves it remembers (see Pollard::RememberedLeaves). The resulting proof has to be
+     * verified with Pollard::VerifyTrimmed and the same remembered positions.
+     */
+    bool ProveTrimmed(BatchProof& proof,
+                      const std::vector<Hash>& target_hashes,
+                      const std::vector<uint64_t>& remembered) const;
+
+    /**
+     * Create one proof for every list of target hashes, like Prove would.
+     * The requests are split across num_threads threads. The accumulator must not be modified
+     * while this runs (see RamForest::GetSnapshot for proving during modifications).
+     * Return false if any of the proofs can not be created.
+     */
+    bool ProveMany(std::vector<BatchProof>& proofs,
+                   const std::vector<std::vector<Hash>>& target_hashes,
+                   int num_threads = 1) const;
+
     /** Return the root hashes (roots of taller trees first) */
     void Roots(std::vector<Hash>& roots) const;
 
@@ -63,11 +148,17 @@ public:
 
     uint64_t NumLeaves() const;
 
-protected:
+    /** Return an estimate of the memory held by the accumulator. */
+    virtual AccumulatorMemory MemoryUsage() const;
+
     struct LeafHasher {
         size_t operator()(const Hash& hash) const;
     };
 
+    /** Return an estimate of the heap memory held by a position map. */
+    static size_t PositionMapMemory(const std::unordered_map<Hash, uint64_t, LeafHasher>& posmap);
+
+protected:
     /*
      * Node represents a node in the accumulator forest.
      * This is used to create an abstraction on top of a accumulator implementation,
@@ -89,11 +180,26 @@ protected:
     // of all the leaves.
     std::unordered_map<Hash, uint64_t, LeafHasher> m_posmap;
 
+    // The swaps of the latest removal, kept to reuse the allocations.
+    std::unique_ptr<SwapBuffer> m_swap_buffer;
+
+    // The size of the reference counts that std::make_shared allocates along with an object.
+    static constexpr size_t SHARED_CONTROL_BLOCK_SIZE = sizeof(void*) + 2 * sizeof(int);
+
     void UpdatePositionMapForRange(uint64_t from, uint64_t to, uint64_t range);
     void UpdatePositionMapForSubtreeSwap(uint64_t from, uint64_t to);
 
+    /* Return the position of a leaf hash from the position map. */
+    std::optional<uint64_t> Position(const Hash& hash) const;
+
     /* Return the hash at a position */
     virtual std::optional<const Hash> Read(uint64_t pos) const = 0;
+    /*
+     * Read the hashes at several positions into hashes (one per position).
+     * Return false if any of them is not available. Implementations can read
+     * faster if the positions are sorted.
+     */
+    virtual bool ReadMany(const std::vector<uint64_t>& positions, std::vector<Hash>& hashes) const;
     /* Return all hashes that are available in the interval [pos, pos+range[ */
     virtual std::vector<Hash> ReadLeafRange(uint64_t pos, uint64_t range) const = 0;
 
@@ -110,18 +216,20 @@ protected:
     /* Return the result of the latest merge. */
     virtual NodePtr<Accumulator::Node> MergeRoot(uint64_t parent_pos, Hash parent_hash) = 0;
     /* Allocate a new leaf and assign it the given hash */
-    virtual NodePtr<Accumulator::Node> NewLeaf(const Leaf& leaf) = 0;
+    virtual NodePtr<Accumulator::Node> NewLeaf(const Hash& hash, bool remember) = 0;
 
     /* Free memory or select new roots. */
     virtual void FinalizeRemove(uint64_t next_num_leaves) = 0;
 
     /* Add new leaves to the accumulator. */
-    virtual bool Add(const std::vector<Leaf>& leaves);
+    virtual bool Add(const LeafSpan& leaves);
     /* Remove target leaves from the accumulator. */
-    bool Remove(const std::vector<uint64_t>& targets);
+    bool Remove(Span<const uint64_t> targets);
 
     /* Compute the parent hash from two children. */
     static void ParentHash(Hash& parent, const Hash& left, const Hash& right);
+    /* Compute count parent hashes, each from the next two of the 2 * count consecutive children. */
+    static void ParentHashes(Hash* parents, const Hash* children, size_t count);
 
     template <class T, typename... Args>
     static NodePtr<T> MakeNodePtr(const Args&... args)
@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <array>
+#include <stddef.h>
 #include <stdint.h>
 #include <vector>
 
@@ -18,6 +19,14 @@ private:
     // The proof hashes for the targets.
     std::vector<std::array<uint8_t, 32>> m_proof;
 
+    // The proof and computed positions of the sorted targets, memoized by ComputePositions
+    // for m_positions_num_leaves leaves. Only valid if m_has_positions is set.
+    std::vector<uint64_t> m_proof_positions, m_computed_positions;
+    uint64_t m_positions_num_leaves{0};
+    bool m_has_positions{false};
+
+    friend class Accumulator;
+
 public:
     BatchProof(const std::vector<uint64_t>& targets, std::vector<std::array<uint8_t, 32>> proof)
         : m_targets(targets), m_sorted_targets(targets), m_proof(proof)
@@ -32,12 +41,40 @@ public:
         m_targets = std::vector<uint64_t>();
         m_sorted_targets = std::vector<uint64_t>();
         m_proof = std::vector<std::array<uint8_t, 32>>();
+        m_has_positions = false;
     }
 
     const std::vector<uint64_t>& GetTargets() const;
     const std::vector<uint64_t>& GetSortedTargets() const;
     const std::vector<std::array<uint8_t, 32>>& GetHashes() const;
 
+    /**
+     * Compute the positions of the hashes needed to verify the proof in a forest
+     * with num_leaves leaves, and the positions computed during verification, and
+     * keep them with the proof. Nothing is computed if they are kept for num_leaves already.
+     * The targets must have passed ForestState::CheckTargetsSanity.
+     */
+    void ComputePositions(uint64_t num_leaves);
+
+    /** Return whether the positions were computed for a forest with num_leaves leaves. */
+    bool HasPositions(uint64_t num_leaves) const { return m_has_positions && m_positions_num_leaves == num_leaves; }
+
+    /** Return the positions kept by ComputePositions (empty if there are none). */
+    const std::vector<uint64_t>& GetProofPositions() const;
+    const std::vector<uint64_t>& GetComputedPositions() const;
+
+    /**
+     * Serialize the proof in the versioned wire format:
+     * - version:      1 byte (currently 1)
+     * - num targets:  varint
+     * - num hashes:   varint
+     * - targets:      varint each, zigzag encoded difference to the previous target
+     *                 (the first target is relative to 0). Sorted targets encode in
+     *                 one or two bytes each.
+     * - proof hashes: 32 bytes each
+     *
+     * Varints are unsigned LEB128 (7 bits per byte, least significant group first).
+     */
     void Serialize(std::vector<uint8_t>& bytes) const;
     bool Unserialize(const std::vector<uint8_t>& bytes);
 
@@ -53,11 +90,61 @@ public:
     void Print();
 };
 
+/**
+ * BatchProofPositions holds the proof and computed positions of a proof in a forest
+ * with a given number of leaves. It refers to the positions kept by the proof if they
+ * were computed for that forest and computes its own copy otherwise, so that the proof
+ * is never modified. The proof has to outlive the positions.
+ */
+class BatchProofPositions
+{
+private:
+    std::vector<uint64_t> m_proof_positions, m_computed_positions;
+    const std::vector<uint64_t>* m_proof{nullptr};
+    const std::vector<uint64_t>* m_computed{nullptr};
+
+public:
+    /** The targets of the proof must have passed ForestState::CheckTargetsSanity. */
+    BatchProofPositions(const BatchProof& proof, uint64_t num_leaves);
+
+    BatchProofPositions(const BatchProofPositions&) = delete;
+    BatchProofPositions& operator=(const BatchProofPositions&) = delete;
+
+    const std::vector<uint64_t>& GetProofPositions() const { return *m_proof; }
+    const std::vector<uint64_t>& GetComputedPositions() const { return *m_computed; }
+};
+
+/**
+ * BatchProofView parses a serialized BatchProof in place.
+ * The view does not copy any data: the proof hashes point straight into the
+ * parsed buffer, which has to outlive the view.
+ */
+class BatchProofView
+{
+private:
+    const uint8_t* m_targets_data{nullptr};
+    const uint8_t* m_hashes_data{nullptr};
+    uint64_t m_num_targets{0};
+    uint64_t m_num_hashes{0};
+
+public:
+    /** Parse and validate a serialized proof. On failure the view is empty. */
+    bool Unserialize(const uint8_t* data, size_t len);
+
+    uint64_t NumTargets() const { return m_num_targets; }
+    uint64_t NumHashes() const { return m_num_hashes; }
+
+    /** Decode the targets in their serialized (unsorted) order. */
+    void GetTargets(std::vector<uint64_t>& targets) const;
+    /** Return a pointer to the NumHashes() proof hashes inside the parsed buffer. */
+    const std::array<uint8_t, 32>* GetHashes() const;
+};
+
 /** UndoBatch represents the data needed to undo a batch modification in the accumulator. */
 class UndoBatch
 {
 private:
-    uint64_t m_num_additions;
+    uint64_t m_num_additions{0};
     std::vector<uint64_t> m_deleted_positions;
     std::vector<std::array<uint8_t, 32>> m_deleted_hashes;
 
@@ -70,6 +157,16 @@ public:
           m_deleted_hashes(deleted_hashes) {}
     UndoBatch() {}
 
+    /**
+     * Serialize the undo data in the versioned wire format:
+     * - version:           1 byte (currently 1)
+     * - num additions:     varint
+     * - num deletions:     varint
+     * - deleted positions: varint each, zigzag encoded difference to the previous position
+     * - deleted hashes:    32 bytes each
+     *
+     * Varints are encoded like in BatchProof::Serialize.
+     */
     void Serialize(std::vector<uint8_t>& bytes) const;
     bool Unserialize(const std::vector<uint8_t>& bytes);
 
@@ -82,5 +179,55 @@ public:
     void Print();
 };
 
+/**
+ * PollardUndoBatch holds the data needed to undo a batch modification in a pollard.
+ * A pollard does not keep the leaves it forgot, so on top of the UndoBatch it stores
+ * the roots before the modification and the proof hashes of the deleted leaves, which
+ * are the siblings on the paths the deletion removed. Undoing puts these branches back
+ * into the pollard, the rest of the cached branches are moved back in place.
+ */
+class PollardUndoBatch
+{
+private:
+    UndoBatch m_undo;
+    std::vector<std::array<uint8_t, 32>> m_prev_roots;
+
+    // The hashes at the proof positions of the deleted leaves before the modification
+    // (see ForestState::ProofPositions), sorted by position.
+    std::vector<std::array<uint8_t, 32>> m_proof_hashes;
+    // The packed flags of the deleted leaves that were remembered (see LeafSpan),
+    // one bit per deleted position.
+    std::vector<uint8_t> m_remembered;
+
+public:
+    PollardUndoBatch(const UndoBatch& undo,
+                     const std::vector<std::array<uint8_t, 32>>& prev_roots,
+                     const std::vector<std::array<uint8_t, 32>>& proof_hashes,
+                     const std::vector<uint8_t>& remembered)
+        : m_undo(undo),
+          m_prev_roots(prev_roots),
+          m_proof_hashes(proof_hashes),
+          m_remembered(remembered) {}
+    PollardUndoBatch() {}
+
+    /**
+     * Serialize the undo data in the versioned wire format:
+     * - version:           1 byte (currently 1)
+     * - undo batch:        varint length followed by the serialized UndoBatch
+     * - num roots:         varint
+     * - roots:             32 bytes each
+     * - num proof hashes:  varint
+     * - proof hashes:      32 bytes each
+     * - remembered flags:  one bit per deleted position, padded to whole bytes
+     */
+    void Serialize(std::vector<uint8_t>& bytes) const;
+    bool Unserialize(const std::vector<uint8_t>& bytes);
+
+    const UndoBatch& GetUndoBatch() const { return m_undo; }
+    const std::vector<std::array<uint8_t, 32>>& GetPrevRoots() const { return m_prev_roots; }
+    const std::vector<std::array<uint8_t, 32>>& GetProofHashes() const { return m_proof_hashes; }
+    const std::vector<uint8_t>& GetRemembered() const { return m_remembered; }
+};
+
 };     // namespace utreexo
 #endif // UTREEXO_BATCHPROOF_H
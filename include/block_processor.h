@@ -0,0 +1,107 @@
+#ifndef UTREEXO_BLOCK_PROCESSOR_H
+#define UTREEXO_BLOCK_PROCESSOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "accumulator.h"
+#include "batchproof.h"
+
+namespace utreexo {
+
+class Pollard;
+class PollardUndoBatch;
+
+/** The utreexo data of a block, as received from a peer. */
+struct BlockData {
+    // The serialized BatchProof for the spent outputs.
+    std::vector<uint8_t> m_proof;
+    // The serialized spent outputs, in the order of the proof targets.
+    std::vector<std::vector<uint8_t>> m_spent;
+    // The serialized outputs created by the block.
+    std::vector<std::vector<uint8_t>> m_created;
+    // The packed remember flags of the created outputs (see LeafSpan), can be empty.
+    std::vector<uint8_t> m_remember;
+};
+
+/**
+ * BlockProcessor connects blocks to a pollard in a two stage pipeline.
+ *
+ * The first stage runs on a worker thread and prepares the submitted blocks in order:
+ * it parses the proof, sanity checks and computes the proof positions of its targets,
+ * and hashes the spent and created outputs. None of this depends on the pollard, only
+ * on its number of leaves, which every block changes by its created minus its spent outputs.
+ *
+ * The second stage runs on the thread that calls Connect. It takes over the next
+ * prepared block, verifies its proof against the pollard and modifies the pollard.
+ * So while block N is verified and connected, block N + 1 is already being prepared.
+ *
+ * The pollard should only be used through the processor while blocks are pending. The
+ * pending blocks were prepared for its number of leaves, if it changes otherwise their
+ * proof positions are computed again when they are connected.
+ */
+class BlockProcessor
+{
+public:
+    explicit BlockProcessor(Pollard& pollard);
+    ~BlockProcessor();
+
+    BlockProcessor(const BlockProcessor&) = delete;
+    BlockProcessor& operator=(const BlockProcessor&) = delete;
+
+    /** Queue a block to be prepared and connected after the previously submitted ones. */
+    void Submit(BlockData block);
+
+    /**
+     * Connect the oldest submitted block that is not connected yet, waiting for its
+     * preparation if needed, and fill undo with the data to roll the modification back.
+     * Return false if there is no submitted block or the block is invalid. After an invalid
+     * block no later block is connected, since they would build on it.
+     */
+    bool Connect(PollardUndoBatch& undo);
+
+    /** Return the number of submitted blocks that are not connected yet. */
+    size_t NumPending() const;
+
+private:
+    /** A block whose proof and leaf hashes are ready to be applied to the pollard. */
+    struct PreparedBlock {
+        bool m_valid{false};
+        BatchProof m_proof;
+        // The hashes of the spent outputs, in the order of the sorted targets.
+        std::vector<Hash> m_target_hashes;
+        std::vector<Hash> m_add_hashes;
+        std::vector<uint8_t> m_remember;
+    };
+
+    Pollard& m_pollard;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    // The submitted blocks that the worker has not started on.
+    std::deque<BlockData> m_submitted;
+    // The blocks that the worker has prepared, oldest first.
+    std::deque<PreparedBlock> m_prepared;
+    // The number of blocks that are submitted and not yet taken over by Connect.
+    size_t m_num_pending{0};
+    bool m_invalid{false};
+    bool m_stop{false};
+
+    // The number of leaves the pollard will have after the blocks before the next
+    // submitted one. Only used by the worker.
+    uint64_t m_next_num_leaves;
+
+    std::thread m_worker;
+
+    void WorkerThread();
+
+    /** Prepare a block for a pollard with num_leaves leaves (see PreparedBlock). */
+    static void Prepare(BlockData& block, uint64_t num_leaves, PreparedBlock& prepared);
+};
+
+};     // namespace utreexo
+#endif // UTREEXO_BLOCK_PROCESSOR_H
@@ -0,0 +1,88 @@
+#ifndef UTREEXO_FOREST_SNAPSHOT_H
+#define UTREEXO_FOREST_SNAPSHOT_H
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "accumulator.h"
+
+namespace utreexo {
+
+class BatchProof;
+
+/**
+ * ForestSnapshot is an immutable version of a RamForest (see RamForest::GetSnapshot).
+ * A snapshot can be read and proven against from any number of threads, while the
+ * forest is modified into the next version.
+ *
+ * The hashes of every row are split into pages. A new version only copies the pages
+ * that were written since the previous version and shares all others with it. The
+ * position map is shared the same way: a base map is extended by a chain of deltas
+ * that hold the positions of the leaves on the written pages.
+ */
+class ForestSnapshot
+{
+public:
+    // The number of hashes in a page.
+    static constexpr uint64_t PAGE_SIZE = 1024;
+
+    uint64_t NumLeaves() const { return m_num_leaves; }
+
+    /** Return the root hashes (roots of taller trees first) */
+    void Roots(std::vector<Hash>& roots) const { roots = m_roots; }
+
+    /** Return the hash at a position. */
+    std::optional<Hash> Read(uint64_t pos) const;
+
+    /**
+     * Read the hashes at several positions into hashes, like Read for every position.
+     * Return false if any of them is not available.
+     */
+    bool ReadMany(const std::vector<uint64_t>& positions, std::vector<Hash>& hashes) const;
+
+    /** Create a batch proof for a set of target hashes, like Accumulator::Prove. */
+    bool Prove(BatchProof& proof, const std::vector<Hash>& target_hashes) const;
+
+    /** Create one proof for every list of target hashes, like Accumulator::ProveMany. */
+    bool ProveMany(std::vector<BatchProof>& proofs,
+                   const std::vector<std::vector<Hash>>& target_hashes,
+                   int num_threads = 1) const;
+
+private:
+    friend class RamForest;
+
+    using Page = std::array<Hash, PAGE_SIZE>;
+    using PositionMap = std::unordered_map<Hash, uint64_t, Accumulator::LeafHasher>;
+
+    struct PositionDelta {
+        PositionMap m_positions;
+        std::shared_ptr<const PositionDelta> m_prev;
+        // The length of the chain and the number of entries in it, including this delta.
+        size_t m_depth{0};
+        size_t m_num_entries{0};
+    };
+
+    uint64_t m_num_leaves{0};
+    std::vector<Hash> m_roots;
+
+    // The pages of every row. The last page of a row might only be partially used.
+    std::vector<std::vector<std::shared_ptr<const Page>>> m_rows;
+
+    // The positions of all leaves at the time the base was copied. The entries of
+    // later deltas take precedence. Entries can be stale, so a position is only
+    // trusted if the leaf at it has the expected hash.
+    std::shared_ptr<const PositionMap> m_posmap_base;
+    std::shared_ptr<const PositionDelta> m_posmap_delta;
+
+    std::optional<uint64_t> Position(const Hash& hash) const;
+
+    /** Return the memory held by the snapshot, counting the pages it shares with older snapshots. */
+    size_t MemoryUsage() const;
+};
+
+};     // namespace utreexo
+#endif // UTREEXO_FOREST_SNAPSHOT_H
@@ -0,0 +1,20 @@
+#ifndef UTREEXO_LEAF_HASH_H
+#define UTREEXO_LEAF_HASH_H
+
+#include "accumulator.h"
+#include "span.h"
+
+namespace utreexo {
+
+/**
+ * Compute the leaf hash, the SHA-512/256 hash, of the serialized data of every UTXO.
+ * out receives one hash per UTXO, in the same order.
+ *
+ * The UTXOs are hashed in one batch with the same SHA-512/256 code that hashes the parents
+ * of the accumulator, without the buffering of a streaming hasher.
+ * Return false if out does not have the same size as utxo_data.
+ */
+bool HashLeaves(Span<const ByteSpan> utxo_data, Span<Hash> out);
+
+};     // namespace utreexo
+#endif // UTREEXO_LEAF_HASH_H
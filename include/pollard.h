@@ -1,12 +1,15 @@
 #ifndef UTREEXO_POLLARD_H
 #define UTREEXO_POLLARD_H
 
+#include <iosfwd>
 #include <optional>
 
 #include "accumulator.h"
 
 namespace utreexo {
 
+class PollardUndoBatch;
+
 class Pollard : public Accumulator
 {
 private:
@@ -30,7 +33,7 @@ private:
     std::vector<Hash> ReadLeafRange(uint64_t pos, uint64_t range) const override;
     NodePtr<Accumulator::Node> SwapSubTrees(uint64_t from, uint64_t to) override;
     NodePtr<Accumulator::Node> MergeRoot(uint64_t parent_pos, Hash parent_hash) override;
-    NodePtr<Accumulator::Node> NewLeaf(const Leaf& hash) override;
+    NodePtr<Accumulator::Node> NewLeaf(const Hash& hash, bool remember) override;
     void FinalizeRemove(uint64_t next_num_leaves) override;
 
     void InitChildrenOfComputed(NodePtr<Pollard::Node>& node,
@@ -39,20 +42,135 @@ private:
                                 bool& recover_left,
                                 bool& recover_right);
 
+    /*
+     * Populate the proof tree for a proof. If cached_positions is set, the proof is trimmed:
+     * it holds no hashes for these (sorted) positions, which have to be cached in the pollard.
+     */
     bool CreateProofTree(std::vector<NodePtr<Node>>& proof_tree,
                          std::vector<std::pair<NodePtr<Node>, int>>& recovery,
-                         const BatchProof& proof);
+                         const std::vector<uint64_t>& proof_positions,
+                         const std::vector<uint64_t>& computed_positions,
+                         const Hash* proof_hashes,
+                         uint64_t num_hashes,
+                         const std::vector<uint64_t>* cached_positions);
 
     bool VerifyProofTree(std::vector<NodePtr<Pollard::Node>> proof_tree,
-                         const std::vector<Hash>& target_hashes,
-                         const std::vector<Hash>& proof_hashes);
+                         const std::vector<Hash>& target_hashes);
+
+    /*
+     * Verify sanity checked targets against num_hashes proof hashes stored at proof_hashes.
+     * The proof and computed positions are the ForestState::ProofPositions of the targets.
+     */
+    bool Verify(const std::vector<uint64_t>& sorted_targets,
+                const std::vector<uint64_t>& proof_positions,
+                const std::vector<uint64_t>& computed_positions,
+                const Hash* proof_hashes,
+                uint64_t num_hashes,
+                const std::vector<Hash>& target_hashes,
+                const std::vector<uint64_t>* cached_positions);
+
+    /* Replace the roots with uncached roots for the current number of leaves. */
+    void RestoreRoots(const std::vector<Hash>& roots);
+
+    /**
+     * Build the PollardUndoBatch that can be used to roll back a modification.
+     * This has to be called in Modify before the deletion of the targets.
+     */
+    bool BuildUndoBatch(PollardUndoBatch& undo, uint64_t num_adds, Span<const uint64_t> targets) const;
+
+    /*
+     * Append the remembered leaves below a node on row > 0 with their positions to leaves,
+     * given the children of the node (the nieces of its sibling) and its leftmost leaf.
+     */
+    void CollectRememberedLeaves(const NodePtr<InternalNode>& left,
+                                 const NodePtr<InternalNode>& right,
+                                 uint8_t row,
+                                 uint64_t first_leaf,
+                                 std::vector<std::pair<Hash, uint64_t>>& leaves) const;
+
+    /* Write the subtree below node in pre-order. */
+    void SerializeNode(std::ostream& stream, const NodePtr<Pollard::InternalNode>& node) const;
+    /* Read a subtree written by SerializeNode. Nodes on row 0 can not have nieces. */
+    bool UnserializeNode(std::istream& stream, NodePtr<Pollard::InternalNode>& node, uint8_t row);
 
 public:
     Pollard(const std::vector<Hash>& roots, uint64_t num_leaves);
     Pollard(uint64_t num_leaves);
     ~Pollard();
 
+    using Accumulator::Modify;
+
     bool Verify(const BatchProof& proof, const std::vector<Hash>& target_hashes) override;
+    AccumulatorMemory MemoryUsage() const override;
+
+    /**
+     * Verify a proof that was parsed in place.
+     * The proof hashes are read straight from the view's buffer without being copied.
+     */
+    bool Verify(const BatchProofView& proof, const std::vector<Hash>& target_hashes);
+
+    /**
+     * Verify a proof created by Accumulator::ProveTrimmed.
+     * The proof holds no hashes for the positions that are cached for the remembered leaves,
+     * so the pollard skips the comparison of provided and cached hashes.
+     * Verification fails if remembered does not describe the leaves this pollard remembers.
+     */
+    bool VerifyTrimmed(const BatchProof& proof,
+                       const std::vector<Hash>& target_hashes,
+                       const std::vector<uint64_t>& remembered);
+
+    /**
+     * Modify the pollard and fill undo with the data needed to roll the modification back.
+     * All targets have to be cached (e.g. by verifying the block's proof first).
+     */
+    bool Modify(PollardUndoBatch& undo,
+                const std::vector<Leaf>& new_leaves,
+                const std::vector<uint64_t>& targets);
+
+    /**
+     * Modify the pollard like above, without copying the leaves or the targets.
+     * The remember flags are packed, one bit per leaf (see LeafSpan), and can be empty.
+     */
+    bool Modify(PollardUndoBatch& undo,
+                Span<const Hash> leaf_hashes,
+                Span<const uint8_t> remember,
+                Span<const uint64_t> targets);
+
+    /**
+     * Roll back the modification that produced undo.
+     * The branches of the deleted leaves are rebuilt from the undo data and checked against
+     * the previous roots, the cached branches of the other leaves are moved back to their
+     * previous positions. The deleted leaves are remembered again if they were remembered
+     * before the modification. On failure the pollard is left unchanged.
+     *
+     * The rebuilt branches are pruned like after a modification, so the cache holds fewer nodes
+     * than right before the modification. The nodes the block's proof populated are not restored:
+     * the block's proof has to be verified again before the same block is re-applied.
+     */
+    bool Undo(const PollardUndoBatch& undo);
+
+    /** Return the positions of the remembered leaves (sorted in ascending order). */
+    void RememberedLeaves(std::vector<uint64_t>& positions) const;
+
+    /**
+     * Write a snapshot of the pollard to a stream.
+     * The snapshot holds the number of leaves, every cached node in pre-order
+     * (starting at each root, taller trees first) and the position map.
+     *
+     * Every node is written as one flag byte followed by its hash:
+     *   bit 0: the left niece is present (and follows this node)
+     *   bit 1: the right niece is present (and follows the left subtree)
+     *   bit 2: the left niece is the remember marker
+     * The position map follows as an 8 byte count and (hash, 8 byte position) pairs.
+     * All integers are big endian.
+     */
+    bool Serialize(std::ostream& stream) const;
+
+    /**
+     * Restore the pollard from a snapshot written by Serialize, replacing the current state.
+     * Return false if the snapshot is malformed, in which case the pollard is left empty.
+     */
+    bool Unserialize(std::istream& stream);
 
     /** Prune everything except the roots. */
     void Prune();
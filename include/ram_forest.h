@@ -2,6 +2,8 @@
 #define UTREEXO_RAMFOREST_H
 
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <optional>
 
 #include "accumulator.h"
@@ -11,6 +13,8 @@ namespace utreexo {
 class BatchProof;
 class UndoBatch;
 class ForestState;
+class UndoJournal;
+class ForestSnapshot;
 
 class RamForest : public Accumulator
 {
@@ -25,10 +29,27 @@ private:
     std::string m_file_path;
     std::fstream m_file;
 
+    // The undo data of the latest modifications, if enabled.
+    std::unique_ptr<UndoJournal> m_undo_journal;
+
+    // The pages (see ForestSnapshot::PAGE_SIZE) of every row that were written
+    // since the latest snapshot was published.
+    std::vector<std::vector<bool>> m_dirty_pages;
+
+    // The latest snapshot, if snapshots are enabled.
+    // Only the pointer is guarded by the mutex, the snapshot itself is immutable.
+    bool m_snapshots_enabled{false};
+    std::shared_ptr<const ForestSnapshot> m_snapshot;
+    mutable std::mutex m_snapshot_mutex;
+
     bool Restore();
 
+    /* Mark count hashes starting at index (within the row) as written. */
+    void MarkDirty(uint8_t row, uint64_t index, uint64_t count = 1);
+    /* Publish the current state as the latest snapshot, copying only the dirty pages. */
+    void PublishSnapshot();
+
     std::optional<const Hash> Read(ForestState state, uint64_t pos) const;
-    std::optional<const Hash> Read(uint64_t pos) const override;
     std::vector<Hash> ReadLeafRange(uint64_t pos, uint64_t range) const override;
 
     /* Swap the hashes of ranges (from, from+range) and (to, to+range). */
@@ -36,7 +57,7 @@ private:
 
     NodePtr<Accumulator::Node> SwapSubTrees(uint64_t from, uint64_t to) override;
     NodePtr<Accumulator::Node> MergeRoot(uint64_t parent_pos, Hash parent_hash) override;
-    NodePtr<Accumulator::Node> NewLeaf(const Leaf& leaf) override;
+    NodePtr<Accumulator::Node> NewLeaf(const Hash& hash, bool remember) override;
     void FinalizeRemove(uint64_t next_num_leaves) override;
 
     void RestoreRoots();
@@ -45,7 +66,27 @@ private:
      * Build the UndoBatch that can be used to roll back a modification.
      * This should only be called in Modify after the deletion and before the addition of new leaves.
      */
-    bool BuildUndoBatch(UndoBatch& undo, uint64_t num_adds, const std::vector<uint64_t>& targets) const;
+    bool BuildUndoBatch(UndoBatch& undo, uint64_t num_adds, Span<const uint64_t> targets) const;
+
+    /* Modify the forest, see Modify. */
+    bool ModifyLeaves(UndoBatch& undo, const LeafSpan& leaves, Span<const uint64_t> targets);
+
+    // Half open ranges [begin, end) of positions in a row.
+    using Ranges = std::vector<std::pair<uint64_t, uint64_t>>;
+
+    /**
+     * Roll back the leaves of a modification, without rehashing.
+     * Append the ranges of all leaves that changed to dirty_leaves and return the
+     * hashes of the leaves the modification added in added_hashes.
+     * The undo data is checked first: on failure the forest is left unchanged.
+     */
+    bool UndoLeaves(const UndoBatch& undo, Ranges& dirty_leaves, std::vector<Hash>& added_hashes);
+    /*
+     * Rehash every ancestor of the dirty leaves once and restore the roots.
+     * The dirty ranges are merged and walked upwards row by row, each range of
+     * parents is rehashed in one batch from the consecutive children below it.
+     */
+    void ReHashDirtyLeaves(Ranges& dirty_leaves);
 
 public:
     RamForest(uint64_t num_leaves);
@@ -53,19 +94,73 @@ public:
     ~RamForest();
 
     bool Verify(const BatchProof& proof, const std::vector<Hash>& target_hashes) override;
-    bool Add(const std::vector<Leaf>& leaves) override;
+    AccumulatorMemory MemoryUsage() const override;
+    bool Add(const LeafSpan& leaves) override;
 
+    /**
+     * Modify the forest and fill undo with the data needed to roll the modification back.
+     * If the undo journal is open and the undo data can not be appended to it, the forest
+     * is left unchanged and false is returned.
+     */
     bool Modify(UndoBatch& undo,
                 const std::vector<Leaf>& new_leaves,
                 const std::vector<uint64_t>& targets);
 
+    /**
+     * Modify the forest like above, without copying the leaf hashes or the targets.
+     * A forest remembers every leaf, so it takes no remember flags.
+     */
+    bool Modify(UndoBatch& undo, Span<const Hash> leaf_hashes, Span<const uint64_t> targets);
+
     bool Undo(const UndoBatch& undo);
 
+    /**
+     * Record the undo data of every following modification in an append-only journal file,
+     * keeping the data of the latest max_blocks modifications.
+     * An existing journal is reused if it ends at the current state of the forest.
+     * Modifications have to be rolled back with Rewind while the journal is open.
+     */
+    bool OpenUndoJournal(const std::string& file, size_t max_blocks);
+
+    /** Return the number of modifications that Rewind can roll back. */
+    size_t NumUndoBlocks() const;
+
+    /**
+     * Roll back the latest k modifications recorded in the undo journal.
+     * The leaves of all k modifications are rolled back first, then every
+     * affected node is rehashed once.
+     * If the undo data of any of them is invalid, the forest and the journal are left as they were.
+     */
+    bool Rewind(size_t k);
+
+    /**
+     * Publish a snapshot of the forest after every following modification.
+     * Snapshots are cheap to publish, since unchanged pages are shared between them.
+     */
+    void EnableSnapshots();
+
+    /**
+     * Return the latest published snapshot, or nullptr if snapshots are not enabled.
+     * This is the only method that is safe to call from other threads while the forest
+     * is modified. The snapshot can be kept and read for as long as needed.
+     */
+    std::shared_ptr<const ForestSnapshot> GetSnapshot() const;
+
     /** Save the forest to file. */
     bool Commit();
 
     Hash GetLeaf(uint64_t pos) const;
 
+    /** Return the hash at a position, or nothing if the position is not in the forest. */
+    std::optional<const Hash> Read(uint64_t pos) const override;
+
+    /**
+     * Read the hashes at several positions into hashes, like Read for every position.
+     * Runs of positions on the same row are read with one offset computation, prefetching ahead.
+     * Return false if any of the positions is not in the forest.
+     */
+    bool ReadMany(const std::vector<uint64_t>& positions, std::vector<Hash>& hashes) const override;
+
     bool operator==(const RamForest& other);
 };
 
@@ -0,0 +1,59 @@
+#ifndef UTREEXO_SPAN_H
+#define UTREEXO_SPAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+namespace utreexo {
+
+/**
+ * A Span is a pointer and a length, a view of contiguous objects that it does not own.
+ * It can be created from a pointer and a length or from any container with data() and
+ * size(), like a std::vector or std::array. This is a subset of C++20's std::span.
+ */
+template <typename T>
+class Span
+{
+public:
+    constexpr Span() noexcept : m_data(nullptr), m_size(0) {}
+    constexpr Span(T* data, size_t size) noexcept : m_data(data), m_size(size) {}
+
+    /** Create a span of the objects in a container, if they can be converted to T. */
+    template <typename C,
+              typename = std::enable_if_t<std::is_convertible<
+                  std::remove_pointer_t<decltype(std::declval<C&>().data())> (*)[], T (*)[]>::value>>
+    constexpr Span(C& container) noexcept : m_data(container.data()), m_size(container.size())
+    {
+    }
+
+    /** Create a span of const objects from a const or temporary container, e.g. a function argument. */
+    template <typename C,
+              typename = std::enable_if_t<std::is_convertible<
+                  std::remove_pointer_t<decltype(std::declval<const C&>().data())> (*)[], T (*)[]>::value>>
+    constexpr Span(const C& container) noexcept : m_data(container.data()), m_size(container.size())
+    {
+    }
+
+    constexpr T* data() const noexcept { return m_data; }
+    constexpr size_t size() const noexcept { return m_size; }
+    constexpr bool empty() const noexcept { return m_size == 0; }
+
+    constexpr T* begin() const noexcept { return m_data; }
+    constexpr T* end() const noexcept { return m_data + m_size; }
+    constexpr T& operator[](size_t pos) const noexcept { return m_data[pos]; }
+    constexpr T& front() const noexcept { return m_data[0]; }
+    constexpr T& back() const noexcept { return m_data[m_size - 1]; }
+
+    /** Return the span of count objects starting at offset. */
+    constexpr Span<T> subspan(size_t offset, size_t count) const noexcept { return Span<T>(m_data + offset, count); }
+
+private:
+    T* m_data;
+    size_t m_size;
+};
+
+using ByteSpan = Span<const uint8_t>;
+
+};     // namespace utreexo
+#endif // UTREEXO_SPAN_H
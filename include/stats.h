@@ -0,0 +1,43 @@
+#ifndef UTREEXO_STATS_H
+#define UTREEXO_STATS_H
+
+#include <stdint.h>
+
+namespace utreexo {
+
+/**
+ * A snapshot of the operation counters of the library, summed over all accumulators
+ * and threads. The counters are only compiled in when configured with --enable-stats,
+ * otherwise they cost nothing and all of them stay zero.
+ */
+struct Stats {
+    // Parent hashes computed.
+    uint64_t m_hashes{0};
+    // Leaf hashes computed from serialized UTXOs (see HashLeaves).
+    uint64_t m_leaf_hashes{0};
+    // Pollard tree nodes allocated and freed.
+    uint64_t m_nodes_allocated{0};
+    uint64_t m_nodes_freed{0};
+    // Position map lookups, inserts and erases.
+    uint64_t m_posmap_lookups{0};
+    uint64_t m_posmap_inserts{0};
+    uint64_t m_posmap_erases{0};
+    // Subtree and range swaps executed while removing or undoing.
+    uint64_t m_swaps{0};
+    // Proof hashes read from proofs during verification, and proof positions whose
+    // hash was already cached in a pollard (whether or not the proof held it).
+    uint64_t m_proof_hashes_consumed{0};
+    uint64_t m_proof_hashes_cached{0};
+    // Bytes written to the forest file and the undo journal.
+    uint64_t m_bytes_committed{0};
+};
+
+/** Return whether the library was built with the operation counters. */
+bool StatsEnabled();
+/** Return the current values of the operation counters. */
+Stats GetStats();
+/** Set all operation counters to zero. */
+void ResetStats();
+
+};     // namespace utreexo
+#endif // UTREEXO_STATS_H
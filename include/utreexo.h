@@ -3,7 +3,13 @@
 
 #include "accumulator.h"
 #include "batchproof.h"
+#include "block_processor.h"
+#include "forest_snapshot.h"
+#include "leaf_hash.h"
 #include "pollard.h"
 #include "ram_forest.h"
+#include "span.h"
+#include "stats.h"
+#include "verifier.h"
 
 #endif
@@ -0,0 +1,69 @@
+#ifndef UTREEXO_VERIFIER_H
+#define UTREEXO_VERIFIER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "accumulator.h"
+
+namespace utreexo {
+
+class BatchProof;
+
+/** The result of verifying a batch proof against roots. */
+enum class VerifyResult {
+    OK,
+    // The number of roots does not match the number of leaves.
+    INVALID_ROOTS,
+    // The targets are duplicated or out of range, or the number of target hashes does not match.
+    INVALID_TARGETS,
+    // The number of proof hashes does not match the number of proof positions.
+    INVALID_PROOF,
+    // A recomputed root does not match the root of its tree.
+    ROOT_MISMATCH,
+};
+
+/**
+ * Verify a batch proof against the roots of a forest with num_leaves leaves
+ * (roots of taller trees first). The target hashes are in the order of the sorted targets
+ * (proof.GetSortedTargets()), like for Accumulator::Verify.
+ *
+ * This needs no tree of nodes: one flat scratch array is sized from the proof positions.
+ * It holds the known and computed hashes of all rows, followed by the children of the row
+ * that is being hashed. Every row is hashed into the array in one batch.
+ */
+VerifyResult VerifyAgainstRoots(const std::vector<Hash>& roots,
+                                uint64_t num_leaves,
+                                const BatchProof& proof,
+                                const std::vector<Hash>& target_hashes);
+
+/**
+ * BatchVerifier verifies batch proofs against the roots of a forest.
+ * It holds no accumulator state besides the roots, so it can verify proofs for
+ * any accumulator (or none) and is safe to use from several threads at once.
+ *
+ * A single threaded verification is the same as VerifyAgainstRoots.
+ */
+class BatchVerifier
+{
+public:
+    /** Create a verifier for a forest with num_leaves leaves and these roots (roots of taller trees first). */
+    BatchVerifier(const std::vector<Hash>& roots, uint64_t num_leaves);
+
+    /**
+     * Verify a batch proof. The target hashes are in the order of the sorted targets
+     * (see Accumulator::Verify). A proof with targets in several trees is split by tree
+     * and the trees are verified on up to num_threads threads.
+     * Return whether or not the proof proved the target hashes.
+     */
+    bool Verify(const BatchProof& proof, const std::vector<Hash>& target_hashes, int num_threads = 1) const;
+
+    uint64_t NumLeaves() const { return m_num_leaves; }
+
+private:
+    std::vector<Hash> m_roots;
+    uint64_t m_num_leaves;
+};
+
+};     // namespace utreexo
+#endif // UTREEXO_VERIFIER_H
@@ -5,10 +5,19 @@ UTREEXO_LIB_HEADERS_INT =
 UTREEXO_LIB_HEADERS_INT += %reldir%/src/accumulator.h
 UTREEXO_LIB_HEADERS_INT += %reldir%/src/pollard.h
 UTREEXO_LIB_HEADERS_INT += %reldir%/src/ram_forest.h
+UTREEXO_LIB_HEADERS_INT += %reldir%/src/forest_snapshot.h
+UTREEXO_LIB_HEADERS_INT += %reldir%/src/verifier.h
+UTREEXO_LIB_HEADERS_INT += %reldir%/src/leaf_hash.h
+UTREEXO_LIB_HEADERS_INT += %reldir%/src/block_processor.h
+UTREEXO_LIB_HEADERS_INT += %reldir%/src/span.h
+UTREEXO_LIB_HEADERS_INT += %reldir%/src/stats.h
 UTREEXO_LIB_HEADERS_INT += %reldir%/src/attributes.h 
 UTREEXO_LIB_HEADERS_INT += %reldir%/src/check.h
+UTREEXO_LIB_HEADERS_INT += %reldir%/src/counters.h
 UTREEXO_LIB_HEADERS_INT += %reldir%/src/batchproof.h
 UTREEXO_LIB_HEADERS_INT += %reldir%/src/state.h
+UTREEXO_LIB_HEADERS_INT += %reldir%/src/prove_many.h
+UTREEXO_LIB_HEADERS_INT += %reldir%/src/undo_journal.h
 UTREEXO_LIB_HEADERS_INT += %reldir%/src/crypto/common.h
 UTREEXO_LIB_HEADERS_INT += %reldir%/src/crypto/sha512.h
 UTREEXO_LIB_HEADERS_INT += %reldir%/src/compat/byteswap.h
@@ -19,8 +28,14 @@ UTREEXO_LIB_SOURCES_INT =
 UTREEXO_LIB_SOURCES_INT += %reldir%/src/accumulator.cpp
 UTREEXO_LIB_SOURCES_INT += %reldir%/src/pollard.cpp
 UTREEXO_LIB_SOURCES_INT += %reldir%/src/ram_forest.cpp
+UTREEXO_LIB_SOURCES_INT += %reldir%/src/forest_snapshot.cpp
+UTREEXO_LIB_SOURCES_INT += %reldir%/src/verifier.cpp
+UTREEXO_LIB_SOURCES_INT += %reldir%/src/leaf_hash.cpp
+UTREEXO_LIB_SOURCES_INT += %reldir%/src/block_processor.cpp
+UTREEXO_LIB_SOURCES_INT += %reldir%/src/stats.cpp
 UTREEXO_LIB_SOURCES_INT += %reldir%/src/batchproof.cpp
 UTREEXO_LIB_SOURCES_INT += %reldir%/src/state.cpp
+UTREEXO_LIB_SOURCES_INT += %reldir%/src/undo_journal.cpp
 UTREEXO_LIB_SOURCES_INT += %reldir%/src/crypto/sha512.cpp
 
 UTREEXO_TEST_SOURCES_INT = 
@@ -37,6 +52,13 @@ UTREEXO_FUZZ_SOURCES_INT += %reldir%/src/fuzz/pollard.cpp
 UTREEXO_BENCH_SOURCES_INT = 
 UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/pollard.cpp
 UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/ram_forest.cpp
+UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/state.cpp
+UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/verifier.cpp
+UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/replay.cpp
+UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/leaf_hash.cpp
+UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/memory.cpp
+UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/scaling.cpp
+UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/sweep.cpp
 UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/bench_utreexo.cpp
 UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/bench.cpp
 UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/bench.h
@@ -44,4 +66,7 @@ UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/nanobench.cpp
 UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/nanobench.h
 UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/util/args.h
 UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/util/args.cpp
+UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/util/latency.h
 UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/util/leaves.h
+UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/util/workload.h
+UTREEXO_BENCH_SOURCES_INT += %reldir%/src/bench/util/workload.cpp
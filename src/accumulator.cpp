@@ -1,9 +1,11 @@
 #include "include/accumulator.h"
 #include "check.h"
+#include "counters.h"
 #include "crypto/common.h"
 #include "crypto/sha512.h"
 #include "include/batchproof.h"
 #include "node.h"
+#include "prove_many.h"
 #include "state.h"
 
 #include <cstring>
@@ -29,6 +31,16 @@ bool Accumulator::Modify(const std::vector<Leaf>& leaves, const std::vector<uint
     return true;
 }
 
+bool Accumulator::Modify(Span<const Hash> leaf_hashes, Span<const uint8_t> remember, Span<const uint64_t> targets)
+{
+    const LeafSpan leaves(leaf_hashes, remember);
+    if (!leaves.HasValidFlags()) return false;
+    if (!Remove(targets)) return false;
+    if (!Add(leaves)) return false;
+
+    return true;
+}
+
 void Accumulator::Roots(std::vector<Hash>& roots) const
 {
     roots.clear();
@@ -61,10 +73,35 @@ std::string HexStr(const T s)
 
 void Accumulator::ParentHash(Hash& parent, const Hash& left, const Hash& right)
 {
-    CSHA512 hasher(CSHA512::OUTPUT_SIZE_256);
-    hasher.Write(left.data(), 32);
-    hasher.Write(right.data(), 32);
-    hasher.Finalize256(parent.data());
+    uint8_t children[64];
+    std::memcpy(children, left.data(), 32);
+    std::memcpy(children + 32, right.data(), 32);
+    SHA512_256_64(parent.data(), children, 1);
+    STATS_INC(m_hashes);
+}
+
+void Accumulator::ParentHashes(Hash* parents, const Hash* children, size_t count)
+{
+    static_assert(sizeof(Hash) == 32, "hashes are stored back to back");
+    SHA512_256_64(parents->data(), children->data(), count);
+    STATS_ADD(m_hashes, count);
+}
+
+size_t Accumulator::PositionMapMemory(const std::unordered_map<Hash, uint64_t, LeafHasher>& posmap)
+{
+    // Every entry is a node with the next pointer, the entry and its cached hash code.
+    return posmap.bucket_count() * sizeof(void*) +
+           posmap.size() * (sizeof(void*) + sizeof(std::pair<const Hash, uint64_t>) + sizeof(size_t));
+}
+
+AccumulatorMemory Accumulator::MemoryUsage() const
+{
+    AccumulatorMemory usage;
+
+    usage.m_posmap = PositionMapMemory(m_posmap);
+    usage.m_nodes = m_roots.capacity() * sizeof(NodePtr<Accumulator::Node>);
+    if (m_swap_buffer) usage.m_auxiliary += sizeof(SwapBuffer) + m_swap_buffer->MemoryUsage();
+    return usage;
 }
 
 bool Accumulator::ComparePositionMap(Accumulator& other) const
@@ -94,6 +131,18 @@ void Accumulator::PrintRoots() const
     }
 }
 
+bool Accumulator::ReadMany(const std::vector<uint64_t>& positions, std::vector<Hash>& hashes) const
+{
+    hashes.clear();
+    hashes.reserve(positions.size());
+    for (const uint64_t pos : positions) {
+        std::optional<const Hash> hash = Read(pos);
+        if (!hash) return false;
+        hashes.push_back(hash.value());
+    }
+    return true;
+}
+
 void Accumulator::UpdatePositionMapForRange(uint64_t from, uint64_t to, uint64_t range)
 {
     if (m_posmap.size() == 0) {
@@ -105,6 +154,7 @@ void Accumulator::UpdatePositionMapForRange(uint64_t from, uint64_t to, uint64_t
     std::vector<Hash> to_range = ReadLeafRange(to, range);
 
     int64_t offset = static_cast<int64_t>(to) - static_cast<int64_t>(from);
+    STATS_ADD(m_posmap_lookups, from_range.size() + to_range.size());
     for (const Hash& hash : from_range) {
         auto pos_it = m_posmap.find(hash);
         if (m_posmap.find(hash) != m_posmap.end()) {
@@ -132,24 +182,24 @@ void Accumulator::UpdatePositionMapForSubtreeSwap(uint64_t from, uint64_t to)
     UpdatePositionMapForRange(start_from, start_to, range);
 }
 
-bool Accumulator::Add(const std::vector<Leaf>& leaves)
+bool Accumulator::Add(const LeafSpan& leaves)
 {
     CHECK_SAFE([](const std::unordered_map<Hash, uint64_t, LeafHasher>& posmap,
-                  const std::vector<Leaf>& leaves) {
+                  const LeafSpan& leaves) {
         // Each leaf should be unique, that means we can't add a leaf that
         // already exits in the position map.
-        for (const Leaf& leaf : leaves) {
-            if (posmap.find(leaf.first) != posmap.end()) return false;
+        for (size_t i = 0; i < leaves.size(); ++i) {
+            if (posmap.find(leaves.GetHash(i)) != posmap.end()) return false;
         }
         return true;
     }(m_posmap, leaves));
 
     ForestState current_state(m_num_leaves);
     // TODO Adding leaves can be batched. Do implement this later.
-    for (auto leaf = leaves.begin(); leaf < leaves.end(); ++leaf) {
+    for (size_t i = 0; i < leaves.size(); ++i) {
         int root = m_roots.size() - 1;
         // Create a new leaf and append it to the end of roots.
-        NodePtr<Accumulator::Node> new_root = this->NewLeaf(*leaf);
+        NodePtr<Accumulator::Node> new_root = this->NewLeaf(leaves.GetHash(i), leaves.GetRemember(i));
 
         // Merge the last two roots into one for every consecutive root from row 0 upwards.
         for (uint8_t row = 0; current_state.HasRoot(row); ++row) {
@@ -182,7 +232,7 @@ bool Accumulator::Add(const std::vector<Leaf>& leaves)
     return true;
 }
 
-bool Accumulator::Remove(const std::vector<uint64_t>& targets)
+bool Accumulator::Remove(Span<const uint64_t> targets)
 {
     if (targets.size() == 0) {
         return true;
@@ -195,7 +245,10 @@ bool Accumulator::Remove(const std::vector<uint64_t>& targets)
         return false;
     }
 
-    std::vector<std::vector<ForestState::Swap>> swaps = current_state.Transform(targets);
+    if (!m_swap_buffer) m_swap_buffer = std::make_unique<SwapBuffer>();
+    const SwapBuffer& swaps = *m_swap_buffer;
+    current_state.Transform(targets, *m_swap_buffer);
+
     // Store the nodes that have to be rehashed because their children changed.
     // These nodes are "dirty".
     std::vector<NodePtr<Accumulator::Node>> dirty_nodes;
@@ -203,10 +256,12 @@ bool Accumulator::Remove(const std::vector<uint64_t>& targets)
     for (uint8_t row = 0; row < current_state.NumRows(); ++row) {
         std::vector<NodePtr<Accumulator::Node>> next_dirty_nodes;
 
-        if (row < swaps.size()) {
+        if (row < swaps.NumRows()) {
             // Execute all the swaps in this row.
-            for (const ForestState::Swap swap : swaps.at(row)) {
+            for (const ForestState::Swap* swap_it = swaps.RowBegin(row); swap_it != swaps.RowEnd(row); ++swap_it) {
+                const ForestState::Swap& swap = *swap_it;
                 UpdatePositionMapForSubtreeSwap(swap.m_from, swap.m_to);
+                STATS_INC(m_swaps);
                 NodePtr<Accumulator::Node> swap_dirt = SwapSubTrees(swap.m_from, swap.m_to);
                 if (!swap.m_collapse) dirty_nodes.push_back(swap_dirt);
             }
@@ -235,39 +290,55 @@ bool Accumulator::Remove(const std::vector<uint64_t>& targets)
 
 bool Accumulator::Prove(BatchProof& proof, const std::vector<Hash>& target_hashes) const
 {
-    // Figure out the positions of the target hashes via the position map.
-    std::vector<uint64_t> targets;
-    targets.reserve(target_hashes.size());
-    for (const Hash& hash : target_hashes) {
-        auto posmap_it = m_posmap.find(hash);
-        if (posmap_it == m_posmap.end()) {
-            // TODO: error
-            return false;
-        }
-        targets.push_back(posmap_it->second);
-    }
+    return ProveTrimmed(proof, target_hashes, {});
+}
 
-    // We need the sorted targets to compute the proof positions.
-    std::vector<uint64_t> sorted_targets(targets);
-    std::sort(sorted_targets.begin(), sorted_targets.end());
+std::optional<uint64_t> Accumulator::Position(const Hash& hash) const
+{
+    STATS_INC(m_posmap_lookups);
+    auto posmap_it = m_posmap.find(hash);
+    if (posmap_it == m_posmap.end()) return std::nullopt;
+    return posmap_it->second;
+}
 
-    if (!ForestState(m_num_leaves).CheckTargetsSanity(sorted_targets)) {
-        return false;
+bool Accumulator::ProveTrimmed(BatchProof& proof,
+                               const std::vector<Hash>& target_hashes,
+                               const std::vector<uint64_t>& remembered) const
+{
+    ForestState state(m_num_leaves);
+    auto position = [this](const Hash& hash) { return Position(hash); };
+    auto read_many = [this](const std::vector<uint64_t>& positions, std::vector<Hash>& hashes) {
+        return ReadMany(positions, hashes);
+    };
+
+    // The peer can only remember leaves.
+    for (const uint64_t pos : remembered) {
+        if (pos >= m_num_leaves) return false;
     }
 
-    // Read proof hashes from the forest using the proof positions
-    auto proof_positions = ForestState(m_num_leaves).ProofPositions(sorted_targets);
-    std::vector<Hash> proof_hashes(proof_positions.first.size());
-    for (int i = 0; i < proof_hashes.size(); i++) {
-        std::optional<Hash> hash = Read(proof_positions.first[i]);
-        if (!hash) return false;
-
-        proof_hashes[i] = hash.value();
-    }
+    // The positions the peer has cached.
+    std::vector<uint64_t> cached_positions = state.CachedProofPositions(remembered);
+    ProveScratch scratch;
+    if (!ProveTargets(proof, target_hashes, state, cached_positions, scratch, position, read_many)) return false;
 
-    // Create the batch proof from the *unsorted* targets and the proof hashes.
-    proof = BatchProof(targets, proof_hashes);
+    // Hand the positions to the proof, so verifying it in this forest state does not recompute them.
+    proof.m_proof_positions = std::move(scratch.m_proof_positions);
+    proof.m_computed_positions = std::move(scratch.m_computed_positions);
+    proof.m_positions_num_leaves = m_num_leaves;
+    proof.m_has_positions = true;
     return true;
 }
 
+bool Accumulator::ProveMany(std::vector<BatchProof>& proofs,
+                            const std::vector<std::vector<Hash>>& target_hashes,
+                            int num_threads) const
+{
+    auto position = [this](const Hash& hash) { return Position(hash); };
+    auto read_many = [this](const std::vector<uint64_t>& positions, std::vector<Hash>& hashes) {
+        return ReadMany(positions, hashes);
+    };
+
+    return utreexo::ProveMany(proofs, target_hashes, m_num_leaves, num_threads, position, read_many);
+}
+
 }; // namespace utreexo
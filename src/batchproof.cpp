@@ -24,25 +24,67 @@ std::string HexStr(const T s)
     return rv;
 }
 
+static constexpr uint8_t BATCHPROOF_VERSION = 1;
+static constexpr uint8_t UNDOBATCH_VERSION = 1;
+static constexpr uint8_t POLLARDUNDOBATCH_VERSION = 1;
+
+// A uint64_t takes at most 10 bytes as a LEB128 varint.
+static constexpr size_t MAX_VARINT_SIZE = 10;
+
+static void WriteVarInt(std::vector<uint8_t>& bytes, uint64_t n)
+{
+    while (n >= 0x80) {
+        bytes.push_back(uint8_t(n) | 0x80);
+        n >>= 7;
+    }
+    bytes.push_back(uint8_t(n));
+}
+
+/**
+ * Read a varint from [data, end) and advance data past it.
+ * Fails on truncated, overlong or non-canonical (trailing zero group) encodings.
+ */
+static bool ReadVarInt(const uint8_t*& data, const uint8_t* end, uint64_t& n)
+{
+    n = 0;
+    for (size_t i = 0; i < MAX_VARINT_SIZE; ++i) {
+        if (data == end) return false;
+        uint8_t byte = *data++;
+
+        // The last group of a 64 bit value only has a single bit left.
+        if (i == MAX_VARINT_SIZE - 1 && byte > 1) return false;
+
+        n |= uint64_t(byte & 0x7f) << (7 * i);
+        if (!(byte & 0x80)) {
+            return i == 0 || byte != 0;
+        }
+    }
+    return false;
+}
+
+static uint64_t ZigZagEncode(uint64_t delta) { return (delta << 1) ^ (0 - (delta >> 63)); }
+
+static uint64_t ZigZagDecode(uint64_t n) { return (n >> 1) ^ (0 - (n & 1)); }
+
 void BatchProof::Serialize(std::vector<uint8_t>& bytes) const
 {
-    // Number of targets:       4 bytes
-    // Number of proof hashes:  4 bytes
-    // Targets:                 4 bytes each
-    // Proof hashes:           32 bytes each
-    bytes.resize(4 + 4 + m_targets.size() * 4 + m_proof.size() * 32);
+    bytes.clear();
+    // Sorted targets take one or two bytes on average.
+    bytes.reserve(1 + 2 * MAX_VARINT_SIZE + m_targets.size() * 2 + m_proof.size() * 32);
 
-    int data_offset = 0;
-    WriteBE32(bytes.data(), uint32_t(m_targets.size()));
-    data_offset += 4;
-    WriteBE32(bytes.data() + data_offset, uint32_t(m_proof.size()));
-    data_offset += 4;
+    bytes.push_back(BATCHPROOF_VERSION);
+    WriteVarInt(bytes, m_targets.size());
+    WriteVarInt(bytes, m_proof.size());
 
+    // The deltas wrap around, which makes the encoding lossless for any target order.
+    uint64_t prev = 0;
     for (const uint64_t target : m_targets) {
-        WriteBE32(bytes.data() + data_offset, uint32_t(target));
-        data_offset += 4;
+        WriteVarInt(bytes, ZigZagEncode(target - prev));
+        prev = target;
     }
 
+    size_t data_offset = bytes.size();
+    bytes.resize(data_offset + m_proof.size() * 32);
     for (const Hash& hash : m_proof) {
         std::memcpy(bytes.data() + data_offset, hash.data(), 32);
         data_offset += 32;
@@ -51,44 +93,17 @@ void BatchProof::Serialize(std::vector<uint8_t>& bytes) const
 
 bool BatchProof::Unserialize(const std::vector<uint8_t>& bytes)
 {
-    if (bytes.size() < 8) {
-        // 8 byte minimum for the number of targets and proof hashses
+    BatchProofView view;
+    if (!view.Unserialize(bytes.data(), bytes.size())) {
         return false;
     }
 
-    int data_offset = 0;
-    uint32_t num_targets = ReadBE32(bytes.data());
-    data_offset += 4;
-    uint32_t num_hashes = ReadBE32(bytes.data() + data_offset);
-    data_offset += 4;
-
-    if (bytes.size() != 8ULL + num_targets * 4ULL + num_hashes * 32ULL) {
-        return false;
-    }
-
-    m_targets.clear();
-    m_proof.clear();
-    m_targets.reserve(num_targets);
-    m_sorted_targets.reserve(num_targets);
-    m_proof.reserve(num_hashes);
-
-    for (uint32_t i = 0; i < num_targets; ++i) {
-        m_targets.push_back(uint64_t(ReadBE32(bytes.data() + data_offset)));
-        m_sorted_targets.push_back(uint64_t(ReadBE32(bytes.data() + data_offset)));
-        data_offset += 4;
-    }
-
+    view.GetTargets(m_targets);
+    m_has_positions = false;
+    m_sorted_targets = m_targets;
     std::sort(m_sorted_targets.begin(), m_sorted_targets.end());
 
-    for (uint32_t i = 0; i < num_hashes; ++i) {
-        Hash hash;
-        std::memcpy(hash.data(), bytes.data() + data_offset, 32);
-        data_offset += 32;
-        m_proof.push_back(hash);
-    }
-
-    assert(data_offset == bytes.size());
-
+    m_proof.assign(view.GetHashes(), view.GetHashes() + view.NumHashes());
     return true;
 }
 
@@ -100,9 +115,36 @@ bool BatchProof::CheckSanity(uint64_t num_leaves) const
         return false;
     }
 
-    std::vector<uint64_t> proof_positions, tmp;
-    std::tie(proof_positions, tmp) = state.ProofPositions(m_sorted_targets);
-    return proof_positions.size() >= m_proof.size();
+    // Only count the positions, unless they are computed already.
+    uint64_t num_proof_positions = HasPositions(num_leaves) ?
+                                       m_proof_positions.size() :
+                                       state.NumProofPositions(m_sorted_targets);
+    return num_proof_positions >= m_proof.size();
+}
+
+void BatchProof::ComputePositions(uint64_t num_leaves)
+{
+    if (HasPositions(num_leaves)) return;
+
+    ForestState(num_leaves).ProofPositions(m_sorted_targets, m_proof_positions, m_computed_positions);
+    m_positions_num_leaves = num_leaves;
+    m_has_positions = true;
+}
+
+const std::vector<uint64_t>& BatchProof::GetProofPositions() const { return m_proof_positions; }
+const std::vector<uint64_t>& BatchProof::GetComputedPositions() const { return m_computed_positions; }
+
+BatchProofPositions::BatchProofPositions(const BatchProof& proof, uint64_t num_leaves)
+{
+    if (proof.HasPositions(num_leaves)) {
+        m_proof = &proof.GetProofPositions();
+        m_computed = &proof.GetComputedPositions();
+        return;
+    }
+
+    ForestState(num_leaves).ProofPositions(proof.GetSortedTargets(), m_proof_positions, m_computed_positions);
+    m_proof = &m_proof_positions;
+    m_computed = &m_computed_positions;
 }
 
 bool BatchProof::operator==(const BatchProof& other)
@@ -130,25 +172,85 @@ const std::vector<uint64_t>& BatchProof::GetSortedTargets() const { return m_sor
 
 const std::vector<std::array<uint8_t, 32>>& BatchProof::GetHashes() const { return m_proof; }
 
-void UndoBatch::Serialize(std::vector<uint8_t>& bytes) const
+// The proof hashes are handed out as a pointer into the parsed buffer.
+static_assert(sizeof(Hash) == 32 && alignof(Hash) == 1, "Hash must have the layout of 32 bytes");
+
+bool BatchProofView::Unserialize(const uint8_t* data, size_t len)
+{
+    *this = BatchProofView();
+
+    const uint8_t* end = data + len;
+    if (len < 1 || *data++ != BATCHPROOF_VERSION) {
+        return false;
+    }
+
+    uint64_t num_targets, num_hashes;
+    if (!ReadVarInt(data, end, num_targets) || !ReadVarInt(data, end, num_hashes)) {
+        return false;
+    }
+
+    // Every target takes at least one byte.
+    if (num_targets > uint64_t(end - data)) {
+        return false;
+    }
+
+    // Validate the targets once so that decoding them later can not fail.
+    const uint8_t* targets_data = data;
+    for (uint64_t i = 0; i < num_targets; ++i) {
+        uint64_t delta;
+        if (!ReadVarInt(data, end, delta)) return false;
+    }
+
+    if (uint64_t(end - data) % 32 != 0 || uint64_t(end - data) / 32 != num_hashes) {
+        return false;
+    }
+
+    m_targets_data = targets_data;
+    m_hashes_data = data;
+    m_num_targets = num_targets;
+    m_num_hashes = num_hashes;
+    return true;
+}
+
+void BatchProofView::GetTargets(std::vector<uint64_t>& targets) const
 {
-    // num adds: 4 bytes
-    // numm dels: 4 bytes
-    // del positions: 4bytes * num dels
-    // del hashes: 32bytes * num dels
-    bytes.resize(4 + 4 + 4 * m_deleted_positions.size() + 32 * m_deleted_hashes.size());
+    targets.clear();
+    targets.reserve(m_num_targets);
+
+    const uint8_t* data = m_targets_data;
+    uint64_t prev = 0;
+    for (uint64_t i = 0; i < m_num_targets; ++i) {
+        uint64_t delta;
+        // The targets were validated while parsing.
+        if (!ReadVarInt(data, m_hashes_data, delta)) break;
+        prev += ZigZagDecode(delta);
+        targets.push_back(prev);
+    }
+}
 
-    int data_offset = 0;
-    WriteBE32(bytes.data(), uint32_t(m_num_additions));
-    data_offset += 4;
-    WriteBE32(bytes.data() + data_offset, uint32_t(m_deleted_positions.size()));
-    data_offset += 4;
+const std::array<uint8_t, 32>* BatchProofView::GetHashes() const
+{
+    return reinterpret_cast<const std::array<uint8_t, 32>*>(m_hashes_data);
+}
 
-    for (const uint64_t& target : m_deleted_positions) {
-        WriteBE32(bytes.data() + data_offset, uint32_t(target));
-        data_offset += 4;
+void UndoBatch::Serialize(std::vector<uint8_t>& bytes) const
+{
+    bytes.clear();
+    bytes.reserve(1 + 3 * MAX_VARINT_SIZE + m_deleted_positions.size() * 2 + m_deleted_hashes.size() * 32);
+
+    bytes.push_back(UNDOBATCH_VERSION);
+    WriteVarInt(bytes, m_num_additions);
+    WriteVarInt(bytes, m_deleted_positions.size());
+
+    // The deleted positions are sorted, so their deltas stay small.
+    uint64_t prev = 0;
+    for (const uint64_t pos : m_deleted_positions) {
+        WriteVarInt(bytes, ZigZagEncode(pos - prev));
+        prev = pos;
     }
 
+    size_t data_offset = bytes.size();
+    bytes.resize(data_offset + m_deleted_hashes.size() * 32);
     for (const Hash& hash : m_deleted_hashes) {
         std::memcpy(bytes.data() + data_offset, hash.data(), 32);
         data_offset += 32;
@@ -157,39 +259,44 @@ void UndoBatch::Serialize(std::vector<uint8_t>& bytes) const
 
 bool UndoBatch::Unserialize(const std::vector<uint8_t>& bytes)
 {
-    if (bytes.size() < 8) {
-        // 8 byte minmum for the number of additions and number of targets
+    const uint8_t* data = bytes.data();
+    const uint8_t* end = data + bytes.size();
+    if (bytes.size() < 1 || *data++ != UNDOBATCH_VERSION) {
         return false;
     }
 
-    int data_offset = 0;
-    m_num_additions = static_cast<uint64_t>(ReadBE32(bytes.data()));
-    data_offset += 4;
-    uint32_t num_targets = ReadBE32(bytes.data() + data_offset);
-    data_offset += 4;
-
-    if (bytes.size() != 4 + 4 + 4 * num_targets + 32 * num_targets) {
+    uint64_t num_additions, num_deleted;
+    if (!ReadVarInt(data, end, num_additions) || !ReadVarInt(data, end, num_deleted)) {
         return false;
     }
 
-    m_deleted_positions.clear();
-    m_deleted_hashes.clear();
-    m_deleted_positions.reserve(num_targets);
-    m_deleted_hashes.reserve(num_targets);
+    // Every deleted position takes at least one byte.
+    if (num_deleted > uint64_t(end - data)) {
+        return false;
+    }
 
-    for (uint32_t i = 0; i < num_targets; ++i) {
-        m_deleted_positions.push_back(static_cast<uint64_t>(ReadBE32(bytes.data() + data_offset)));
-        data_offset += 4;
+    std::vector<uint64_t> deleted_positions;
+    deleted_positions.reserve(num_deleted);
+    uint64_t prev = 0;
+    for (uint64_t i = 0; i < num_deleted; ++i) {
+        uint64_t delta;
+        if (!ReadVarInt(data, end, delta)) return false;
+        prev += ZigZagDecode(delta);
+        deleted_positions.push_back(prev);
     }
 
-    for (uint32_t i = 0; i < num_targets; ++i) {
-        Hash hash;
-        std::memcpy(hash.data(), bytes.data() + data_offset, 32);
-        data_offset += 32;
-        m_deleted_hashes.push_back(hash);
+    // Every deleted position has its hash.
+    if (uint64_t(end - data) % 32 != 0 || uint64_t(end - data) / 32 != num_deleted) {
+        return false;
     }
 
-    assert(data_offset == bytes.size());
+    m_num_additions = num_additions;
+    m_deleted_positions = std::move(deleted_positions);
+    m_deleted_hashes.resize(num_deleted);
+    for (Hash& hash : m_deleted_hashes) {
+        std::memcpy(hash.data(), data, 32);
+        data += 32;
+    }
 
     return true;
 }
@@ -223,4 +330,99 @@ void UndoBatch::Print()
     std::cout << std::endl;
 }
 
+// PollardUndoBatch
+
+/** Append a varint length prefix and the bytes. */
+static void WriteBytes(std::vector<uint8_t>& bytes, const std::vector<uint8_t>& data)
+{
+    WriteVarInt(bytes, data.size());
+    bytes.insert(bytes.end(), data.begin(), data.end());
+}
+
+/** Read bytes written by WriteBytes from [data, end) and advance data past them. */
+static bool ReadBytes(const uint8_t*& data, const uint8_t* end, std::vector<uint8_t>& out)
+{
+    uint64_t len;
+    if (!ReadVarInt(data, end, len) || len > uint64_t(end - data)) return false;
+    out.assign(data, data + len);
+    data += len;
+    return true;
+}
+
+void PollardUndoBatch::Serialize(std::vector<uint8_t>& bytes) const
+{
+    std::vector<uint8_t> undo_bytes;
+    m_undo.Serialize(undo_bytes);
+
+    bytes.clear();
+    bytes.reserve(1 + 3 * MAX_VARINT_SIZE + undo_bytes.size() +
+                  (m_prev_roots.size() + m_proof_hashes.size()) * 32 + m_remembered.size());
+
+    bytes.push_back(POLLARDUNDOBATCH_VERSION);
+    WriteBytes(bytes, undo_bytes);
+
+    WriteVarInt(bytes, m_prev_roots.size());
+    for (const Hash& root : m_prev_roots) {
+        bytes.insert(bytes.end(), root.begin(), root.end());
+    }
+
+    WriteVarInt(bytes, m_proof_hashes.size());
+    for (const Hash& hash : m_proof_hashes) {
+        bytes.insert(bytes.end(), hash.begin(), hash.end());
+    }
+
+    bytes.insert(bytes.end(), m_remembered.begin(), m_remembered.end());
+}
+
+bool PollardUndoBatch::Unserialize(const std::vector<uint8_t>& bytes)
+{
+    const uint8_t* data = bytes.data();
+    const uint8_t* end = data + bytes.size();
+    if (bytes.size() < 1 || *data++ != POLLARDUNDOBATCH_VERSION) {
+        return false;
+    }
+
+    std::vector<uint8_t> undo_bytes;
+    UndoBatch undo;
+    if (!ReadBytes(data, end, undo_bytes) || !undo.Unserialize(undo_bytes)) {
+        return false;
+    }
+
+    // There are at most 64 roots.
+    uint64_t num_roots;
+    if (!ReadVarInt(data, end, num_roots) || num_roots > 64 || num_roots * 32 > uint64_t(end - data)) {
+        return false;
+    }
+
+    std::vector<Hash> prev_roots(num_roots);
+    for (Hash& root : prev_roots) {
+        std::memcpy(root.data(), data, 32);
+        data += 32;
+    }
+
+    uint64_t num_proof_hashes;
+    if (!ReadVarInt(data, end, num_proof_hashes) || num_proof_hashes > uint64_t(end - data) / 32) {
+        return false;
+    }
+
+    std::vector<Hash> proof_hashes(num_proof_hashes);
+    for (Hash& hash : proof_hashes) {
+        std::memcpy(hash.data(), data, 32);
+        data += 32;
+    }
+
+    // The remembered flags fill the rest, with the padding bits of the last byte unset.
+    uint64_t num_deleted = undo.GetDeletedPositions().size();
+    if (uint64_t(end - data) != (num_deleted + 7) / 8) return false;
+    std::vector<uint8_t> remembered(data, end);
+    if (num_deleted % 8 != 0 && remembered.back() >> (num_deleted % 8) != 0) return false;
+
+    m_undo = std::move(undo);
+    m_prev_roots = std::move(prev_roots);
+    m_proof_hashes = std::move(proof_hashes);
+    m_remembered = std::move(remembered);
+
+    return true;
+}
+
 }; // namespace utreexo
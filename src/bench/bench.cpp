@@ -4,14 +4,202 @@
 
 #include "bench.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <map>
 #include <regex>
 #include <string>
+#include <utility>
 
 using namespace std::chrono_literals;
 
+namespace {
+// One line per result. The median is in seconds per iteration (of batch units), the error is a fraction of it.
+const char* CSV_TEMPLATE = "# Benchmark, complexityN, unit, batch, epochs, median, median absolute error\n"
+                           "{{#result}}{{name}}, {{complexityN}}, {{unit}}, {{batch}}, {{epochs}}, {{median(elapsed)}}, "
+                           "{{medianAbsolutePercentError(elapsed)}}\n{{/result}}";
+
+void GenerateTemplateResults(const std::vector<ankerl::nanobench::Result>& benchmarkResults, const std::string& filename, const char* tpl)
+{
+    if (benchmarkResults.empty() || filename.empty()) {
+        // nothing to write, bail out
+        return;
+    }
+    std::ofstream fout(filename);
+    if (!fout.is_open()) {
+        std::cout << "Could not write to file '" << filename << "'" << std::endl;
+        return;
+    }
+    ankerl::nanobench::render(tpl, benchmarkResults, fout);
+    std::cout << "Created '" << filename << "'" << std::endl;
+}
+
+// Benchmarks are identified by their name and complexityN.
+using BenchmarkKey = std::pair<std::string, double>;
+
+/** Return the median time per unit of a result, in seconds. */
+double TimePerUnit(const ankerl::nanobench::Result& result)
+{
+    return result.median(ankerl::nanobench::Result::Measure::elapsed) / result.config().mBatch;
+}
+
+/**
+ * Print the complexity fits of every benchmark name that ran for several complexityN,
+ * like Bench::complexityBigO but separately for every name of a benchmark.
+ */
+void PrintComplexityBigO(const std::vector<ankerl::nanobench::Result>& results)
+{
+    using ankerl::nanobench::BigO;
+
+    std::vector<std::string> names;
+    std::map<std::string, std::vector<ankerl::nanobench::Result>> results_by_name;
+    for (const auto& result : results) {
+        const std::string& name = result.config().mBenchmarkName;
+        if (results_by_name.count(name) == 0) names.push_back(name);
+        results_by_name[name].push_back(result);
+    }
+
+    for (const std::string& name : names) {
+        const auto range_measure = BigO::collectRangeMeasure(results_by_name[name]);
+        if (range_measure.size() < 2) continue;
+
+        std::vector<BigO> big_os;
+        big_os.emplace_back("O(1)", range_measure, [](double) { return 1.0; });
+        big_os.emplace_back("O(n)", range_measure, [](double n) { return n; });
+        big_os.emplace_back("O(log n)", range_measure, [](double n) { return std::log2(n); });
+        big_os.emplace_back("O(n log n)", range_measure, [](double n) { return n * std::log2(n); });
+        big_os.emplace_back("O(n^2)", range_measure, [](double n) { return n * n; });
+        big_os.emplace_back("O(n^3)", range_measure, [](double n) { return n * n * n; });
+        std::sort(big_os.begin(), big_os.end());
+        std::cout << std::endl
+                  << name << big_os;
+    }
+}
+
+/**
+ * Print the hardware counters of every result per unit, along with the instructions per
+ * cycle. Many cache misses per unit with a low IPC point at a memory bound benchmark.
+ */
+void PrintPerfCounters(const std::vector<ankerl::nanobench::Result>& benchmarkResults)
+{
+    using Measure = ankerl::nanobench::Result::Measure;
+
+    bool has_counters = false;
+    for (const auto& result : benchmarkResults) has_counters |= result.has(Measure::instructions);
+    if (!has_counters) {
+        std::cout << std::endl
+                  << "Hardware performance counters are not available. perf_event_open failed, see" << std::endl
+                  << "/proc/sys/kernel/perf_event_paranoid, or the machine does not expose them (e.g. a VM)." << std::endl;
+        return;
+    }
+
+    // Print a counter per unit, or a dash if it was not measured.
+    const auto per_unit = [](const ankerl::nanobench::Result& result, Measure m, int width) {
+        std::cout << " | " << std::setw(width);
+        if (result.has(m)) {
+            std::cout << std::fixed << std::setprecision(2) << result.median(m) / result.config().mBatch;
+        } else {
+            std::cout << "-";
+        }
+    };
+
+    std::cout << std::endl
+              << "|   ins/unit |   cyc/unit |   IPC | bra miss/unit | cache miss/unit | benchmark" << std::endl
+              << "|-----------:|-----------:|------:|--------------:|----------------:|:----------" << std::endl;
+    for (const auto& result : benchmarkResults) {
+        std::cout << "|";
+        per_unit(result, Measure::instructions, 10);
+        per_unit(result, Measure::cpucycles, 10);
+        std::cout << " | " << std::setw(5);
+        if (result.has(Measure::instructions) && result.has(Measure::cpucycles) && result.median(Measure::cpucycles) > 0) {
+            std::cout << std::fixed << std::setprecision(2) << result.median(Measure::instructions) / result.median(Measure::cpucycles);
+        } else {
+            std::cout << "-";
+        }
+        per_unit(result, Measure::branchmisses, 13);
+        per_unit(result, Measure::cachemisses, 15);
+        std::cout << " | " << result.config().mBenchmarkName;
+        if (result.config().mComplexityN > 0) std::cout << " (N=" << std::defaultfloat << result.config().mComplexityN << ")";
+        std::cout << std::defaultfloat << std::endl;
+    }
+}
+
+/**
+ * Read the median time per unit of every result in a file written with -output-json.
+ * Only the keys that -compare needs are parsed, one "key": value pair per line.
+ */
+bool ReadBaseline(const std::string& filename, std::map<BenchmarkKey, double>& baseline)
+{
+    std::ifstream fin(filename);
+    if (!fin.is_open()) return false;
+
+    std::string name;
+    double batch = 1, complexity_n = -1;
+    std::string line;
+    while (std::getline(fin, line)) {
+        const size_t key_begin = line.find('"');
+        const size_t key_end = line.find("\": ", key_begin + 1);
+        if (key_begin == std::string::npos || key_end == std::string::npos) continue;
+
+        const std::string key = line.substr(key_begin + 1, key_end - key_begin - 1);
+        std::string value = line.substr(key_end + 3);
+        if (!value.empty() && value.back() == ',') value.pop_back();
+
+        if (key == "name") {
+            name = value.size() >= 2 ? value.substr(1, value.size() - 2) : value;
+        } else if (key == "batch") {
+            batch = std::stod(value);
+        } else if (key == "complexityN") {
+            complexity_n = std::stod(value);
+        } else if (key == "median(elapsed)") {
+            baseline[{name, complexity_n}] = std::stod(value) / batch;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Print the change of every result against the baseline and flag the ones that are
+ * slower by more than threshold_percent. Return false if any of them is.
+ */
+bool CompareResults(const std::vector<ankerl::nanobench::Result>& benchmarkResults,
+                    const std::map<BenchmarkKey, double>& baseline,
+                    double threshold_percent)
+{
+    size_t num_slower = 0;
+    std::cout << std::endl
+              << "| change | baseline ns/unit | ns/unit | benchmark" << std::endl
+              << "|-------:|-----------------:|--------:|:----------" << std::endl;
+    for (const auto& result : benchmarkResults) {
+        const BenchmarkKey key{result.config().mBenchmarkName, result.config().mComplexityN};
+        const auto it = baseline.find(key);
+        if (it == baseline.end() || it->second <= 0) continue;
+
+        const double now = TimePerUnit(result);
+        const double change = 100 * (now / it->second - 1);
+        const bool slower = change > threshold_percent;
+        num_slower += slower;
+
+        std::cout << "| " << std::showpos << std::fixed << std::setprecision(1) << std::setw(5) << change << "%"
+                  << std::noshowpos << std::setprecision(2)
+                  << " | " << std::setw(16) << it->second * 1e9
+                  << " | " << std::setw(7) << now * 1e9
+                  << " | " << key.first;
+        if (key.second > 0) std::cout << " (N=" << std::defaultfloat << key.second << ")";
+        std::cout << std::defaultfloat << (slower ? " SLOWER" : "") << std::endl;
+    }
+
+    std::cout << std::endl
+              << num_slower << " benchmark(s) slowed down by more than " << threshold_percent << "%" << std::endl;
+    return num_slower == 0;
+}
+} // namespace
+
 benchmark::BenchRunner::BenchmarkMap& benchmark::BenchRunner::benchmarks()
 {
     static std::map<std::string, BenchFunction> benchmarks_map;
@@ -23,8 +211,14 @@ benchmark::BenchRunner::BenchRunner(std::string name, benchmark::BenchFunction f
     benchmarks().insert(std::make_pair(name, func));
 }
 
-void benchmark::BenchRunner::RunAll(const Args& args)
+bool benchmark::BenchRunner::RunAll(const Args& args)
 {
+    std::map<BenchmarkKey, double> baseline;
+    if (!args.compare.empty() && !ReadBaseline(args.compare, baseline)) {
+        std::cout << "Could not read baseline file '" << args.compare << "'" << std::endl;
+        return false;
+    }
+
     std::regex reFilter(args.regex_filter);
     std::smatch baseMatch;
 
@@ -36,6 +230,7 @@ void benchmark::BenchRunner::RunAll(const Args& args)
 
         Bench bench;
         bench.name(p.first);
+        bench.performanceCounters(args.perf);
         if (args.min_time > 0ms) {
             // convert to nanos before dividing to reduce rounding errors
             std::chrono::nanoseconds min_time_ns = args.min_time;
@@ -49,11 +244,18 @@ void benchmark::BenchRunner::RunAll(const Args& args)
                 bench.complexityN(n);
                 p.second(bench);
             }
-            std::cout << bench.complexityBigO() << std::endl;
+            PrintComplexityBigO(bench.results());
         }
 
-        if (!bench.results().empty()) {
-            benchmarkResults.push_back(bench.results().back());
-        }
+        // Keep the result of every complexityN.
+        benchmarkResults.insert(benchmarkResults.end(), bench.results().begin(), bench.results().end());
     }
+
+    if (args.perf) PrintPerfCounters(benchmarkResults);
+
+    GenerateTemplateResults(benchmarkResults, args.output_csv, CSV_TEMPLATE);
+    GenerateTemplateResults(benchmarkResults, args.output_json, ankerl::nanobench::templates::json());
+
+    if (args.compare.empty()) return true;
+    return CompareResults(benchmarkResults, baseline, args.compare_threshold);
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include <functional>
 #include <map>
 #include <string>
+#include <vector>
 
 /*
  * Usage:
@@ -45,6 +46,13 @@ struct Args {
     std::chrono::milliseconds min_time;
     std::vector<double> asymptote;
     std::string regex_filter;
+    // Show the hardware performance counters of every benchmark.
+    bool perf;
+    std::string output_csv;
+    std::string output_json;
+    // A file written with output_json to compare the results against.
+    std::string compare;
+    double compare_threshold;
 };
 
 class BenchRunner
@@ -55,8 +63,19 @@ class BenchRunner
 public:
     BenchRunner(std::string name, BenchFunction func);
 
-    static void RunAll(const Args& args);
+    /**
+     * Run the benchmarks that match the filter and write their results to the output files.
+     * Return false if a comparison was requested and a benchmark got slower than the baseline
+     * by more than the threshold (or the baseline could not be read).
+     */
+    static bool RunAll(const Args& args);
 };
+
+/**
+ * Print the bytes per leaf of forests and pollards with num_leaves leaves, for
+ * several ratios of remembered leaves, broken down like AccumulatorMemory.
+ */
+void RunMemoryReport(const std::vector<double>& num_leaves);
 } // namespace benchmark
 
 // BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
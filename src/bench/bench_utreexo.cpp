@@ -8,18 +8,37 @@
 
 static const char* DEFAULT_BENCH_FILTER = ".*";
 static constexpr int64_t DEFAULT_MIN_TIME_MS{10};
+static constexpr int64_t DEFAULT_COMPARE_THRESHOLD{10};
+static const char* SWEEP_BENCH_FILTER = "AccumulatorSweep";
 
 using namespace benchmark;
 
 static void SetupBenchArgs(ArgsManager& argsman)
 {
     argsman.AddArg("-asymptote=<n1,n2,n3,...>", "Test asymptotic growth of the runtime of an algorithm, if supported by the benchmark");
+    argsman.AddArg("-compare=<baseline.json>", "Compare the results against a file written with -output-json and exit with an error if a benchmark got slower than -compare_threshold");
+    argsman.AddArg("-compare_threshold=<percent>", "Slowdown against the -compare baseline that is flagged, in percent (default: " + std::to_string(DEFAULT_COMPARE_THRESHOLD) + ")");
     argsman.AddArg("-filter=<regex>", "Regular expression filter to select benchmark by name (default: " + std::string(DEFAULT_BENCH_FILTER) + ")");
+    argsman.AddArg("-memory", "Report the memory usage per leaf for several forest sizes (set with -asymptote) and remember ratios instead of running benchmarks");
     argsman.AddArg("-min_time=<milliseconds>", "Minimum runtime per benchmark, in milliseconds (default: " + std::to_string(DEFAULT_MIN_TIME_MS) + ")");
+    argsman.AddArg("-output-csv=<output.csv>", "Generate CSV file with the most important benchmark results");
+    argsman.AddArg("-output-json=<output.json>", "Generate JSON file with all benchmark results");
+    argsman.AddArg("-perf", "Show instructions, cycles, branch misses and cache misses per unit of every benchmark (Linux only, uses perf_event_open)");
+    argsman.AddArg("-sweep=<small|medium|large|huge>", "Run AccumulatorSweep for a preset of forest sizes: small (8k-64k leaves), medium (256k-1M), large (2M-16M) or huge (32M-100M, needs about 16 GB of memory)");
     // help options
     argsman.AddArg("-?", "Print this help message and exit");
 }
 
+// Return the forest sizes of a -sweep preset, or nothing for an unknown preset.
+static std::vector<double> SweepPreset(const std::string& preset)
+{
+    if (preset == "small") return {1 << 13, 1 << 14, 1 << 15, 1 << 16};
+    if (preset == "medium") return {1 << 18, 1 << 19, 1 << 20};
+    if (preset == "large") return {1 << 21, 1 << 22, 1 << 23, 1 << 24};
+    if (preset == "huge") return {1 << 25, 1 << 26, 100000000};
+    return {};
+}
+
 // parses a comma separated list like "10,20,30,50"
 static std::vector<double> parseAsymptote(const std::string& str)
 {
@@ -96,8 +115,26 @@ int main(int argc, char** argv)
     args.asymptote = parseAsymptote(argsman.GetArg("-asymptote", ""));
     args.min_time = std::chrono::milliseconds(argsman.GetIntArg("-min_time", DEFAULT_MIN_TIME_MS));
     args.regex_filter = argsman.GetArg("-filter", DEFAULT_BENCH_FILTER);
+    args.perf = argsman.IsArgSet("-perf");
+    args.output_csv = argsman.GetArg("-output-csv", "");
+    args.output_json = argsman.GetArg("-output-json", "");
+    args.compare = argsman.GetArg("-compare", "");
+    args.compare_threshold = argsman.GetIntArg("-compare_threshold", DEFAULT_COMPARE_THRESHOLD);
 
-    BenchRunner::RunAll(args);
+    if (argsman.IsArgSet("-sweep")) {
+        // The sizes are only meaningful to AccumulatorSweep, so it is the only benchmark unless filtered otherwise.
+        if (!argsman.IsArgSet("-asymptote")) args.asymptote = SweepPreset(argsman.GetArg("-sweep", ""));
+        if (args.asymptote.empty()) {
+            std::cout << "Unknown -sweep preset '" << argsman.GetArg("-sweep", "") << "'" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!argsman.IsArgSet("-filter")) args.regex_filter = SWEEP_BENCH_FILTER;
+    }
+
+    if (argsman.IsArgSet("-memory")) {
+        RunMemoryReport(args.asymptote);
+        return EXIT_SUCCESS;
+    }
 
-    return EXIT_SUCCESS;
+    return BenchRunner::RunAll(args) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
\ No newline at end of file
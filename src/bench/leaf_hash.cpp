@@ -0,0 +1,52 @@
+#include "bench.h"
+#include "crypto/sha512.h"
+#include "include/utreexo.h"
+
+#include <vector>
+
+using namespace utreexo;
+
+// The serialized UTXOs of a block, of the size of a typical UTXO with a P2WPKH script.
+static void CreateUTXOData(std::vector<std::vector<uint8_t>>& utxos, int count)
+{
+    utxos.assign(count, std::vector<uint8_t>(90));
+    for (int i = 0; i < count; ++i) {
+        for (size_t j = 0; j < utxos[i].size(); ++j) utxos[i][j] = static_cast<uint8_t>(i + j);
+    }
+}
+
+// Hash the UTXOs of a block with HashLeaves.
+static void HashLeavesBlock(benchmark::Bench& bench)
+{
+    const int num_utxos = bench.complexityN() > 1 ? static_cast<int>(bench.complexityN()) : 2000;
+
+    std::vector<std::vector<uint8_t>> utxos;
+    CreateUTXOData(utxos, num_utxos);
+    std::vector<ByteSpan> utxo_data(utxos.begin(), utxos.end());
+    std::vector<Hash> hashes(num_utxos);
+
+    bench.batch(num_utxos).unit("leaf").run([&] {
+        bool ok = HashLeaves(utxo_data, hashes);
+        ankerl::nanobench::doNotOptimizeAway(ok);
+    });
+}
+
+// Hash the same UTXOs one at a time with the streaming hasher.
+static void HashLeavesStreaming(benchmark::Bench& bench)
+{
+    const int num_utxos = bench.complexityN() > 1 ? static_cast<int>(bench.complexityN()) : 2000;
+
+    std::vector<std::vector<uint8_t>> utxos;
+    CreateUTXOData(utxos, num_utxos);
+    std::vector<Hash> hashes(num_utxos);
+
+    bench.batch(num_utxos).unit("leaf").run([&] {
+        for (int i = 0; i < num_utxos; ++i) {
+            CSHA512(CSHA512::OUTPUT_SIZE_256).Write(utxos[i].data(), utxos[i].size()).Finalize256(hashes[i].data());
+        }
+        ankerl::nanobench::doNotOptimizeAway(hashes);
+    });
+}
+
+BENCHMARK(HashLeavesBlock);
+BENCHMARK(HashLeavesStreaming);
@@ -0,0 +1,61 @@
+#include "bench.h"
+#include "include/utreexo.h"
+#include "util/leaves.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace utreexo;
+
+static void PrintMemoryRow(const char* name, uint64_t num_leaves, double remember_ratio, const AccumulatorMemory& usage)
+{
+    const double leaves = static_cast<double>(num_leaves);
+    std::printf("| %-9s | %10llu | %8.2f | %11.2f | %11.2f | %8.2f | %8.2f | %14.2f | %9.2f | %9.2f |\n",
+                name, static_cast<unsigned long long>(num_leaves), remember_ratio,
+                usage.Total() / leaves, usage.m_forest_data / leaves, usage.m_posmap / leaves,
+                usage.m_nodes / leaves, usage.m_control_blocks / leaves,
+                usage.m_snapshots / leaves, usage.m_auxiliary / leaves);
+}
+
+void benchmark::RunMemoryReport(const std::vector<double>& num_leaves)
+{
+    std::vector<double> sizes = num_leaves;
+    if (sizes.empty()) sizes = {1 << 10, 1 << 14, 1 << 18};
+
+    std::printf("| %-9s | %10s | %8s | %11s | %11s | %8s | %8s | %14s | %9s | %9s |\n",
+                "", "leaves", "remember", "bytes/leaf", "forest data", "posmap", "nodes", "control blocks",
+                "snapshots", "auxiliary");
+    std::printf("|:----------|-----------:|---------:|------------:|------------:|---------:|---------:|---------------:|----------:|----------:|\n");
+
+    std::mt19937_64 rng_targets(0);
+    for (double size : sizes) {
+        std::vector<Leaf> leaves;
+        CreateTestLeaves(leaves, static_cast<int>(size));
+
+        UndoBatch unused_undo;
+        RamForest full(0);
+        full.Modify(unused_undo, leaves, {});
+        PrintMemoryRow("forest", full.NumLeaves(), 1.0, full.MemoryUsage());
+
+        // A forest that publishes snapshots for concurrent provers, after a block that removes leaves.
+        RamForest snapshots(0);
+        snapshots.EnableSnapshots();
+        snapshots.Modify(unused_undo, leaves, {});
+        std::vector<uint64_t> targets = RandomPositions(rng_targets, snapshots.NumLeaves(), snapshots.NumLeaves() / 100);
+        std::sort(targets.begin(), targets.end());
+        snapshots.Modify(unused_undo, {}, targets);
+        PrintMemoryRow("snapshots", snapshots.NumLeaves(), 1.0, snapshots.MemoryUsage());
+
+        for (double remember_ratio : {0.0, 0.01, 0.1, 0.5, 1.0}) {
+            std::mt19937_64 rng(0);
+            std::bernoulli_distribution remember(remember_ratio);
+            for (Leaf& leaf : leaves) leaf.second = remember(rng);
+
+            Pollard pruned(0);
+            pruned.Modify(leaves, {});
+            PrintMemoryRow("pollard", pruned.NumLeaves(), remember_ratio, pruned.MemoryUsage());
+        }
+    }
+}
@@ -180,7 +180,7 @@ class BigO;
  *    Apart from these tags, it is also possible to use some mathematical operations on the measurement data. The operations
  *    are of the form `{{command(name)}}`.  Currently `name` can be one of `elapsed`, `iterations`. If performance counters
  *    are available (currently only on current Linux systems), you also have `pagefaults`, `cpucycles`,
- *    `contextswitches`, `instructions`, `branchinstructions`, and `branchmisses`. All the measuers (except `iterations`) are
+ *    `contextswitches`, `instructions`, `branchinstructions`, `branchmisses`, and `cachemisses`. All the measuers (except `iterations`) are
  *    provided for a single iteration (so `elapsed` is the time a single iteration took). The following tags are available:
  *
  *    * `{{median(<name>)}}` Calculate median of a measurement data set, e.g. `{{median(elapsed)}}`.
@@ -235,6 +235,8 @@ class BigO;
  *
  *       * `{{branchmisses}}` Average number of branches that were missed per iteration.
  *
+ *       * `{{cachemisses}}` Average number of last level cache misses per iteration.
+ *
  *    * `{{/measurement}}` Ends the measurement tag.
  *
  * * `{{/result}}` Marks the end of the result layer. This is the end marker for the template part that will be instantiated
@@ -371,6 +373,7 @@ struct PerfCountSet {
     T instructions{};
     T branchInstructions{};
     T branchMisses{};
+    T cacheMisses{};
 };
 
 } // namespace detail
@@ -418,6 +421,7 @@ public:
         instructions,
         branchinstructions,
         branchmisses,
+        cachemisses,
         _size
     };
 
@@ -1406,6 +1410,7 @@ char const* json() noexcept {
             "median(pagefaults)": {{median(pagefaults)}},
             "median(branchinstructions)": {{median(branchinstructions)}},
             "median(branchmisses)": {{median(branchmisses)}},
+            "median(cachemisses)": {{median(cachemisses)}},
             "totalTime": {{sumProduct(iterations, elapsed)}},
             "measurements": [
 {{#measurement}}                {
@@ -1416,7 +1421,8 @@ char const* json() noexcept {
                     "contextswitches": {{contextswitches}},
                     "instructions": {{instructions}},
                     "branchinstructions": {{branchinstructions}},
-                    "branchmisses": {{branchmisses}}
+                    "branchmisses": {{branchmisses}},
+                    "cachemisses": {{cachemisses}}
                 }{{^-last}},{{/-last}}
 {{/measurement}}            ]
         }{{^-last}},{{/-last}}
@@ -2623,6 +2629,7 @@ PerformanceCounters::PerformanceCounters()
         mPc->monitor(PERF_COUNT_HW_BRANCH_INSTRUCTIONS, LinuxPerformanceCounters::Target(&mVal.branchInstructions, true, false));
     mHas.branchMisses = mPc->monitor(PERF_COUNT_HW_BRANCH_MISSES, LinuxPerformanceCounters::Target(&mVal.branchMisses, true, false));
     // mHas.branchMisses = false;
+    mHas.cacheMisses = mPc->monitor(PERF_COUNT_HW_CACHE_MISSES, LinuxPerformanceCounters::Target(&mVal.cacheMisses, true, false));
 
     mPc->start();
     mPc->calibrate([] {
@@ -2875,6 +2882,9 @@ void Result::add(Clock::duration totalElapsed, uint64_t iters, detail::Performan
             mNameToMeasurements[u(Result::Measure::branchmisses)].push_back(branchMisses / dIters);
         }
     }
+    if (pc.has().cacheMisses) {
+        mNameToMeasurements[u(Result::Measure::cachemisses)].push_back(d(pc.val().cacheMisses) / dIters);
+    }
 }
 
 Config const& Result::config() const noexcept {
@@ -3004,6 +3014,8 @@ Result::Measure Result::fromString(std::string const& str) {
         return Measure::branchinstructions;
     } else if (str == "branchmisses") {
         return Measure::branchmisses;
+    } else if (str == "cachemisses") {
+        return Measure::cachemisses;
     } else {
         // not found, return _size
         return Measure::_size;
@@ -2,6 +2,7 @@
 #include "include/utreexo.h"
 #include "util/leaves.h"
 
+#include <thread>
 #include <vector>
 
 using namespace utreexo;
@@ -40,6 +41,23 @@ static void AddElementsWithModifyForest(benchmark::Bench& bench)
     AddElements(bench, true);
 }
 
+// Benchmarks the creation of leaves using Modify with the leaf hashes in their own array
+static void AddElementsWithSpanModifyForest(benchmark::Bench& bench)
+{
+    UndoBatch unused_undo;
+    const int num_leaves = bench.complexityN() > 1 ? static_cast<int>(bench.complexityN()) : 64;
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, num_leaves);
+    std::vector<Hash> hashes;
+    for (const Leaf& leaf : leaves) hashes.push_back(leaf.first);
+
+    bench.run([&]() {
+        RamForest full(0);
+        full.Modify(unused_undo, hashes, {});
+    });
+}
+
 // Benchmarks the restoration from disk
 static void RestoreFromDiskForest(benchmark::Bench& bench)
 {
@@ -106,12 +124,61 @@ static void VerifyElementsForest(benchmark::Bench& bench)
     }
     full.Prove(proof, leaf_hashes); // prove elements in the forest
 
+    // Verify expects the hashes in the order of the sorted targets.
+    leaf_hashes.clear();
+    for (const uint64_t pos : proof.GetSortedTargets()) leaf_hashes.push_back(full.GetLeaf(pos));
+
     // Benchmark
     bench.unit("verification").run([&] {
         full.Verify(proof, leaf_hashes);
     });
 }
 
+// Create a forest and one request with two leaves for every 64 leaves.
+static void CreateProofRequests(RamForest& full, std::vector<std::vector<Hash>>& requests, int num_requests)
+{
+    UndoBatch unused_undo;
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, num_requests * 64);
+    full.Modify(unused_undo, leaves, {});
+
+    random_unique(leaves.begin(), leaves.end(), num_requests * 2);
+    for (int i = 0; i < num_requests; ++i) {
+        requests.push_back({leaves[2 * i].first, leaves[2 * i + 1].first});
+    }
+}
+
+// Benchmarks proving many small requests one by one
+static void ProveRequestsForest(benchmark::Bench& bench)
+{
+    const int num_requests = bench.complexityN() > 1 ? static_cast<int>(bench.complexityN()) : 1000;
+    RamForest full(0);
+    std::vector<std::vector<Hash>> requests;
+    CreateProofRequests(full, requests, num_requests);
+
+    std::vector<BatchProof> proofs(num_requests);
+    bench.unit("request").batch(num_requests).run([&] {
+        for (int i = 0; i < num_requests; ++i) {
+            full.Prove(proofs[i], requests[i]);
+        }
+    });
+}
+
+// Benchmarks proving many small requests with ProveMany on all cores
+static void ProveManyForest(benchmark::Bench& bench)
+{
+    const int num_requests = bench.complexityN() > 1 ? static_cast<int>(bench.complexityN()) : 1000;
+    RamForest full(0);
+    std::vector<std::vector<Hash>> requests;
+    CreateProofRequests(full, requests, num_requests);
+
+    const int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<BatchProof> proofs;
+    bench.unit("request").batch(num_requests).run([&] {
+        full.ProveMany(proofs, requests, num_threads);
+    });
+}
+
 // Benchmarks the removal of half the number of created leaves
 // this benchmark unavoidably includes the creation of the leaves
 static void RemoveElementsForest(benchmark::Bench& bench)
@@ -150,9 +217,46 @@ static void RemoveElementsForest(benchmark::Bench& bench)
     });
 }
 
+// Benchmarks the rollback of the removal of half the number of created leaves
+// this benchmark unavoidably includes redoing the removal
+static void UndoRemoveElementsForest(benchmark::Bench& bench)
+{
+    BatchProof proof;
+    const int num_leaves_to_remove = bench.complexityN() > 1 ? static_cast<int>(bench.complexityN()) : 32;
+    const int num_leaves = num_leaves_to_remove * 2;
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, num_leaves);
+
+    // select leaves to remove
+    std::vector<Hash> leaf_hashes;
+    std::vector<Leaf> leaves_to_shuffle(leaves); // copy leaves
+    random_unique(leaves_to_shuffle.begin(), leaves_to_shuffle.end(), num_leaves_to_remove);
+    for (int i = 0; i < num_leaves_to_remove; ++i) {
+        leaf_hashes.push_back(leaves_to_shuffle[i].first);
+    }
+
+    RamForest full(0);
+    full.Add(leaves);
+    full.Prove(proof, leaf_hashes);
+
+    UndoBatch undo;
+    full.Modify(undo, {}, proof.GetSortedTargets());
+
+    // Benchmark
+    bench.run([&]() {
+        full.Undo(undo);
+        full.Modify(undo, {}, proof.GetSortedTargets());
+    });
+}
+
 BENCHMARK(AddElementsForest);
 BENCHMARK(AddElementsWithModifyForest);
+BENCHMARK(AddElementsWithSpanModifyForest);
 BENCHMARK(RestoreFromDiskForest);
 BENCHMARK(ProveElementsForest);
+BENCHMARK(ProveRequestsForest);
+BENCHMARK(ProveManyForest);
 BENCHMARK(VerifyElementsForest);
-BENCHMARK(RemoveElementsForest);
\ No newline at end of file
+BENCHMARK(RemoveElementsForest);
+BENCHMARK(UndoRemoveElementsForest);
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "bench.h"
+#include "include/utreexo.h"
+#include "util/latency.h"
+#include "util/workload.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace utreexo;
+
+static void PrintLatencies(const std::string& name, std::vector<std::chrono::nanoseconds>& latencies)
+{
+    using std::chrono::microseconds;
+    std::cout << name << ": p50 " << std::chrono::duration_cast<microseconds>(benchmark::Percentile(latencies, 0.50)).count()
+              << " us/block, p99 " << std::chrono::duration_cast<microseconds>(benchmark::Percentile(latencies, 0.99)).count()
+              << " us/block" << std::endl;
+}
+
+// Replay a generated chain: a bridge proves the spends of every block and modifies its forest,
+// a pollard verifies the proof and modifies itself. Reports the per block latencies of both.
+static void BlockReplay(benchmark::Bench& bench)
+{
+    const int num_blocks = bench.complexityN() > 1 ? static_cast<int>(bench.complexityN()) : 2000;
+
+    benchmark::WorkloadParams params;
+    params.m_remember_lifetime = 10;
+    benchmark::WorkloadGenerator generator(params);
+
+    std::vector<benchmark::WorkloadBlock> blocks(num_blocks);
+    for (benchmark::WorkloadBlock& block : blocks) generator.Next(block);
+
+    std::vector<std::chrono::nanoseconds> forest_latencies, pollard_latencies;
+
+    // Every run replays the whole chain from scratch.
+    bench.epochs(1).epochIterations(1).batch(num_blocks).unit("block").run([&] {
+        RamForest full(0);
+        Pollard pruned(0);
+        UndoBatch undo;
+        BatchProof proof;
+        std::vector<uint64_t> order;
+        std::vector<Hash> sorted_spends;
+
+        forest_latencies.clear();
+        pollard_latencies.clear();
+        for (const benchmark::WorkloadBlock& block : blocks) {
+            auto start = std::chrono::steady_clock::now();
+            bool ok = full.Prove(proof, block.m_spends);
+            ok = ok && full.Modify(undo, block.m_adds, proof.GetSortedTargets());
+            auto forest_done = std::chrono::steady_clock::now();
+
+            // The pollard expects the target hashes in the order of the sorted targets.
+            const std::vector<uint64_t>& targets = proof.GetTargets();
+            order.resize(targets.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&targets](uint64_t a, uint64_t b) { return targets[a] < targets[b]; });
+            sorted_spends.clear();
+            for (const uint64_t i : order) sorted_spends.push_back(block.m_spends[i]);
+
+            ok = ok && pruned.Verify(proof, sorted_spends);
+            ok = ok && pruned.Modify(block.m_adds, proof.GetSortedTargets());
+            auto pollard_done = std::chrono::steady_clock::now();
+            assert(ok);
+
+            forest_latencies.push_back(forest_done - start);
+            pollard_latencies.push_back(pollard_done - forest_done);
+        }
+    });
+
+    PrintLatencies(bench.name() + " forest (Prove + Modify)", forest_latencies);
+    PrintLatencies(bench.name() + " pollard (Verify + Modify)", pollard_latencies);
+}
+
+// The number of blocks that BlockConnect benchmarks replay.
+static constexpr int CONNECT_NUM_BLOCKS{1000};
+
+/**
+ * Create the BlockData of a generated chain, as a bridge would send it. The serialized
+ * outputs are the generated hashes, so the leaves are their hashes.
+ */
+static void CreateConnectBlocks(std::vector<BlockData>& blocks, int num_blocks)
+{
+    benchmark::WorkloadParams params;
+    params.m_remember_lifetime = 10;
+    benchmark::WorkloadGenerator generator(params);
+
+    RamForest full(0);
+    UndoBatch undo;
+    BatchProof proof;
+    benchmark::WorkloadBlock workload;
+    std::vector<ByteSpan> utxo_data;
+    std::vector<Hash> spent_hashes, add_hashes;
+    std::vector<Leaf> adds;
+
+    blocks.resize(num_blocks);
+    for (BlockData& block : blocks) {
+        generator.Next(workload);
+
+        utxo_data.assign(workload.m_spends.begin(), workload.m_spends.end());
+        spent_hashes.resize(utxo_data.size());
+        bool ok = HashLeaves(utxo_data, spent_hashes);
+        ok = ok && full.Prove(proof, spent_hashes);
+        proof.Serialize(block.m_proof);
+        for (const Hash& spend : workload.m_spends) block.m_spent.emplace_back(spend.begin(), spend.end());
+
+        adds = workload.m_adds;
+        block.m_remember.assign((adds.size() + 7) / 8, 0);
+        for (size_t i = 0; i < adds.size(); ++i) {
+            block.m_created.emplace_back(adds[i].first.begin(), adds[i].first.end());
+            if (adds[i].second) block.m_remember[i / 8] |= 1 << (i % 8);
+        }
+        utxo_data.assign(block.m_created.begin(), block.m_created.end());
+        add_hashes.resize(utxo_data.size());
+        ok = ok && HashLeaves(utxo_data, add_hashes);
+        for (size_t i = 0; i < adds.size(); ++i) adds[i].first = add_hashes[i];
+        ok = ok && full.Modify(undo, adds, proof.GetSortedTargets());
+        assert(ok);
+    }
+}
+
+// Connect a chain to a pollard on one thread: parse and position every proof, hash the outputs, verify and modify.
+static void BlockConnectSequential(benchmark::Bench& bench)
+{
+    std::vector<BlockData> blocks;
+    CreateConnectBlocks(blocks, CONNECT_NUM_BLOCKS);
+
+    bench.epochs(1).epochIterations(1).batch(blocks.size()).unit("block").run([&] {
+        Pollard pruned(0);
+        PollardUndoBatch undo;
+        BatchProof proof;
+        std::vector<uint64_t> order;
+        std::vector<ByteSpan> utxo_data;
+        std::vector<Hash> target_hashes, add_hashes;
+
+        for (const BlockData& block : blocks) {
+            bool ok = proof.Unserialize(block.m_proof);
+
+            const std::vector<uint64_t>& targets = proof.GetTargets();
+            order.resize(targets.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&targets](uint64_t a, uint64_t b) { return targets[a] < targets[b]; });
+            utxo_data.clear();
+            for (const uint64_t i : order) utxo_data.emplace_back(block.m_spent[i]);
+            target_hashes.resize(utxo_data.size());
+            ok = ok && HashLeaves(utxo_data, target_hashes);
+
+            utxo_data.assign(block.m_created.begin(), block.m_created.end());
+            add_hashes.resize(utxo_data.size());
+            ok = ok && HashLeaves(utxo_data, add_hashes);
+
+            ok = ok && pruned.Verify(proof, target_hashes);
+            ok = ok && pruned.Modify(undo, add_hashes, block.m_remember, proof.GetSortedTargets());
+            assert(ok);
+        }
+    });
+}
+
+// Connect the same chain with a BlockProcessor, which prepares the next block while the current one is connected.
+static void BlockConnectPipelined(benchmark::Bench& bench)
+{
+    std::vector<BlockData> blocks;
+    CreateConnectBlocks(blocks, CONNECT_NUM_BLOCKS);
+
+    bench.epochs(1).epochIterations(1).batch(blocks.size()).unit("block").run([&] {
+        Pollard pruned(0);
+        PollardUndoBatch undo;
+        BlockProcessor processor(pruned);
+
+        processor.Submit(blocks[0]);
+        for (size_t i = 1; i <= blocks.size(); ++i) {
+            if (i < blocks.size()) processor.Submit(blocks[i]);
+            bool ok = processor.Connect(undo);
+            assert(ok);
+        }
+    });
+}
+
+BENCHMARK(BlockReplay);
+BENCHMARK(BlockConnectSequential);
+BENCHMARK(BlockConnectPipelined);
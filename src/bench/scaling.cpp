@@ -0,0 +1,215 @@
+#include "bench.h"
+#include "include/utreexo.h"
+#include "util/latency.h"
+#include "util/leaves.h"
+#include "util/workload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+using namespace utreexo;
+
+// The number of blocks in the forest before the readers start.
+static constexpr int SCALING_HISTORY_BLOCKS{500};
+// The number of requests every reader serves per run.
+static constexpr int SCALING_READER_REQUESTS{200};
+// The number of leaves proven per request.
+static constexpr int SCALING_REQUEST_TARGETS{8};
+
+/**
+ * A forest that follows a generated chain. The writer thread keeps connecting the next
+ * block while the readers serve requests against it.
+ */
+class ScalingChain
+{
+public:
+    ScalingChain() : m_generator(benchmark::WorkloadParams()), m_forest(0)
+    {
+        for (int i = 0; i < SCALING_HISTORY_BLOCKS; ++i) ConnectNext();
+    }
+
+    /** Prove the spends of the next block and modify the forest. */
+    void ConnectNext()
+    {
+        m_generator.Next(m_block);
+        bool ok = m_forest.Prove(m_proof, m_block.m_spends);
+        ok = ok && m_forest.Modify(m_undo, m_block.m_adds, m_proof.GetSortedTargets());
+        assert(ok);
+    }
+
+    RamForest& Forest() { return m_forest; }
+
+private:
+    benchmark::WorkloadGenerator m_generator;
+    benchmark::WorkloadBlock m_block;
+    RamForest m_forest;
+    UndoBatch m_undo;
+    BatchProof m_proof;
+};
+
+// Run for 1, 2, 4, ... readers up to the number of hardware threads, or for the asymptote values if set.
+static std::vector<int> ReaderCounts(const benchmark::Bench& bench)
+{
+    if (bench.complexityN() > 1) return {static_cast<int>(bench.complexityN())};
+
+    const int max_readers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    std::vector<int> counts;
+    for (int n = 1; n < max_readers; n *= 2) counts.push_back(n);
+    counts.push_back(max_readers);
+    return counts;
+}
+
+/**
+ * Run read(rng) SCALING_READER_REQUESTS times on each of several reader threads, while a
+ * writer thread calls write() until all readers are done. Report the aggregate throughput of
+ * the readers and their tail latency, along with the throughput of the writer.
+ *
+ * Every new locking or snapshot mode only needs a reader and a writer function.
+ * The time measured by nanobench also includes waiting for the last block of the writer,
+ * the printed throughput only covers the readers.
+ */
+template <typename ReadFn, typename WriteFn>
+static void RunScaling(benchmark::Bench& bench, ReadFn read, WriteFn write)
+{
+    const std::string name = bench.name();
+    for (const int num_readers : ReaderCounts(bench)) {
+        std::vector<std::chrono::nanoseconds> latencies;
+        std::chrono::nanoseconds elapsed{0};
+        uint64_t num_blocks = 0;
+
+        bench.name(name + " " + std::to_string(num_readers));
+        bench.epochs(1).epochIterations(1).batch(num_readers * SCALING_READER_REQUESTS).unit("request").run([&] {
+            std::atomic<bool> done{false};
+            std::atomic<uint64_t> blocks{0};
+            std::thread writer([&] {
+                while (!done) {
+                    write();
+                    ++blocks;
+                }
+            });
+
+            std::vector<std::vector<std::chrono::nanoseconds>> reader_latencies(num_readers);
+            std::vector<std::thread> readers;
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < num_readers; ++i) {
+                readers.emplace_back([&, i] {
+                    std::mt19937_64 rng(i);
+                    for (int request = 0; request < SCALING_READER_REQUESTS; ++request) {
+                        const auto request_start = std::chrono::steady_clock::now();
+                        const bool ok = read(rng);
+                        assert(ok);
+                        reader_latencies[i].push_back(std::chrono::steady_clock::now() - request_start);
+                    }
+                });
+            }
+            for (std::thread& reader : readers) reader.join();
+            elapsed = std::chrono::steady_clock::now() - start;
+
+            done = true;
+            writer.join();
+            num_blocks = blocks;
+
+            latencies.clear();
+            for (const auto& l : reader_latencies) latencies.insert(latencies.end(), l.begin(), l.end());
+        });
+
+        using std::chrono::microseconds;
+        const double seconds = std::chrono::duration<double>(elapsed).count();
+        std::cout << bench.name() << " readers: "
+                  << static_cast<uint64_t>(latencies.size() / seconds) << " requests/s, p50 "
+                  << std::chrono::duration_cast<microseconds>(benchmark::Percentile(latencies, 0.50)).count() << " us, p99 "
+                  << std::chrono::duration_cast<microseconds>(benchmark::Percentile(latencies, 0.99)).count() << " us, writer "
+                  << static_cast<uint64_t>(num_blocks / seconds) << " blocks/s" << std::endl;
+    }
+    bench.name(name);
+}
+
+// Readers prove random leaves from the latest snapshot, the writer publishes a new one per block.
+static void ScalingProveSnapshot(benchmark::Bench& bench)
+{
+    ScalingChain chain;
+    chain.Forest().EnableSnapshots();
+
+    RunScaling(
+        bench,
+        [&](std::mt19937_64& rng) {
+            std::shared_ptr<const ForestSnapshot> snapshot = chain.Forest().GetSnapshot();
+            std::vector<Hash> target_hashes;
+            for (const uint64_t pos : RandomPositions(rng, snapshot->NumLeaves(), SCALING_REQUEST_TARGETS)) {
+                target_hashes.push_back(snapshot->Read(pos).value());
+            }
+            BatchProof proof;
+            return snapshot->Prove(proof, target_hashes);
+        },
+        [&] { chain.ConnectNext(); });
+}
+
+// Readers prove random leaves while holding a shared lock, the writer holds it exclusively per block.
+static void ScalingProveLocked(benchmark::Bench& bench)
+{
+    ScalingChain chain;
+    std::shared_mutex mutex;
+
+    RunScaling(
+        bench,
+        [&](std::mt19937_64& rng) {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            const RamForest& forest = chain.Forest();
+            std::vector<Hash> target_hashes;
+            for (const uint64_t pos : RandomPositions(rng, forest.NumLeaves(), SCALING_REQUEST_TARGETS)) {
+                target_hashes.push_back(forest.GetLeaf(pos));
+            }
+            BatchProof proof;
+            return forest.Prove(proof, target_hashes);
+        },
+        [&] {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            chain.ConnectNext();
+        });
+}
+
+// Readers verify block sized proofs statelessly against fixed roots while the writer modifies the forest.
+static void ScalingVerify(benchmark::Bench& bench)
+{
+    ScalingChain chain;
+    const RamForest& forest = chain.Forest();
+
+    std::vector<Hash> roots;
+    forest.Roots(roots);
+    const uint64_t num_leaves = forest.NumLeaves();
+
+    // Proofs for blocks of 2000 random leaves, each reader picks one at random per request.
+    std::mt19937_64 rng(0);
+    std::vector<BatchProof> proofs(8);
+    std::vector<std::vector<Hash>> target_hashes(proofs.size());
+    for (size_t i = 0; i < proofs.size(); ++i) {
+        // The verification takes the hashes in the order of the sorted targets.
+        std::vector<uint64_t> positions = RandomPositions(rng, num_leaves, 2000);
+        std::sort(positions.begin(), positions.end());
+        for (const uint64_t pos : positions) target_hashes[i].push_back(forest.GetLeaf(pos));
+        bool ok = forest.Prove(proofs[i], target_hashes[i]);
+        assert(ok);
+        // The readers share the proofs, compute their positions before they start.
+        proofs[i].ComputePositions(num_leaves);
+    }
+
+    RunScaling(
+        bench,
+        [&](std::mt19937_64& rng) {
+            const size_t i = rng() % proofs.size();
+            return VerifyAgainstRoots(roots, num_leaves, proofs[i], target_hashes[i]) == VerifyResult::OK;
+        },
+        [&] { chain.ConnectNext(); });
+}
+
+BENCHMARK(ScalingProveSnapshot);
+BENCHMARK(ScalingProveLocked);
+BENCHMARK(ScalingVerify);
@@ -0,0 +1,157 @@
+#include "bench.h"
+#include "state.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace utreexo;
+
+static constexpr uint64_t PROOF_POSITIONS_NUM_LEAVES = 1 << 20;
+
+// Pick num_targets random sorted targets from a forest with PROOF_POSITIONS_NUM_LEAVES leaves.
+static std::vector<uint64_t> CreateTargets(int num_targets)
+{
+    std::vector<uint64_t> positions(PROOF_POSITIONS_NUM_LEAVES);
+    std::iota(positions.begin(), positions.end(), 0);
+    std::shuffle(positions.begin(), positions.end(), std::mt19937_64(num_targets));
+
+    std::vector<uint64_t> targets(positions.begin(), positions.begin() + num_targets);
+    std::sort(targets.begin(), targets.end());
+    return targets;
+}
+
+// Run bench_fn for 1 to 10k targets or for the asymptote values if set.
+template <typename BenchFn>
+static void RunForTargetCounts(benchmark::Bench& bench, BenchFn bench_fn)
+{
+    std::vector<int> target_counts{1, 10, 100, 1000, 10000};
+    if (bench.complexityN() > 1) target_counts = {static_cast<int>(bench.complexityN())};
+
+    const std::string name = bench.name();
+    for (int num_targets : target_counts) {
+        std::vector<uint64_t> targets = CreateTargets(num_targets);
+        bench.name(name + " " + std::to_string(num_targets));
+        bench_fn(targets);
+    }
+    bench.name(name);
+}
+
+// Benchmarks ProofPositions allocating new vectors on every call.
+static void ProofPositions(benchmark::Bench& bench)
+{
+    ForestState state(PROOF_POSITIONS_NUM_LEAVES);
+    RunForTargetCounts(bench, [&](const std::vector<uint64_t>& targets) {
+        bench.batch(targets.size()).unit("target").run([&] {
+            auto positions = state.ProofPositions(targets);
+            ankerl::nanobench::doNotOptimizeAway(positions);
+        });
+    });
+}
+
+// Benchmarks ProofPositions writing into reused buffers.
+static void ProofPositionsReuse(benchmark::Bench& bench)
+{
+    ForestState state(PROOF_POSITIONS_NUM_LEAVES);
+    std::vector<uint64_t> proof, computed;
+    RunForTargetCounts(bench, [&](const std::vector<uint64_t>& targets) {
+        bench.batch(targets.size()).unit("target").run([&] {
+            state.ProofPositions(targets, proof, computed);
+            ankerl::nanobench::doNotOptimizeAway(proof);
+        });
+    });
+}
+
+// Benchmarks counting the proof positions, as done by BatchProof::CheckSanity.
+static void NumProofPositions(benchmark::Bench& bench)
+{
+    ForestState state(PROOF_POSITIONS_NUM_LEAVES);
+    RunForTargetCounts(bench, [&](const std::vector<uint64_t>& targets) {
+        bench.batch(targets.size()).unit("target").run([&] {
+            ankerl::nanobench::doNotOptimizeAway(state.NumProofPositions(targets));
+        });
+    });
+}
+
+// A forest with a few trees of different heights.
+static constexpr uint64_t POSITIONS_NUM_LEAVES = (1 << 20) + (1 << 12) + 7;
+
+// Pick random positions on all rows of the forest.
+static std::vector<uint64_t> CreatePositions()
+{
+    ForestState state(POSITIONS_NUM_LEAVES);
+    std::mt19937_64 rng(POSITIONS_NUM_LEAVES);
+
+    std::vector<uint64_t> positions(1024);
+    for (uint64_t& pos : positions) {
+        uint8_t row = rng() % state.NumRows();
+        pos = state.RowOffset(row) + rng() % (POSITIONS_NUM_LEAVES >> row);
+    }
+    return positions;
+}
+
+// Benchmarks walking from positions up to their roots.
+static void PositionParent(benchmark::Bench& bench)
+{
+    ForestState state(POSITIONS_NUM_LEAVES);
+    std::vector<uint64_t> positions = CreatePositions();
+
+    bench.batch(positions.size()).unit("position").run([&] {
+        for (uint64_t pos : positions) {
+            uint8_t path_length{0};
+            std::tie(std::ignore, path_length, std::ignore) = state.Path(pos);
+            for (uint8_t i = 0; i < path_length; ++i) pos = state.Parent(pos);
+            ankerl::nanobench::doNotOptimizeAway(pos);
+        }
+    });
+}
+
+// Benchmarks detecting rows and row offsets.
+static void PositionDetectRow(benchmark::Bench& bench)
+{
+    ForestState state(POSITIONS_NUM_LEAVES);
+    std::vector<uint64_t> positions = CreatePositions();
+
+    bench.batch(positions.size()).unit("position").run([&] {
+        for (uint64_t pos : positions) {
+            ankerl::nanobench::doNotOptimizeAway(state.RowOffset(pos));
+        }
+    });
+}
+
+// Benchmarks descending from positions to their leftmost leaves.
+static void PositionLeftDescendant(benchmark::Bench& bench)
+{
+    ForestState state(POSITIONS_NUM_LEAVES);
+    std::vector<uint64_t> positions = CreatePositions();
+
+    bench.batch(positions.size()).unit("position").run([&] {
+        for (uint64_t pos : positions) {
+            ankerl::nanobench::doNotOptimizeAway(state.LeftDescendant(pos, state.DetectRow(pos)));
+        }
+    });
+}
+
+// Benchmarks computing all root positions of forests of different sizes.
+static void PositionRoots(benchmark::Bench& bench)
+{
+    bench.batch(1024).unit("forest").run([&] {
+        for (uint64_t num_leaves = POSITIONS_NUM_LEAVES; num_leaves < POSITIONS_NUM_LEAVES + 1024; ++num_leaves) {
+            ForestState state(num_leaves);
+            for (uint8_t row = 0; row <= state.NumRows(); ++row) {
+                if (state.HasRoot(row)) ankerl::nanobench::doNotOptimizeAway(state.RootPosition(row));
+            }
+        }
+    });
+}
+
+BENCHMARK(ProofPositions);
+BENCHMARK(ProofPositionsReuse);
+BENCHMARK(NumProofPositions);
+BENCHMARK(PositionParent);
+BENCHMARK(PositionDetectRow);
+BENCHMARK(PositionLeftDescendant);
+BENCHMARK(PositionRoots);
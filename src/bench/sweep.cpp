@@ -0,0 +1,139 @@
+#include "bench.h"
+#include "include/utreexo.h"
+#include "util/leaves.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace utreexo;
+
+// The forest size if no sizes are given with -asymptote or -sweep.
+static constexpr uint64_t SWEEP_DEFAULT_LEAVES{1 << 16};
+// The number of blocks that the operations cycle through.
+static constexpr int SWEEP_NUM_BLOCKS{8};
+// The number of spends and adds of a block, at most a quarter of the forest.
+// The smallest preset size is 4 blocks, so all preset sizes use the same blocks.
+static constexpr uint64_t SWEEP_BLOCK_SIZE{2000};
+// The forests are built by adding this many leaves at a time.
+static constexpr int SWEEP_BUILD_CHUNK{1 << 20};
+
+static const char* SWEEP_FOREST_FILE = "./bench_sweep_forest";
+
+/** A block that can be applied to the sweep forest and undone again. */
+struct SweepBlock {
+    std::vector<uint64_t> m_targets;
+    std::vector<Hash> m_target_hashes;
+    BatchProof m_proof;
+    std::vector<uint64_t> m_proof_positions;
+    std::vector<Leaf> m_adds;
+};
+
+// Build a forest with num_leaves leaves and the blocks that the operations run on.
+static void BuildSweepForest(RamForest& full, std::vector<SweepBlock>& blocks, uint64_t num_leaves)
+{
+    UndoBatch unused_undo;
+    std::vector<Leaf> leaves;
+    for (uint64_t added = 0; added < num_leaves; added += leaves.size()) {
+        leaves.clear();
+        CreateTestLeaves(leaves, std::min<uint64_t>(SWEEP_BUILD_CHUNK, num_leaves - added), static_cast<int>(added));
+        full.Modify(unused_undo, leaves, {});
+    }
+
+    const uint64_t block_size = std::max<uint64_t>(1, std::min(SWEEP_BLOCK_SIZE, num_leaves / 4));
+    std::mt19937_64 rng(0);
+    blocks.resize(SWEEP_NUM_BLOCKS);
+    for (int i = 0; i < SWEEP_NUM_BLOCKS; ++i) {
+        SweepBlock& block = blocks[i];
+        block.m_targets = RandomPositions(rng, num_leaves, block_size);
+        std::sort(block.m_targets.begin(), block.m_targets.end());
+        for (const uint64_t pos : block.m_targets) block.m_target_hashes.push_back(full.GetLeaf(pos));
+        bool ok = full.Prove(block.m_proof, block.m_target_hashes);
+        assert(ok);
+        block.m_proof.ComputePositions(num_leaves);
+        block.m_proof_positions = block.m_proof.GetProofPositions();
+
+        // The added leaves follow the ones of the forest, so they are new to it.
+        CreateTestLeaves(block.m_adds, block_size, static_cast<int>(num_leaves + i * block_size));
+    }
+}
+
+// Run one operation of the sweep, named after it. All operations share the unit, since
+// nanobench drops the previous results when the unit changes.
+template <typename Fn>
+static void RunSweepOperation(benchmark::Bench& bench, const std::string& name, Fn fn)
+{
+    const std::string sweep_name = bench.name();
+    bench.name(sweep_name + " " + name).batch(1).unit("op").run(fn);
+    bench.name(sweep_name);
+}
+
+/**
+ * Measure the main forest operations on a forest of N leaves (the -asymptote or -sweep values).
+ * The forest is built once per size, outside of the measurements, and every operation leaves it
+ * in the same state: blocks are applied with Modify and rolled back with Undo.
+ * The results are named after the operations, so every operation gets its own big-O fit.
+ */
+static void AccumulatorSweep(benchmark::Bench& bench)
+{
+    const uint64_t num_leaves = bench.complexityN() > 1 ? static_cast<uint64_t>(bench.complexityN()) : SWEEP_DEFAULT_LEAVES;
+
+    std::remove(SWEEP_FOREST_FILE);
+    {
+        RamForest full(SWEEP_FOREST_FILE);
+        std::vector<SweepBlock> blocks;
+        BuildSweepForest(full, blocks, num_leaves);
+        size_t next = 0;
+
+        BatchProof proof;
+        RunSweepOperation(bench, "Prove", [&] {
+            const SweepBlock& block = blocks[next++ % blocks.size()];
+            bool ok = full.Prove(proof, block.m_target_hashes);
+            assert(ok);
+        });
+
+        // Gather the proof hashes of a block position by position, and with one ReadMany,
+        // which is what Prove does. The positions are random on forests larger than the cache.
+        std::vector<Hash> proof_hashes;
+        RunSweepOperation(bench, "GatherRead", [&] {
+            const SweepBlock& block = blocks[next++ % blocks.size()];
+            proof_hashes.clear();
+            for (const uint64_t pos : block.m_proof_positions) proof_hashes.push_back(full.Read(pos).value());
+        });
+        RunSweepOperation(bench, "GatherReadMany", [&] {
+            const SweepBlock& block = blocks[next++ % blocks.size()];
+            bool ok = full.ReadMany(block.m_proof_positions, proof_hashes);
+            assert(ok);
+        });
+
+        RunSweepOperation(bench, "Verify", [&] {
+            const SweepBlock& block = blocks[next++ % blocks.size()];
+            bool ok = full.Verify(block.m_proof, block.m_target_hashes);
+            assert(ok);
+        });
+
+        UndoBatch undo;
+        RunSweepOperation(bench, "ModifyUndo", [&] {
+            const SweepBlock& block = blocks[next++ % blocks.size()];
+            bool ok = full.Modify(undo, block.m_adds, block.m_targets);
+            ok = ok && full.Undo(undo);
+            assert(ok);
+        });
+
+        // Every commit writes the whole forest, so it is only measured a few times.
+        const size_t epochs = bench.epochs();
+        bench.epochs(3).epochIterations(1);
+        RunSweepOperation(bench, "Commit", [&] {
+            bool ok = full.Commit();
+            assert(ok);
+        });
+        bench.epochs(epochs).epochIterations(0);
+
+        assert(full.NumLeaves() == num_leaves);
+    }
+    std::remove(SWEEP_FOREST_FILE);
+}
+
+BENCHMARK(AccumulatorSweep);
@@ -0,0 +1,19 @@
+#ifndef UTREEXO_BENCH_UTIL_LATENCY_H
+#define UTREEXO_BENCH_UTIL_LATENCY_H
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace benchmark {
+
+// Return the p-th percentile of the latencies (sorts them).
+inline std::chrono::nanoseconds Percentile(std::vector<std::chrono::nanoseconds>& latencies, double p)
+{
+    if (latencies.empty()) return std::chrono::nanoseconds(0);
+    std::sort(latencies.begin(), latencies.end());
+    return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+}
+
+} // namespace benchmark
+#endif // UTREEXO_BENCH_UTIL_LATENCY_H
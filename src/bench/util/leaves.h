@@ -3,12 +3,14 @@
 
 #include "include/accumulator.h"
 
+#include <algorithm>
+#include <random>
 #include <vector>
 
 using namespace utreexo;
 
 // Copied from src/test/accumulator_tests.cpp
-static void SetHash(Hash& hash, int num)
+inline void SetHash(Hash& hash, int num)
 {
     hash[0] = num;
     hash[1] = num >> 8;
@@ -17,7 +19,7 @@ static void SetHash(Hash& hash, int num)
     hash[4] = 0xFF;
 }
 // Copied from src/test/accumulator_tests.cpp
-static void CreateTestLeaves(std::vector<Leaf>& leaves, int count, int offset)
+inline void CreateTestLeaves(std::vector<Leaf>& leaves, int count, int offset)
 {
     for (int i = 0; i < count; i++) {
         Hash hash = {}; // initialize all elements to 0
@@ -26,7 +28,7 @@ static void CreateTestLeaves(std::vector<Leaf>& leaves, int count, int offset)
     }
 }
 // Copied from src/test/accumulator_tests.cpp
-static void CreateTestLeaves(std::vector<Leaf>& leaves, int count)
+inline void CreateTestLeaves(std::vector<Leaf>& leaves, int count)
 {
     CreateTestLeaves(leaves, count, 0);
 }
@@ -46,4 +48,15 @@ bidiiter random_unique(bidiiter begin, bidiiter end, size_t num_random)
     return begin;
 }
 
+// Draw count distinct random leaf positions of a forest with num_leaves leaves.
+inline std::vector<uint64_t> RandomPositions(std::mt19937_64& rng, uint64_t num_leaves, size_t count)
+{
+    std::vector<uint64_t> positions;
+    while (positions.size() < std::min<uint64_t>(count, num_leaves)) {
+        const uint64_t pos = rng() % num_leaves;
+        if (std::find(positions.begin(), positions.end(), pos) == positions.end()) positions.push_back(pos);
+    }
+    return positions;
+}
+
 #endif // UTREEXO_BENCH_UTIL_LEAVES_H
@@ -0,0 +1,50 @@
+#include "workload.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace benchmark {
+
+WorkloadGenerator::WorkloadGenerator(const WorkloadParams& params)
+    : m_params(params), m_rng(params.m_seed) {}
+
+uint64_t WorkloadGenerator::Lifetime()
+{
+    if (std::bernoulli_distribution(m_params.m_young_fraction)(m_rng)) {
+        return 1 + std::geometric_distribution<uint64_t>(1.0 / m_params.m_young_lifetime)(m_rng);
+    }
+
+    std::uniform_real_distribution<double> log_lifetime(std::log(m_params.m_young_lifetime),
+                                                        std::log(m_params.m_max_lifetime));
+    return std::max<uint64_t>(1, std::llround(std::exp(log_lifetime(m_rng))));
+}
+
+void WorkloadGenerator::Next(WorkloadBlock& block)
+{
+    ++m_height;
+    block.m_adds.clear();
+    block.m_spends.clear();
+
+    auto spends = m_spends.find(m_height);
+    if (spends != m_spends.end()) {
+        block.m_spends = std::move(spends->second);
+        m_spends.erase(spends);
+        // Spends are not ordered by their creation within a block.
+        std::shuffle(block.m_spends.begin(), block.m_spends.end(), m_rng);
+    }
+
+    int num_outputs = std::uniform_int_distribution<int>(m_params.m_min_outputs, m_params.m_max_outputs)(m_rng);
+    for (int i = 0; i < num_outputs; ++i) {
+        // Every output gets a unique hash from its index.
+        utreexo::Hash hash{};
+        for (int byte = 0; byte < 8; ++byte) hash[byte] = m_num_outputs >> (8 * byte);
+        hash[8] = 0xFF;
+        ++m_num_outputs;
+
+        uint64_t lifetime = Lifetime();
+        m_spends[m_height + lifetime].push_back(hash);
+        block.m_adds.emplace_back(hash, lifetime <= m_params.m_remember_lifetime);
+    }
+}
+
+} // namespace benchmark
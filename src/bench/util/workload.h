@@ -0,0 +1,63 @@
+#ifndef UTREEXO_BENCH_UTIL_WORKLOAD_H
+#define UTREEXO_BENCH_UTIL_WORKLOAD_H
+
+#include "include/accumulator.h"
+
+#include <map>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+namespace benchmark {
+
+/** The shape of a generated chain. */
+struct WorkloadParams {
+    // The number of outputs created per block is uniform in [m_min_outputs, m_max_outputs].
+    int m_min_outputs{50};
+    int m_max_outputs{250};
+    // This fraction of the outputs dies young, after a geometric number of blocks with mean m_young_lifetime.
+    double m_young_fraction{0.6};
+    double m_young_lifetime{6};
+    // The long tail lives for a log-uniform number of blocks in [m_young_lifetime, m_max_lifetime].
+    double m_max_lifetime{100000};
+    // A pollard remembers the outputs that will be spent within this many blocks (0 remembers none).
+    uint64_t m_remember_lifetime{0};
+    uint64_t m_seed{0};
+};
+
+/** The outputs created and spent by a generated block. */
+struct WorkloadBlock {
+    std::vector<utreexo::Leaf> m_adds;
+    std::vector<utreexo::Hash> m_spends;
+};
+
+/**
+ * Generates a chain of blocks where every output is given a lifetime when it is created
+ * and is spent that many blocks later. Unlike sequential leaves with uniform random
+ * deletes, most spends hit recent outputs and a few hit outputs from long ago.
+ */
+class WorkloadGenerator
+{
+public:
+    explicit WorkloadGenerator(const WorkloadParams& params);
+
+    /** Generate the next block, spending the outputs whose lifetime ends at its height. */
+    void Next(WorkloadBlock& block);
+
+    uint64_t Height() const { return m_height; }
+
+private:
+    WorkloadParams m_params;
+    std::mt19937_64 m_rng;
+    uint64_t m_height{0};
+    uint64_t m_num_outputs{0};
+
+    // The outputs to spend by block height.
+    std::map<uint64_t, std::vector<utreexo::Hash>> m_spends;
+
+    /** Draw the number of blocks an output lives for (at least one). */
+    uint64_t Lifetime();
+};
+
+} // namespace benchmark
+#endif // UTREEXO_BENCH_UTIL_WORKLOAD_H
@@ -0,0 +1,77 @@
+#include "bench.h"
+#include "include/utreexo.h"
+#include "util/leaves.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <vector>
+
+using namespace utreexo;
+
+// Create a block sized proof: num_targets random leaves of a forest with 64 leaves per target.
+static void CreateBlockProof(std::vector<Hash>& roots,
+                             uint64_t& num_leaves,
+                             BatchProof& proof,
+                             std::vector<Hash>& target_hashes,
+                             int num_targets)
+{
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, num_targets * 64);
+
+    UndoBatch unused_undo;
+    RamForest full(0);
+    full.Modify(unused_undo, leaves, {});
+    full.Roots(roots);
+    num_leaves = full.NumLeaves();
+
+    // Sort the targets, Pollard::Verify expects the hashes in the order of the sorted targets.
+    std::vector<int> indices(leaves.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    random_unique(indices.begin(), indices.end(), num_targets);
+    std::sort(indices.begin(), indices.begin() + num_targets);
+
+    target_hashes.clear();
+    for (int i = 0; i < num_targets; ++i) target_hashes.push_back(leaves[indices[i]].first);
+
+    full.Prove(proof, target_hashes);
+}
+
+// Verify a block sized proof against the roots.
+static void VerifyAgainstRootsBlock(benchmark::Bench& bench)
+{
+    const int num_targets = bench.complexityN() > 1 ? static_cast<int>(bench.complexityN()) : 2000;
+
+    std::vector<Hash> roots, target_hashes;
+    uint64_t num_leaves;
+    BatchProof proof;
+    CreateBlockProof(roots, num_leaves, proof, target_hashes, num_targets);
+    assert(VerifyAgainstRoots(roots, num_leaves, proof, target_hashes) == VerifyResult::OK);
+
+    bench.unit("verification").run([&] {
+        VerifyResult result = VerifyAgainstRoots(roots, num_leaves, proof, target_hashes);
+        ankerl::nanobench::doNotOptimizeAway(result);
+    });
+}
+
+// Verify the same proof with a pollard that only holds the roots.
+static void VerifyPollardBlock(benchmark::Bench& bench)
+{
+    const int num_targets = bench.complexityN() > 1 ? static_cast<int>(bench.complexityN()) : 2000;
+
+    std::vector<Hash> roots, target_hashes;
+    uint64_t num_leaves;
+    BatchProof proof;
+    CreateBlockProof(roots, num_leaves, proof, target_hashes, num_targets);
+
+    bench.unit("verification").run([&] {
+        // Verifying caches the proof in the pollard, so every run starts from the roots.
+        Pollard pruned(roots, num_leaves);
+        bool ok = pruned.Verify(proof, target_hashes);
+        assert(ok);
+        ankerl::nanobench::doNotOptimizeAway(ok);
+    });
+}
+
+BENCHMARK(VerifyAgainstRootsBlock);
+BENCHMARK(VerifyPollardBlock);
@@ -0,0 +1,122 @@
+#include "include/block_processor.h"
+#include "include/leaf_hash.h"
+#include "include/pollard.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+namespace utreexo {
+
+BlockProcessor::BlockProcessor(Pollard& pollard)
+    : m_pollard(pollard),
+      m_next_num_leaves(pollard.NumLeaves()),
+      m_worker(&BlockProcessor::WorkerThread, this) {}
+
+BlockProcessor::~BlockProcessor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_worker.join();
+}
+
+void BlockProcessor::Submit(BlockData block)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_submitted.push_back(std::move(block));
+        ++m_num_pending;
+    }
+    m_cond.notify_all();
+}
+
+bool BlockProcessor::Connect(PollardUndoBatch& undo)
+{
+    PreparedBlock block;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_num_pending == 0) return false;
+        m_cond.wait(lock, [this] { return !m_prepared.empty(); });
+
+        // This is the hand over: from here on the block is only used by this thread.
+        block = std::move(m_prepared.front());
+        m_prepared.pop_front();
+        --m_num_pending;
+        if (m_invalid) return false;
+    }
+
+    bool ok = block.m_valid &&
+              m_pollard.Verify(block.m_proof, block.m_target_hashes) &&
+              m_pollard.Modify(undo, block.m_add_hashes, block.m_remember, block.m_proof.GetSortedTargets());
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_invalid = true;
+    }
+    return ok;
+}
+
+size_t BlockProcessor::NumPending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_num_pending;
+}
+
+void BlockProcessor::WorkerThread()
+{
+    while (true) {
+        BlockData block;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_stop || !m_submitted.empty(); });
+            if (m_stop) return;
+            block = std::move(m_submitted.front());
+            m_submitted.pop_front();
+        }
+
+        PreparedBlock prepared;
+        Prepare(block, m_next_num_leaves, prepared);
+        m_next_num_leaves += block.m_created.size() - block.m_spent.size();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_prepared.push_back(std::move(prepared));
+        }
+        m_cond.notify_all();
+    }
+}
+
+void BlockProcessor::Prepare(BlockData& block, uint64_t num_leaves, PreparedBlock& prepared)
+{
+    BatchProof& proof = prepared.m_proof;
+    if (!proof.Unserialize(block.m_proof)) return;
+
+    const std::vector<uint64_t>& targets = proof.GetTargets();
+    if (block.m_spent.size() != targets.size()) return;
+    if (!proof.CheckSanity(num_leaves)) return;
+
+    // Keep the positions with the proof, so that verifying it does not compute them again.
+    proof.ComputePositions(num_leaves);
+
+    // The pollard expects the target hashes in the order of the sorted targets.
+    std::vector<size_t> order(targets.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&targets](size_t a, size_t b) { return targets[a] < targets[b]; });
+    std::vector<ByteSpan> utxo_data;
+    utxo_data.reserve(std::max(targets.size(), block.m_created.size()));
+    for (const size_t i : order) utxo_data.emplace_back(block.m_spent[i]);
+    prepared.m_target_hashes.resize(utxo_data.size());
+    if (!HashLeaves(utxo_data, prepared.m_target_hashes)) return;
+
+    utxo_data.clear();
+    for (const std::vector<uint8_t>& utxo : block.m_created) utxo_data.emplace_back(utxo);
+    prepared.m_add_hashes.resize(utxo_data.size());
+    if (!HashLeaves(utxo_data, prepared.m_add_hashes)) return;
+
+    prepared.m_remember = std::move(block.m_remember);
+    prepared.m_valid = true;
+}
+
+}; // namespace utreexo
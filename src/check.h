@@ -2,6 +2,7 @@
 
 #ifdef UTREEXO_VERIFY
 #include <stdio.h>
+#include <stdlib.h>
 #endif
 
 /* Assertion macros */
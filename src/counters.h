@@ -0,0 +1,40 @@
+#ifndef UTREEXO_COUNTERS_H
+#define UTREEXO_COUNTERS_H
+
+#include "include/stats.h"
+
+/**
+ * STATS_ADD(counter, n) adds n to one of the counters in utreexo::Stats.
+ * Without UTREEXO_STATS the macro expands to nothing and n is not evaluated.
+ */
+#ifdef UTREEXO_STATS
+#include <atomic>
+
+namespace utreexo {
+
+struct AtomicStats {
+    std::atomic<uint64_t> m_hashes{0};
+    std::atomic<uint64_t> m_leaf_hashes{0};
+    std::atomic<uint64_t> m_nodes_allocated{0};
+    std::atomic<uint64_t> m_nodes_freed{0};
+    std::atomic<uint64_t> m_posmap_lookups{0};
+    std::atomic<uint64_t> m_posmap_inserts{0};
+    std::atomic<uint64_t> m_posmap_erases{0};
+    std::atomic<uint64_t> m_swaps{0};
+    std::atomic<uint64_t> m_proof_hashes_consumed{0};
+    std::atomic<uint64_t> m_proof_hashes_cached{0};
+    std::atomic<uint64_t> m_bytes_committed{0};
+};
+
+extern AtomicStats g_stats;
+
+}; // namespace utreexo
+
+#define STATS_ADD(counter, n) ::utreexo::g_stats.counter.fetch_add((n), std::memory_order_relaxed)
+#else
+#define STATS_ADD(counter, n) do { } while (0)
+#endif
+
+#define STATS_INC(counter) STATS_ADD(counter, 1)
+
+#endif // UTREEXO_COUNTERS_H
@@ -242,4 +242,57 @@ CSHA512& CSHA512::Reset()
     return *this;
 }
 
+void SHA512_256_64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    // A 64 byte input and its padding fit into a single chunk.
+    unsigned char chunk[128] = {0};
+    chunk[64] = 0x80;
+    WriteBE64(chunk + 120, 64 << 3);
+
+    uint64_t s[8];
+    for (size_t i = 0; i < blocks; ++i) {
+        memcpy(chunk, in, 64);
+        sha512::Initialize256(s);
+        sha512::Transform(s, chunk);
+        WriteBE64(out, s[0]);
+        WriteBE64(out + 8, s[1]);
+        WriteBE64(out + 16, s[2]);
+        WriteBE64(out + 24, s[3]);
+        in += 64;
+        out += 32;
+    }
+}
+
+void SHA512_256_Many(unsigned char* out, Span<const ByteSpan> in)
+{
+    unsigned char chunk[128];
+    uint64_t s[8];
+    for (const ByteSpan& input : in) {
+        sha512::Initialize256(s);
+
+        const size_t num_full = input.size() / 128;
+        for (size_t i = 0; i < num_full; ++i) sha512::Transform(s, input.data() + i * 128);
+
+        // The rest of the input, the 0x80 marker and the 128 bit length in bits. The length
+        // does not fit behind an input that fills more than 111 bytes of the last chunk.
+        const size_t rest = input.size() % 128;
+        memset(chunk, 0, sizeof(chunk));
+        if (rest > 0) memcpy(chunk, input.data() + num_full * 128, rest);
+        chunk[rest] = 0x80;
+        if (rest >= 112) {
+            sha512::Transform(s, chunk);
+            memset(chunk, 0, sizeof(chunk));
+        }
+        WriteBE64(chunk + 112, static_cast<uint64_t>(input.size()) >> 61);
+        WriteBE64(chunk + 120, static_cast<uint64_t>(input.size()) << 3);
+        sha512::Transform(s, chunk);
+
+        WriteBE64(out, s[0]);
+        WriteBE64(out + 8, s[1]);
+        WriteBE64(out + 16, s[2]);
+        WriteBE64(out + 24, s[3]);
+        out += 32;
+    }
+}
+
 }; // namespace utreexo
@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "include/span.h"
+
 namespace utreexo {
 
 /** A hasher class for SHA-512. */
@@ -32,5 +34,19 @@ public:
     uint64_t Size() const { return bytes; }
 };
 
+/**
+ * Compute the SHA-512/256 hashes of blocks 64 byte inputs at once.
+ * out receives 32 bytes per input. This skips the buffering of CSHA512,
+ * since every input fits into a single chunk with its padding.
+ */
+void SHA512_256_64(unsigned char* out, const unsigned char* in, size_t blocks);
+
+/**
+ * Compute the SHA-512/256 hashes of several inputs of any length at once.
+ * out receives 32 bytes per input. Full chunks are hashed straight from the inputs
+ * and only the last one or two chunks of an input are padded in a local buffer.
+ */
+void SHA512_256_Many(unsigned char* out, Span<const ByteSpan> in);
+
 };     // namespace utreexo
 #endif // UTREEXO_CRYPTO_SHA512_H
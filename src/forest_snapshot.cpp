@@ -0,0 +1,92 @@
+#include "include/forest_snapshot.h"
+#include "include/batchproof.h"
+
+#include "prove_many.h"
+#include "state.h"
+
+namespace utreexo {
+
+std::optional<Hash> ForestSnapshot::Read(uint64_t pos) const
+{
+    ForestState state(m_num_leaves);
+    uint8_t row = state.DetectRow(pos);
+    if (row >= m_rows.size()) return std::nullopt;
+
+    uint64_t index = pos - state.RowOffset(row);
+    if (index >= (m_num_leaves >> row)) return std::nullopt;
+
+    return (*m_rows[row][index / PAGE_SIZE])[index % PAGE_SIZE];
+}
+
+bool ForestSnapshot::ReadMany(const std::vector<uint64_t>& positions, std::vector<Hash>& hashes) const
+{
+    hashes.clear();
+    hashes.reserve(positions.size());
+    for (const uint64_t pos : positions) {
+        std::optional<Hash> hash = Read(pos);
+        if (!hash) return false;
+        hashes.push_back(*hash);
+    }
+    return true;
+}
+
+size_t ForestSnapshot::MemoryUsage() const
+{
+    // The size of the reference counts that std::make_shared allocates along with an object.
+    constexpr size_t control_block_size = sizeof(void*) + 2 * sizeof(int);
+
+    size_t usage = sizeof(ForestSnapshot) + m_roots.capacity() * sizeof(Hash);
+    usage += m_rows.capacity() * sizeof(std::vector<std::shared_ptr<const Page>>);
+    for (const auto& row : m_rows) {
+        usage += row.capacity() * sizeof(std::shared_ptr<const Page>) + row.size() * (sizeof(Page) + control_block_size);
+    }
+
+    if (m_posmap_base) usage += Accumulator::PositionMapMemory(*m_posmap_base) + control_block_size;
+    for (const PositionDelta* delta = m_posmap_delta.get(); delta; delta = delta->m_prev.get()) {
+        usage += sizeof(PositionDelta) + control_block_size + Accumulator::PositionMapMemory(delta->m_positions);
+    }
+    return usage;
+}
+
+std::optional<uint64_t> ForestSnapshot::Position(const Hash& hash) const
+{
+    std::optional<uint64_t> pos;
+    for (const PositionDelta* delta = m_posmap_delta.get(); delta && !pos; delta = delta->m_prev.get()) {
+        auto it = delta->m_positions.find(hash);
+        if (it != delta->m_positions.end()) pos = it->second;
+    }
+
+    if (!pos && m_posmap_base) {
+        auto it = m_posmap_base->find(hash);
+        if (it != m_posmap_base->end()) pos = it->second;
+    }
+
+    // The leaf might have been removed since the entry was made.
+    if (!pos || *pos >= m_num_leaves || Read(*pos) != hash) return std::nullopt;
+    return pos;
+}
+
+bool ForestSnapshot::Prove(BatchProof& proof, const std::vector<Hash>& target_hashes) const
+{
+    auto position = [this](const Hash& hash) { return Position(hash); };
+    auto read_many = [this](const std::vector<uint64_t>& positions, std::vector<Hash>& hashes) {
+        return ReadMany(positions, hashes);
+    };
+
+    ProveScratch scratch;
+    return ProveTargets(proof, target_hashes, ForestState(m_num_leaves), {}, scratch, position, read_many);
+}
+
+bool ForestSnapshot::ProveMany(std::vector<BatchProof>& proofs,
+                               const std::vector<std::vector<Hash>>& target_hashes,
+                               int num_threads) const
+{
+    auto position = [this](const Hash& hash) { return Position(hash); };
+    auto read_many = [this](const std::vector<uint64_t>& positions, std::vector<Hash>& hashes) {
+        return ReadMany(positions, hashes);
+    };
+
+    return utreexo::ProveMany(proofs, target_hashes, m_num_leaves, num_threads, position, read_many);
+}
+
+}; // namespace utreexo
@@ -6,14 +6,22 @@ using namespace utreexo;
 
 FUZZ(batchproof)
 {
-    FUZZ_CONSUME(uint8_t, num_targets)
-    FUZZ_CONSUME(uint8_t, num_hashes)
-    FUZZ_CONSUME_VEC(uint8_t, proof_bytes, 8 + num_targets * 4 + num_hashes * 32)
+    std::vector<uint8_t> proof_bytes(data, data + size);
 
+    BatchProofView view;
     BatchProof proof;
-    if (proof.Unserialize(proof_bytes)) {
+    bool view_ok = view.Unserialize(proof_bytes.data(), proof_bytes.size());
+    assert(view_ok == proof.Unserialize(proof_bytes));
+
+    if (view_ok) {
+        // The encoding is canonical, so a round trip reproduces the input.
         std::vector<uint8_t> bytes;
         proof.Serialize(bytes);
         assert(proof_bytes == bytes);
+
+        std::vector<uint64_t> targets;
+        view.GetTargets(targets);
+        assert(targets == proof.GetTargets());
+        assert(view.NumHashes() == proof.GetHashes().size());
     }
 }
@@ -19,7 +19,8 @@ FUZZ(forest_state)
 
     std::sort(targets.begin(), targets.end());
     state.ProofPositions(targets);
-    state.Transform(targets);
+    SwapBuffer swaps;
+    state.Transform(targets, swaps);
     state.CheckTargetsSanity(targets);
     state.UndoTransform(targets);
 
@@ -0,0 +1,18 @@
+#include "include/leaf_hash.h"
+
+#include "counters.h"
+#include "crypto/sha512.h"
+
+namespace utreexo {
+
+bool HashLeaves(Span<const ByteSpan> utxo_data, Span<Hash> out)
+{
+    if (utxo_data.size() != out.size()) return false;
+    if (utxo_data.empty()) return true;
+
+    SHA512_256_Many(out.data()->data(), utxo_data);
+    STATS_ADD(m_leaf_hashes, utxo_data.size());
+    return true;
+}
+
+}; // namespace utreexo
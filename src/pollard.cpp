@@ -1,13 +1,20 @@
 #include "../include/pollard.h"
 #include "../include/batchproof.h"
 #include "check.h"
+#include "counters.h"
+#include "crypto/common.h"
 #include "node.h"
 #include "state.h"
+#include <algorithm>
+#include <array>
 #include <deque>
+#include <istream>
 #include <memory>
 #include <optional>
+#include <ostream>
 #include <string.h>
 #include <tuple>
+#include <unordered_map>
 
 // Get the internal node from a NodePtr<Accumulator::Node>.
 #define INTERNAL_NODE(acc_node) (((Pollard::Node*)acc_node.get())->m_node)
@@ -19,6 +26,11 @@ static const int RECOVERY_CHOP_LEFT = 0;
 static const int RECOVERY_CHOP_RIGHT = 1;
 static const int RECOVERY_CHOP_BOTH = 2;
 
+// Snapshot node flags:
+static const uint8_t SNAPSHOT_LEFT = 1;
+static const uint8_t SNAPSHOT_RIGHT = 1 << 1;
+static const uint8_t SNAPSHOT_REMEMBER = 1 << 2;
+
 class Pollard::InternalNode
 {
 public:
@@ -31,16 +43,19 @@ public:
         m_nieces[0] = left;
         m_nieces[1] = right;
         m_hash.fill(0);
+        STATS_INC(m_nodes_allocated);
     }
     InternalNode(NodePtr<InternalNode> left, NodePtr<InternalNode> right, const Hash& hash)
     {
         m_nieces[0] = left;
         m_nieces[1] = right;
         m_hash = hash;
+        STATS_INC(m_nodes_allocated);
     }
 
     ~InternalNode()
     {
+        STATS_INC(m_nodes_freed);
         m_nieces[0] = nullptr;
         m_nieces[1] = nullptr;
     }
@@ -52,6 +67,8 @@ public:
 
     /* Chop of deadend nieces. */
     void Prune();
+    /* Chop of leaf nieces, unless one of them is remembered. */
+    void PruneLeaves();
 
     /*
      * Return wether or not this node is a deadend.
@@ -127,6 +144,16 @@ Pollard::Pollard(uint64_t num_leaves) : Accumulator(num_leaves)
 
 Pollard::Pollard(const std::vector<Hash>& roots, uint64_t num_leaves)
     : Pollard(num_leaves)
+{
+    RestoreRoots(roots);
+}
+
+Pollard::~Pollard()
+{
+    m_roots.clear();
+}
+
+void Pollard::RestoreRoots(const std::vector<Hash>& roots)
 {
     ForestState state(m_num_leaves);
 
@@ -134,7 +161,7 @@ Pollard::Pollard(const std::vector<Hash>& roots, uint64_t num_leaves)
     auto root_positions = state.RootPositions();
     assert(root_positions.size() == roots.size());
 
-    // Restore roots
+    m_roots.clear();
     for (int i = 0; i < roots.size(); ++i) {
         auto int_node = MakeNodePtr<InternalNode>(nullptr, nullptr, roots.at(i));
         m_roots.push_back(MakeNodePtr<Pollard::Node>(int_node, int_node, nullptr,
@@ -142,11 +169,6 @@ Pollard::Pollard(const std::vector<Hash>& roots, uint64_t num_leaves)
     }
 }
 
-Pollard::~Pollard()
-{
-    m_roots.clear();
-}
-
 std::optional<const Hash> Pollard::Read(uint64_t pos) const
 {
     auto [node, sibling] = ReadSiblings(pos);
@@ -254,11 +276,11 @@ NodePtr<Accumulator::Node> Pollard::SwapSubTrees(uint64_t from, uint64_t to)
     return rehash_path;
 }
 
-NodePtr<Accumulator::Node> Pollard::NewLeaf(const Leaf& leaf)
+NodePtr<Accumulator::Node> Pollard::NewLeaf(const Hash& hash, bool remember)
 {
     assert(m_remember);
     NodePtr<InternalNode> int_node = Accumulator::MakeNodePtr<InternalNode>(
-        leaf.second ? m_remember : nullptr, nullptr, leaf.first);
+        remember ? m_remember : nullptr, nullptr, hash);
 
     NodePtr<Pollard::Node> node = Accumulator::MakeNodePtr<Pollard::Node>(
         /*node*/ int_node, /*sibling*/ int_node, /*parent*/ nullptr,
@@ -267,8 +289,9 @@ NodePtr<Accumulator::Node> Pollard::NewLeaf(const Leaf& leaf)
 
     // Only keep the hash in the map if the leaf is marked to be
     // remembered.
-    if (leaf.second) {
-        m_posmap[leaf.first] = node->m_position;
+    if (remember) {
+        m_posmap[hash] = node->m_position;
+        STATS_INC(m_posmap_inserts);
     }
 
     return m_roots.back();
@@ -309,6 +332,7 @@ void Pollard::FinalizeRemove(uint64_t next_num_leaves)
     for (uint64_t pos = next_state.m_num_leaves; pos < current_state.m_num_leaves; ++pos) {
         if (std::optional<const Hash> read_hash = Read(pos)) {
             m_posmap.erase(read_hash.value());
+            STATS_INC(m_posmap_erases);
         }
     }
 
@@ -347,6 +371,257 @@ void Pollard::FinalizeRemove(uint64_t next_num_leaves)
     m_roots = new_roots;
 }
 
+bool Pollard::Modify(PollardUndoBatch& undo,
+                     const std::vector<Leaf>& new_leaves,
+                     const std::vector<uint64_t>& targets)
+{
+    if (!BuildUndoBatch(undo, new_leaves.size(), targets)) return false;
+    return Accumulator::Modify(new_leaves, targets);
+}
+
+bool Pollard::Modify(PollardUndoBatch& undo,
+                     Span<const Hash> leaf_hashes,
+                     Span<const uint8_t> remember,
+                     Span<const uint64_t> targets)
+{
+    if (!LeafSpan(leaf_hashes, remember).HasValidFlags()) return false;
+    if (!BuildUndoBatch(undo, leaf_hashes.size(), targets)) return false;
+    return Accumulator::Modify(leaf_hashes, remember, targets);
+}
+
+bool Pollard::BuildUndoBatch(PollardUndoBatch& undo, uint64_t num_adds, Span<const uint64_t> targets) const
+{
+    ForestState state(m_num_leaves);
+    if (!state.CheckTargetsSanity(targets)) return false;
+
+    std::vector<Hash> deleted_hashes;
+    deleted_hashes.reserve(targets.size());
+    std::vector<uint8_t> remembered((targets.size() + 7) / 8);
+    for (size_t i = 0; i < targets.size(); ++i) {
+        std::optional<const Hash> hash = Read(targets[i]);
+        if (!hash) return false;
+        deleted_hashes.push_back(hash.value());
+        if (m_posmap.count(hash.value()) > 0) remembered[i / 8] |= 1 << (i % 8);
+    }
+
+    // The siblings on the paths of the targets are cached with the targets.
+    std::vector<uint64_t> sorted_targets(targets.begin(), targets.end());
+    std::vector<uint64_t> proof_positions, computed_positions;
+    state.ProofPositions(sorted_targets, proof_positions, computed_positions);
+    std::vector<Hash> proof_hashes;
+    proof_hashes.reserve(proof_positions.size());
+    for (const uint64_t pos : proof_positions) {
+        std::optional<const Hash> hash = Read(pos);
+        if (!hash) return false;
+        proof_hashes.push_back(hash.value());
+    }
+
+    std::vector<Hash> roots;
+    Roots(roots);
+
+    undo = PollardUndoBatch(UndoBatch(num_adds, std::move(sorted_targets), deleted_hashes), roots,
+                            proof_hashes, remembered);
+    return true;
+}
+
+void Pollard::CollectRememberedLeaves(const NodePtr<InternalNode>& left,
+                                      const NodePtr<InternalNode>& right,
+                                      uint8_t row,
+                                      uint64_t first_leaf,
+                                      std::vector<std::pair<Hash, uint64_t>>& leaves) const
+{
+    if (row == 1) {
+        // The remember marker of a leaf is a niece of its sibling.
+        if (!left || !right) return;
+        if (right->m_nieces[0] == m_remember) leaves.emplace_back(left->m_hash, first_leaf);
+        if (left->m_nieces[0] == m_remember) leaves.emplace_back(right->m_hash, first_leaf + 1);
+        return;
+    }
+
+    // The children of the left child are the nieces of the right child and vice versa.
+    if (right) CollectRememberedLeaves(right->m_nieces[0], right->m_nieces[1], row - 1, first_leaf, leaves);
+    if (left) CollectRememberedLeaves(left->m_nieces[0], left->m_nieces[1], row - 1, first_leaf + (1ULL << (row - 1)), leaves);
+}
+
+bool Pollard::Undo(const PollardUndoBatch& undo)
+{
+    using Children = std::array<NodePtr<InternalNode>, 2>;
+
+    const UndoBatch& leaves_undo = undo.GetUndoBatch();
+    const std::vector<uint64_t>& targets = leaves_undo.GetDeletedPositions();
+    const std::vector<Hash>& deleted_hashes = leaves_undo.GetDeletedHashes();
+    if (leaves_undo.GetNumAdds() > m_num_leaves || deleted_hashes.size() != targets.size()) return false;
+    const LeafSpan deleted(deleted_hashes, undo.GetRemembered());
+    if (!deleted.HasValidFlags()) return false;
+
+    // The forest before the modification and the forest after it.
+    const uint64_t num_leaves_deleted = m_num_leaves - leaves_undo.GetNumAdds();
+    const ForestState prev_state(num_leaves_deleted + targets.size());
+    const ForestState current_state(m_num_leaves);
+    if (!prev_state.CheckTargetsSanity(targets)) return false;
+
+    const std::vector<Hash>& prev_roots = undo.GetPrevRoots();
+    if (prev_roots.size() != prev_state.NumRoots()) return false;
+
+    // The removed branches are the proof of the deleted leaves.
+    std::vector<uint64_t> proof_positions, computed_positions;
+    prev_state.ProofPositions(targets, proof_positions, computed_positions);
+    const std::vector<Hash>& proof_hashes = undo.GetProofHashes();
+    if (proof_hashes.size() != proof_positions.size()) return false;
+
+    // The subtrees that the swaps of the deletion moved, mapped from their positions
+    // before the swaps of their row to their positions after them.
+    SwapBuffer swaps;
+    prev_state.Transform(targets, swaps);
+    std::unordered_map<uint64_t, uint64_t> moved_to;
+    for (uint8_t row = 0; row < swaps.NumRows(); ++row) {
+        // The subtree at each swapped position of the row.
+        std::unordered_map<uint64_t, uint64_t> subtree_at;
+        for (const ForestState::Swap* swap = swaps.RowBegin(row); swap != swaps.RowEnd(row); ++swap) {
+            uint64_t from = subtree_at.try_emplace(swap->m_from, swap->m_from).first->second;
+            uint64_t to = subtree_at.try_emplace(swap->m_to, swap->m_to).first->second;
+            subtree_at[swap->m_from] = to;
+            subtree_at[swap->m_to] = from;
+        }
+        for (const auto& [pos, subtree] : subtree_at) moved_to[subtree] = pos;
+    }
+
+    // Nothing below the proof positions and the roots without a deleted leaf was removed, so
+    // their cached children are taken from the current pollard. The remembered leaves below
+    // them that the deletion moved are collected with their previous positions.
+    std::vector<std::pair<Hash, uint64_t>> moved_leaves;
+    auto graft = [&](uint64_t pos, const Hash& hash, Children& children) {
+        uint8_t row = prev_state.DetectRow(pos);
+        uint64_t first_leaf = prev_state.LeftDescendant(pos, row);
+
+        // Follow the leftmost leaf through the swaps of every row of its ancestors.
+        uint64_t current_leaf = first_leaf;
+        for (uint8_t swap_row = row; swap_row < swaps.NumRows(); ++swap_row) {
+            auto it = moved_to.find(prev_state.RowOffset(swap_row) + (current_leaf >> swap_row));
+            if (it == moved_to.end()) continue;
+            uint64_t below = current_leaf & ((1ULL << swap_row) - 1);
+            current_leaf = ((it->second - prev_state.RowOffset(swap_row)) << swap_row) | below;
+        }
+
+        auto [node, sibling] = ReadSiblings(current_state.RowOffset(row) + (current_leaf >> row));
+        if (node && node->m_hash != hash) return false;
+        children = sibling ? Children{sibling->m_nieces[0], sibling->m_nieces[1]} : Children{};
+
+        if (current_leaf != first_leaf) {
+            if (row > 0) {
+                CollectRememberedLeaves(children[0], children[1], row, first_leaf, moved_leaves);
+            } else if (children[0] == m_remember) {
+                moved_leaves.emplace_back(hash, first_leaf);
+            }
+        }
+        return true;
+    };
+
+    std::vector<Children> proof_children(proof_positions.size());
+    for (size_t i = 0; i < proof_positions.size(); ++i) {
+        if (!graft(proof_positions[i], proof_hashes[i], proof_children[i])) return false;
+    }
+
+    // Rebuild the removed branches bottom up, pruning them like Node::ReHash does.
+    std::vector<Hash> computed_hashes(computed_positions.size());
+    std::vector<Children> computed_children(computed_positions.size());
+    for (size_t i = 0; i < targets.size(); ++i) {
+        computed_hashes[i] = deleted_hashes[i];
+        computed_children[i] = {deleted.GetRemember(i) ? m_remember : nullptr, nullptr};
+    }
+
+    for (size_t i = targets.size(); i < computed_positions.size(); ++i) {
+        const uint64_t pos = computed_positions[i];
+        const Hash* child_hashes[2];
+        const Children* grand_children[2];
+        for (uint8_t lr = 0; lr < 2; ++lr) {
+            const uint64_t child = prev_state.Child(pos, lr);
+            auto computed_it = std::lower_bound(computed_positions.begin(), computed_positions.begin() + i, child);
+            auto proof_it = std::lower_bound(proof_positions.begin(), proof_positions.end(), child);
+            if (computed_it != computed_positions.begin() + i && *computed_it == child) {
+                child_hashes[lr] = &computed_hashes[computed_it - computed_positions.begin()];
+                grand_children[lr] = &computed_children[computed_it - computed_positions.begin()];
+            } else if (proof_it != proof_positions.end() && *proof_it == child) {
+                child_hashes[lr] = &proof_hashes[proof_it - proof_positions.begin()];
+                grand_children[lr] = &proof_children[proof_it - proof_positions.begin()];
+            } else {
+                return false;
+            }
+        }
+
+        Accumulator::ParentHash(computed_hashes[i], *child_hashes[0], *child_hashes[1]);
+
+        // The children of a node are the nieces of its sibling.
+        auto make_child = [&](uint8_t lr) {
+            const Children& nieces = *grand_children[lr ^ 1];
+            return Accumulator::MakeNodePtr<InternalNode>(nieces[0], nieces[1], *child_hashes[lr]);
+        };
+        bool cached[2] = {(*grand_children[0])[0] || (*grand_children[0])[1],
+                          (*grand_children[1])[0] || (*grand_children[1])[1]};
+        if (prev_state.DetectRow(pos) == 1) {
+            // Both leaves are kept if one of them is remembered (see InternalNode::PruneLeaves).
+            if (cached[0] || cached[1]) computed_children[i] = {make_child(0), make_child(1)};
+        } else {
+            // A child is kept if its sibling has cached children (see InternalNode::Prune).
+            computed_children[i] = {cached[1] ? make_child(0) : nullptr, cached[0] ? make_child(1) : nullptr};
+        }
+    }
+
+    // Every rebuilt branch ends in a root, which has to match the previous root.
+    std::vector<uint64_t> root_positions = prev_state.RootPositions();
+    std::vector<NodePtr<Accumulator::Node>> roots;
+    roots.reserve(root_positions.size());
+    for (size_t i = 0; i < root_positions.size(); ++i) {
+        Children children;
+        auto computed_it = std::lower_bound(computed_positions.begin(), computed_positions.end(), root_positions[i]);
+        if (computed_it != computed_positions.end() && *computed_it == root_positions[i]) {
+            if (computed_hashes[computed_it - computed_positions.begin()] != prev_roots[i]) return false;
+            children = computed_children[computed_it - computed_positions.begin()];
+        } else if (!graft(root_positions[i], prev_roots[i], children)) {
+            return false;
+        }
+
+        auto int_node = Accumulator::MakeNodePtr<InternalNode>(children[0], children[1], prev_roots[i]);
+        roots.push_back(Accumulator::MakeNodePtr<Pollard::Node>(int_node, int_node, nullptr,
+                                                                prev_state.m_num_leaves, root_positions[i]));
+    }
+
+    // The undo data is valid, from here on the pollard is modified.
+    for (uint64_t pos = num_leaves_deleted; pos < m_num_leaves; ++pos) {
+        std::optional<const Hash> hash = Read(pos);
+        if (!hash) continue;
+        auto posmap_it = m_posmap.find(hash.value());
+        if (posmap_it != m_posmap.end() && posmap_it->second == pos) {
+            m_posmap.erase(posmap_it);
+            STATS_INC(m_posmap_erases);
+        }
+    }
+
+    for (const auto& [hash, pos] : moved_leaves) {
+        m_posmap[hash] = pos;
+    }
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (!deleted.GetRemember(i)) continue;
+        m_posmap[deleted_hashes[i]] = targets[i];
+        STATS_INC(m_posmap_inserts);
+    }
+
+    m_roots = std::move(roots);
+    m_num_leaves = prev_state.m_num_leaves;
+    return true;
+}
+
+void Pollard::RememberedLeaves(std::vector<uint64_t>& positions) const
+{
+    positions.clear();
+    positions.reserve(m_posmap.size());
+    for (const auto& [hash, pos] : m_posmap) {
+        positions.push_back(pos);
+    }
+    std::sort(positions.begin(), positions.end());
+}
+
 void Pollard::Prune()
 {
     for (NodePtr<Accumulator::Node>& root : m_roots) {
@@ -370,6 +645,136 @@ uint64_t Pollard::CountNodes() const
     return res;
 }
 
+AccumulatorMemory Pollard::MemoryUsage() const
+{
+    AccumulatorMemory usage = Accumulator::MemoryUsage();
+
+    // The remember marker is shared by all remembered leaves.
+    uint64_t num_internal_nodes = CountNodes() + (m_remember ? 1 : 0);
+    usage.m_nodes += num_internal_nodes * sizeof(Pollard::InternalNode) +
+                     m_roots.size() * sizeof(Pollard::Node);
+    usage.m_control_blocks += (num_internal_nodes + m_roots.size()) * SHARED_CONTROL_BLOCK_SIZE;
+    return usage;
+}
+
+void Pollard::SerializeNode(std::ostream& stream, const NodePtr<Pollard::InternalNode>& node) const
+{
+    const NodePtr<InternalNode>& left = node->m_nieces[0];
+    const NodePtr<InternalNode>& right = node->m_nieces[1];
+
+    uint8_t flags = 0;
+    if (left == m_remember) {
+        flags |= SNAPSHOT_REMEMBER;
+    } else if (left) {
+        flags |= SNAPSHOT_LEFT;
+    }
+    if (right) flags |= SNAPSHOT_RIGHT;
+
+    stream.put(static_cast<char>(flags));
+    stream.write(reinterpret_cast<const char*>(node->m_hash.data()), 32);
+
+    if (flags & SNAPSHOT_LEFT) SerializeNode(stream, left);
+    if (flags & SNAPSHOT_RIGHT) SerializeNode(stream, right);
+}
+
+bool Pollard::UnserializeNode(std::istream& stream, NodePtr<Pollard::InternalNode>& node, uint8_t row)
+{
+    char flags_byte;
+    Hash hash;
+    if (!stream.get(flags_byte)) return false;
+    if (!stream.read(reinterpret_cast<char*>(hash.data()), 32)) return false;
+
+    uint8_t flags = static_cast<uint8_t>(flags_byte);
+    if (flags & ~(SNAPSHOT_LEFT | SNAPSHOT_RIGHT | SNAPSHOT_REMEMBER)) return false;
+    if ((flags & SNAPSHOT_LEFT) && (flags & SNAPSHOT_REMEMBER)) return false;
+    // The nieces of a node live one row below it, so there are none on the bottom row.
+    if (row == 0 && (flags & (SNAPSHOT_LEFT | SNAPSHOT_RIGHT))) return false;
+    // Only the siblings of leaves carry the remember marker.
+    if (row > 0 && (flags & SNAPSHOT_REMEMBER)) return false;
+
+    node = Accumulator::MakeNodePtr<InternalNode>(nullptr, nullptr, hash);
+    if (flags & SNAPSHOT_REMEMBER) node->m_nieces[0] = m_remember;
+    if ((flags & SNAPSHOT_LEFT) && !UnserializeNode(stream, node->m_nieces[0], row - 1)) return false;
+    if ((flags & SNAPSHOT_RIGHT) && !UnserializeNode(stream, node->m_nieces[1], row - 1)) return false;
+
+    return true;
+}
+
+bool Pollard::Serialize(std::ostream& stream) const
+{
+    uint8_t uint64_buf[8];
+
+    WriteBE64(uint64_buf, m_num_leaves);
+    stream.write(reinterpret_cast<const char*>(uint64_buf), 8);
+
+    for (const NodePtr<Accumulator::Node>& root : m_roots) {
+        SerializeNode(stream, INTERNAL_NODE(root));
+    }
+
+    // Sort the position map entries so that equal pollards produce equal snapshots.
+    std::vector<std::pair<uint64_t, Hash>> entries;
+    entries.reserve(m_posmap.size());
+    for (const auto& [hash, pos] : m_posmap) {
+        entries.emplace_back(pos, hash);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    WriteBE64(uint64_buf, entries.size());
+    stream.write(reinterpret_cast<const char*>(uint64_buf), 8);
+    for (const auto& [pos, hash] : entries) {
+        stream.write(reinterpret_cast<const char*>(hash.data()), 32);
+        WriteBE64(uint64_buf, pos);
+        stream.write(reinterpret_cast<const char*>(uint64_buf), 8);
+    }
+
+    return stream.good();
+}
+
+bool Pollard::Unserialize(std::istream& stream)
+{
+    m_roots.clear();
+    m_posmap.clear();
+    m_num_leaves = 0;
+
+    uint8_t uint64_buf[8];
+    if (!stream.read(reinterpret_cast<char*>(uint64_buf), 8)) return false;
+    uint64_t num_leaves = ReadBE64(uint64_buf);
+
+    ForestState state(num_leaves);
+    std::vector<uint64_t> root_positions = state.RootPositions();
+
+    std::vector<NodePtr<Accumulator::Node>> roots;
+    roots.reserve(root_positions.size());
+    for (const uint64_t root_pos : root_positions) {
+        NodePtr<InternalNode> int_node;
+        if (!UnserializeNode(stream, int_node, state.DetectRow(root_pos))) return false;
+
+        roots.push_back(MakeNodePtr<Pollard::Node>(int_node, int_node, nullptr, num_leaves, root_pos));
+    }
+
+    if (!stream.read(reinterpret_cast<char*>(uint64_buf), 8)) return false;
+    uint64_t num_entries = ReadBE64(uint64_buf);
+    if (num_entries > num_leaves) return false;
+
+    // No reserve: num_entries is not trusted until all entries were read.
+    std::unordered_map<Hash, uint64_t, LeafHasher> posmap;
+    for (uint64_t i = 0; i < num_entries; ++i) {
+        Hash hash;
+        if (!stream.read(reinterpret_cast<char*>(hash.data()), 32)) return false;
+        if (!stream.read(reinterpret_cast<char*>(uint64_buf), 8)) return false;
+
+        uint64_t pos = ReadBE64(uint64_buf);
+        if (pos >= num_leaves) return false;
+        posmap[hash] = pos;
+    }
+
+    m_num_leaves = num_leaves;
+    m_roots = std::move(roots);
+    m_posmap = std::move(posmap);
+
+    return true;
+}
+
 void Pollard::InitChildrenOfComputed(NodePtr<Pollard::Node>& node,
                                      NodePtr<Pollard::Node>& left_child,
                                      NodePtr<Pollard::Node>& right_child,
@@ -406,15 +811,21 @@ void Pollard::InitChildrenOfComputed(NodePtr<Pollard::Node>& node,
 
 bool Pollard::CreateProofTree(std::vector<NodePtr<Pollard::Node>>& proof_tree_out,
                               std::vector<std::pair<NodePtr<Pollard::Node>, int>>& recovery,
-                              const BatchProof& proof)
+                              const std::vector<uint64_t>& proof_positions,
+                              const std::vector<uint64_t>& computed_positions,
+                              const Hash* proof_hashes,
+                              uint64_t num_hashes,
+                              const std::vector<uint64_t>* cached_positions)
 {
     ForestState state(m_num_leaves);
-    std::vector<uint64_t> proof_positions, computed_positions;
-    std::tie(proof_positions, computed_positions) = state.ProofPositions(proof.GetSortedTargets());
 
-    auto proof_hash = proof.GetHashes().crbegin();
+    // The proof hashes are consumed in reverse, just like the positions.
+    std::reverse_iterator<const Hash*> proof_hash(proof_hashes + num_hashes);
+    const std::reverse_iterator<const Hash*> proof_hashes_end(proof_hashes);
     auto proof_pos = proof_positions.crbegin();
     auto computed_pos = computed_positions.crbegin();
+    std::vector<uint64_t>::const_reverse_iterator cached_pos;
+    if (cached_positions) cached_pos = cached_positions->crbegin();
 
     // We use a std::deque here because we need to be able to append and prepend efficiently
     // and a vector does not offer that.
@@ -505,12 +916,52 @@ bool Pollard::CreateProofTree(std::vector<NodePtr<Pollard::Node>>& proof_tree_ou
                 node->m_verification_flag &= ~(Pollard::Node::TARGET);
                 ++proof_pos;
 
+                if (cached_positions) {
+                    // The proof is trimmed, so we know which hashes were left out.
+                    // (Nodes are visited in descending order of their positions.)
+                    while (cached_pos != cached_positions->crend() && *cached_pos > node->m_position) {
+                        ++cached_pos;
+                    }
+
+                    if (cached_pos != cached_positions->crend() && *cached_pos == node->m_position) {
+                        // The hash was left out because it is expected to be cached.
+                        if (!node->IsCached()) {
+                            // A pruned ancestor of a remembered leaf is computed from its children,
+                            // which are cached as the nieces of its sibling.
+                            const NodePtr<InternalNode>& left = node->m_sibling->m_nieces[0];
+                            const NodePtr<InternalNode>& right = node->m_sibling->m_nieces[1];
+                            if (node->m_position < m_num_leaves || !left || !right) return false;
+                            Accumulator::ParentHash(node->m_node->m_hash, left->m_hash, right->m_hash);
+                        }
+                        STATS_INC(m_proof_hashes_cached);
+                        continue;
+                    }
+
+                    if (proof_hash >= proof_hashes_end) {
+                        // The needed proof hash was not supplied.
+                        return false;
+                    }
+
+                    if (node->IsCached()) {
+                        // Never overwrite a cached hash with an unverified one.
+                        if (node->m_node->m_hash != *proof_hash) return false;
+                        STATS_INC(m_proof_hashes_cached);
+                    } else {
+                        node->m_node->m_hash = *proof_hash;
+                    }
+
+                    ++proof_hash;
+                    STATS_INC(m_proof_hashes_consumed);
+                    continue;
+                }
+
                 // Populate the proof hashses.
                 bool consume = true;
                 if (node->IsCached()) {
+                    STATS_INC(m_proof_hashes_cached);
                     Hash null_hash;
                     null_hash.fill(0);
-                    const Hash& hash = proof_hash < proof.GetHashes().crend() ? *proof_hash : null_hash;
+                    const Hash& hash = proof_hash < proof_hashes_end ? *proof_hash : null_hash;
                     // If provided proof hash matches the cached hash, we consume the hash.
                     consume = node->m_node->m_hash == hash;
                 } else {
@@ -519,7 +970,7 @@ bool Pollard::CreateProofTree(std::vector<NodePtr<Pollard::Node>>& proof_tree_ou
                     // If the proof is invalid then this will lead to verification
                     // failure during the rehashing of the parent node.
 
-                    if (proof_hash >= proof.GetHashes().crend()) {
+                    if (proof_hash >= proof_hashes_end) {
                         // The needed proof hash was not supplied.
                         return false;
                     }
@@ -527,7 +978,10 @@ bool Pollard::CreateProofTree(std::vector<NodePtr<Pollard::Node>>& proof_tree_ou
                     node->m_node->m_hash = *proof_hash;
                 }
 
-                if (consume) ++proof_hash;
+                if (consume) {
+                    ++proof_hash;
+                    STATS_INC(m_proof_hashes_consumed);
+                }
             }
         }
 
@@ -537,13 +991,12 @@ bool Pollard::CreateProofTree(std::vector<NodePtr<Pollard::Node>>& proof_tree_ou
 
     std::copy(proof_tree.begin(), proof_tree.end(), std::inserter(proof_tree_out, proof_tree_out.begin()));
 
-    return proof_hash == proof.GetHashes().crend();
+    return proof_hash == proof_hashes_end;
 }
 
 
 bool Pollard::VerifyProofTree(std::vector<NodePtr<Pollard::Node>> proof_tree,
-                              const std::vector<Hash>& target_hashes,
-                              const std::vector<Hash>& proof_hashes)
+                              const std::vector<Hash>& target_hashes)
 {
     bool verification_success = true;
     auto target_hash = target_hashes.begin();
@@ -639,15 +1092,62 @@ bool Pollard::VerifyProofTree(std::vector<NodePtr<Pollard::Node>> proof_tree,
 
 bool Pollard::Verify(const BatchProof& proof, const std::vector<Hash>& target_hashes)
 {
-    // The number of targets specified in the proof must match the number of provided target hashes.
-    if (target_hashes.size() != proof.GetTargets().size()) return false;
-
     // If the proof fails the sanity check it fails to verify.
-    // (e.g.: the targets are not sorted)
-    if (!proof.CheckSanity(m_num_leaves)) return false;
+    // (e.g.: the targets are duplicated)
+    // This is BatchProof::CheckSanity on the positions that the verification needs anyway.
+    if (!ForestState(m_num_leaves).CheckTargetsSanity(proof.GetSortedTargets())) return false;
+    const BatchProofPositions positions(proof, m_num_leaves);
+    if (positions.GetProofPositions().size() < proof.GetHashes().size()) return false;
+
+    return Verify(proof.GetSortedTargets(), positions.GetProofPositions(), positions.GetComputedPositions(),
+                  proof.GetHashes().data(), proof.GetHashes().size(), target_hashes, nullptr);
+}
+
+bool Pollard::Verify(const BatchProofView& proof, const std::vector<Hash>& target_hashes)
+{
+    std::vector<uint64_t> sorted_targets;
+    proof.GetTargets(sorted_targets);
+    std::sort(sorted_targets.begin(), sorted_targets.end());
+
+    // A view is not sanity checked on parsing, the targets might be duplicated.
+    if (!ForestState(m_num_leaves).CheckTargetsSanity(sorted_targets)) return false;
+
+    std::vector<uint64_t> proof_positions, computed_positions;
+    ForestState(m_num_leaves).ProofPositions(sorted_targets, proof_positions, computed_positions);
+
+    return Verify(sorted_targets, proof_positions, computed_positions,
+                  proof.GetHashes(), proof.NumHashes(), target_hashes, nullptr);
+}
+
+bool Pollard::VerifyTrimmed(const BatchProof& proof,
+                            const std::vector<Hash>& target_hashes,
+                            const std::vector<uint64_t>& remembered)
+{
+    if (!ForestState(m_num_leaves).CheckTargetsSanity(proof.GetSortedTargets())) return false;
+    const BatchProofPositions positions(proof, m_num_leaves);
+    if (positions.GetProofPositions().size() < proof.GetHashes().size()) return false;
+    for (const uint64_t pos : remembered) {
+        if (pos >= m_num_leaves) return false;
+    }
+
+    std::vector<uint64_t> cached_positions = ForestState(m_num_leaves).CachedProofPositions(remembered);
+    return Verify(proof.GetSortedTargets(), positions.GetProofPositions(), positions.GetComputedPositions(),
+                  proof.GetHashes().data(), proof.GetHashes().size(), target_hashes, &cached_positions);
+}
+
+bool Pollard::Verify(const std::vector<uint64_t>& sorted_targets,
+                     const std::vector<uint64_t>& proof_positions,
+                     const std::vector<uint64_t>& computed_positions,
+                     const Hash* proof_hashes,
+                     uint64_t num_hashes,
+                     const std::vector<Hash>& target_hashes,
+                     const std::vector<uint64_t>* cached_positions)
+{
+    // The number of targets specified in the proof must match the number of provided target hashes.
+    if (target_hashes.size() != sorted_targets.size()) return false;
 
     // If there are no targets to verify we are done.
-    if (proof.GetTargets().size() == 0) return true;
+    if (sorted_targets.size() == 0) return true;
 
     // The proof tree holds the leaves of the partial tree involved in verifying the proof.
     // The leaves know their parents, so the tree can be traversed from the bottom up.
@@ -663,10 +1163,11 @@ bool Pollard::Verify(const BatchProof& proof, const std::vector<Hash>& target_ha
     // Populate the proof tree from top to bottom.
     // This adds new empty nodes to the pollard that will either hold
     // proof hashes or hashes that were computed during verification.
-    bool create_ok = CreateProofTree(proof_tree, recovery_tree, proof);
+    bool create_ok = CreateProofTree(proof_tree, recovery_tree, proof_positions, computed_positions,
+                                     proof_hashes, num_hashes, cached_positions);
 
     // Verify the proof tree from bottom to top.
-    bool verify_ok = create_ok && VerifyProofTree(proof_tree, target_hashes, proof.GetHashes());
+    bool verify_ok = create_ok && VerifyProofTree(proof_tree, target_hashes);
     if (!verify_ok) {
         // The proof was invalid and we have to revert the changes that were made to the pollard.
         // This is where we use the recovery tree to chop of the newly populated branches.
@@ -702,8 +1203,9 @@ bool Pollard::Verify(const BatchProof& proof, const std::vector<Hash>& target_ha
 
     // All targets are now remembered.
     for (int i = 0; i < target_hashes.size(); i++) {
-        m_posmap[target_hashes[i]] = proof.GetSortedTargets()[i];
+        m_posmap[target_hashes[i]] = sorted_targets[i];
     }
+    STATS_ADD(m_posmap_inserts, target_hashes.size());
 
     // TODO: in theory the proof tree could be used during deletion as well.
     // it has references to all nodes that get swaped around. Using the proof
@@ -731,7 +1233,11 @@ void Pollard::Node::ReHash()
     }
 
     Accumulator::ParentHash(m_node->m_hash, m_sibling->m_nieces[0]->m_hash, m_sibling->m_nieces[1]->m_hash);
-    m_sibling->Prune();
+    if (ForestState(m_num_leaves).DetectRow(m_position) == 1) {
+        m_sibling->PruneLeaves();
+    } else {
+        m_sibling->Prune();
+    }
 }
 
 void Pollard::Node::ReHashNoPrune()
@@ -790,6 +1296,15 @@ void Pollard::InternalNode::Prune()
     }
 }
 
+void Pollard::InternalNode::PruneLeaves()
+{
+    // Leaves are only deadends if they are not remembered. The sibling of a
+    // remembered leaf is its proof, so both leaves are kept in that case.
+    bool remembered = (m_nieces[0] && !m_nieces[0]->DeadEnd()) ||
+                      (m_nieces[1] && !m_nieces[1]->DeadEnd());
+    if (!remembered) Chop();
+}
+
 bool Pollard::InternalNode::DeadEnd() const
 {
     return !m_nieces[0] && !m_nieces[1];
@@ -0,0 +1,136 @@
+#ifndef UTREEXO_PROVE_MANY_H
+#define UTREEXO_PROVE_MANY_H
+
+#include "include/accumulator.h"
+#include "include/batchproof.h"
+#include "state.h"
+
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace utreexo {
+
+/**
+ * Split [0, count) into num_threads contiguous chunks and call fn(begin, end) for each.
+ * The first chunk runs on the calling thread.
+ */
+template <typename Fn>
+void ParallelFor(size_t count, int num_threads, Fn fn)
+{
+    size_t chunks = std::max<size_t>(1, std::min<size_t>(num_threads > 0 ? num_threads : 1, count));
+    size_t chunk_size = (count + chunks - 1) / chunks;
+
+    std::vector<std::thread> workers;
+    workers.reserve(chunks - 1);
+    for (size_t begin = chunk_size; begin < count; begin += chunk_size) {
+        workers.emplace_back(fn, begin, std::min(begin + chunk_size, count));
+    }
+
+    fn(0, std::min(chunk_size, count));
+    for (std::thread& worker : workers) worker.join();
+}
+
+/** The buffers ProveTargets works in, reused across proofs. */
+struct ProveScratch {
+    std::vector<uint64_t> m_targets, m_sorted_targets;
+    std::vector<uint64_t> m_proof_positions, m_computed_positions;
+    // The proof positions that are not cached by the peer.
+    std::vector<uint64_t> m_uncached_positions;
+    std::vector<Hash> m_proof_hashes;
+};
+
+/**
+ * Create a proof for target hashes in a forest with state.m_num_leaves leaves. This is the
+ * one proving kernel that Accumulator and ForestSnapshot use for single and many proofs.
+ *
+ * position(hash) returns the position of a target hash as a std::optional.
+ * read_many(positions, hashes) reads the hashes at the sorted positions into hashes
+ * and returns false if one is missing (see Accumulator::ReadMany).
+ *
+ * The hashes at the sorted cached_positions are left out of the proof (see Accumulator::ProveTrimmed).
+ * The proof and computed positions are left in scratch.
+ * Return false if a target is not found or the targets are duplicated.
+ */
+template <typename PositionFn, typename ReadManyFn>
+bool ProveTargets(BatchProof& proof,
+                  const std::vector<Hash>& target_hashes,
+                  const ForestState& state,
+                  const std::vector<uint64_t>& cached_positions,
+                  ProveScratch& scratch,
+                  PositionFn position,
+                  ReadManyFn read_many)
+{
+    scratch.m_targets.clear();
+    scratch.m_targets.reserve(target_hashes.size());
+    for (const Hash& hash : target_hashes) {
+        std::optional<uint64_t> pos = position(hash);
+        if (!pos) return false;
+        scratch.m_targets.push_back(*pos);
+    }
+
+    // We need the sorted targets to compute the proof positions.
+    scratch.m_sorted_targets = scratch.m_targets;
+    std::sort(scratch.m_sorted_targets.begin(), scratch.m_sorted_targets.end());
+    if (!state.CheckTargetsSanity(scratch.m_sorted_targets)) return false;
+
+    state.ProofPositions(scratch.m_sorted_targets, scratch.m_proof_positions, scratch.m_computed_positions);
+
+    // Both the cached and the proof positions are sorted.
+    const std::vector<uint64_t>* read_positions = &scratch.m_proof_positions;
+    if (!cached_positions.empty()) {
+        scratch.m_uncached_positions.clear();
+        auto cached_pos = cached_positions.cbegin();
+        for (const uint64_t pos : scratch.m_proof_positions) {
+            while (cached_pos != cached_positions.cend() && *cached_pos < pos) ++cached_pos;
+            if (cached_pos != cached_positions.cend() && *cached_pos == pos) continue;
+            scratch.m_uncached_positions.push_back(pos);
+        }
+        read_positions = &scratch.m_uncached_positions;
+    }
+    if (!read_many(*read_positions, scratch.m_proof_hashes)) return false;
+
+    // Create the batch proof from the *unsorted* targets and the proof hashes.
+    proof = BatchProof(scratch.m_targets, scratch.m_proof_hashes);
+    return true;
+}
+
+/**
+ * Create one proof for every list of target hashes in a forest with num_leaves leaves.
+ *
+ * position and read_many are the callables of ProveTargets. They are called from
+ * num_threads threads at once.
+ *
+ * The requests are split into contiguous chunks, one per thread. Every thread reuses
+ * its buffers for the targets and positions of all requests in its chunk.
+ * Return false if any of the proofs can not be created.
+ */
+template <typename PositionFn, typename ReadManyFn>
+bool ProveMany(std::vector<BatchProof>& proofs,
+               const std::vector<std::vector<Hash>>& target_hashes,
+               uint64_t num_leaves,
+               int num_threads,
+               PositionFn position,
+               ReadManyFn read_many)
+{
+    const ForestState state(num_leaves);
+    const std::vector<uint64_t> no_cached_positions;
+    std::atomic<bool> ok{true};
+
+    proofs.assign(target_hashes.size(), BatchProof());
+    ParallelFor(target_hashes.size(), num_threads, [&](size_t begin, size_t end) {
+        ProveScratch scratch;
+        for (size_t i = begin; i < end && ok; ++i) {
+            if (!ProveTargets(proofs[i], target_hashes[i], state, no_cached_positions, scratch, position, read_many)) {
+                ok = false;
+            }
+        }
+    });
+
+    return ok;
+}
+
+};     // namespace utreexo
+#endif // UTREEXO_PROVE_MANY_H
@@ -1,14 +1,17 @@
 #include "include/ram_forest.h"
 #include "include/batchproof.h"
+#include "include/forest_snapshot.h"
+#include "include/verifier.h"
 
 #include "check.h"
+#include "counters.h"
 #include "crypto/common.h"
 #include "node.h"
 #include "state.h"
+#include "undo_journal.h"
 
 #include <algorithm>
 #include <iostream>
-#include <unordered_set>
 
 namespace utreexo {
 
@@ -67,6 +70,7 @@ void RamForest::Node::ReHash()
     uint64_t offset = state.RowOffset(m_position);
     std::vector<Hash>& rowData = m_forest->m_data.at(row);
     rowData[m_position - offset] = m_hash;
+    m_forest->MarkDirty(row, m_position - offset);
 }
 
 NodePtr<Accumulator::Node> RamForest::Node::Parent() const
@@ -147,6 +151,7 @@ bool RamForest::Restore()
             if (num_hashes == m_num_leaves) {
                 // populate position map
                 m_posmap[hash] = pos;
+                STATS_INC(m_posmap_inserts);
             }
             ++pos;
         }
@@ -169,6 +174,7 @@ bool RamForest::Commit()
     // commit number of leaves
     WriteBE64(reinterpret_cast<uint8_t*>(uint64_buf), m_num_leaves);
     m_file.write(reinterpret_cast<char*>(uint64_buf), 8);
+    STATS_ADD(m_bytes_committed, 8);
 
     // commit forest hashes
     ForestState state(m_num_leaves);
@@ -178,6 +184,7 @@ bool RamForest::Commit()
         for (int j = 0; j < num_hashes; ++j) {
             m_file.write(reinterpret_cast<const char*>(m_data[i][j].data()), 32);
         }
+        STATS_ADD(m_bytes_committed, num_hashes * 32);
         num_hashes >>= 1;
     }
 
@@ -189,11 +196,8 @@ std::optional<const Hash> RamForest::Read(ForestState state, uint64_t pos) const
     uint8_t row = state.DetectRow(pos);
     uint64_t offset = state.RowOffset(pos);
 
-    assert(row < m_data.size());
-    const std::vector<Hash>& row_data = m_data.at(row);
-
-    assert((pos - offset) < row_data.size());
-    return std::optional<const Hash>{row_data.at(pos - offset)};
+    if (row >= m_data.size() || pos - offset >= m_data[row].size()) return std::nullopt;
+    return std::optional<const Hash>{m_data[row][pos - offset]};
 }
 
 std::optional<const Hash> RamForest::Read(uint64_t pos) const
@@ -202,6 +206,47 @@ std::optional<const Hash> RamForest::Read(uint64_t pos) const
     return Read(state, pos);
 }
 
+bool RamForest::ReadMany(const std::vector<uint64_t>& positions, std::vector<Hash>& hashes) const
+{
+    // How many positions to prefetch ahead of the current one.
+    static constexpr size_t PREFETCH_DISTANCE = 8;
+
+    ForestState state(m_num_leaves);
+    hashes.resize(positions.size());
+
+    // The row of the current run of positions, covering [row_begin, row_end).
+    const Hash* row_data = nullptr;
+    uint64_t row_begin = 0, row_end = 0, row_size = 0;
+
+    for (size_t i = 0; i < positions.size(); ++i) {
+        const uint64_t pos = positions[i];
+        if (pos < row_begin || pos >= row_end) {
+            uint8_t row = state.DetectRow(pos);
+            if (row >= m_data.size()) return false;
+
+            row_begin = state.RowOffset(row);
+            row_end = state.RowOffset(static_cast<uint8_t>(row + 1));
+            row_data = m_data[row].data();
+            row_size = m_data[row].size();
+        }
+
+        if (pos - row_begin >= row_size) return false;
+
+#if defined(__GNUC__)
+        if (i + PREFETCH_DISTANCE < positions.size()) {
+            const uint64_t next = positions[i + PREFETCH_DISTANCE];
+            if (next >= row_begin && next - row_begin < row_size) {
+                __builtin_prefetch(row_data + (next - row_begin));
+            }
+        }
+#endif
+
+        hashes[i] = row_data[pos - row_begin];
+    }
+
+    return true;
+}
+
 std::vector<Hash> RamForest::ReadLeafRange(uint64_t pos, uint64_t range) const
 {
     std::vector<Hash> hashes;
@@ -222,6 +267,9 @@ void RamForest::SwapRange(uint64_t from, uint64_t to, uint64_t range)
     for (uint64_t i = 0; i < range; ++i) {
         std::swap(rowData[(from - offset_from) + i], rowData[(to - offset_to) + i]);
     }
+
+    MarkDirty(row, from - offset_from, range);
+    MarkDirty(row, to - offset_to, range);
 }
 
 NodePtr<Accumulator::Node> RamForest::SwapSubTrees(uint64_t from, uint64_t to)
@@ -258,6 +306,7 @@ NodePtr<Accumulator::Node> RamForest::MergeRoot(uint64_t parent_pos, Hash parent
     m_data.at(row).push_back(parent_hash);
     uint64_t offset = state.RowOffset(parent_pos);
     m_data[row][parent_pos - offset] = parent_hash;
+    MarkDirty(row, parent_pos - offset);
 
     NodePtr<RamForest::Node> node = Accumulator::MakeNodePtr<RamForest::Node>(this, m_data.at(row).back(), m_num_leaves, parent_pos);
     m_roots.push_back(node);
@@ -265,15 +314,17 @@ NodePtr<Accumulator::Node> RamForest::MergeRoot(uint64_t parent_pos, Hash parent
     return m_roots.back();
 }
 
-NodePtr<Accumulator::Node> RamForest::NewLeaf(const Leaf& leaf)
+NodePtr<Accumulator::Node> RamForest::NewLeaf(const Hash& hash, bool /*remember*/)
 {
     // append new hash on row 0 (as a leaf)
-    this->m_data[0][m_num_leaves] = leaf.first;
+    this->m_data[0][m_num_leaves] = hash;
+    MarkDirty(0, m_num_leaves);
 
-    NodePtr<RamForest::Node> new_root = Accumulator::MakeNodePtr<RamForest::Node>(this, leaf.first, m_num_leaves, m_num_leaves);
+    NodePtr<RamForest::Node> new_root = Accumulator::MakeNodePtr<RamForest::Node>(this, hash, m_num_leaves, m_num_leaves);
     m_roots.push_back(new_root);
 
-    m_posmap[leaf.first] = new_root->m_position;
+    m_posmap[hash] = new_root->m_position;
+    STATS_INC(m_posmap_inserts);
     return this->m_roots.back();
 }
 
@@ -287,6 +338,7 @@ void RamForest::FinalizeRemove(uint64_t next_num_leaves)
     for (uint64_t pos = next_state.m_num_leaves; pos < current_state.m_num_leaves; ++pos) {
         m_posmap.erase(Read(pos).value());
     }
+    STATS_ADD(m_posmap_erases, current_state.m_num_leaves - next_state.m_num_leaves);
 
     assert(m_posmap.size() == next_num_leaves);
 
@@ -309,18 +361,33 @@ void RamForest::FinalizeRemove(uint64_t next_num_leaves)
 
 bool RamForest::Verify(const BatchProof& proof, const std::vector<Hash>& target_hashes)
 {
-    // TODO: verify the actual proof. a bitcoin bridge node would like to validate proofs to ensure
-    // that he does not give invalid proofs to anyone.
-    // For now just check that the target hashes exist.
-    for (const Hash& hash : target_hashes) {
-        auto it = m_posmap.find(hash);
-        if (it == m_posmap.end()) return false;
+    std::vector<Hash> roots;
+    Roots(roots);
+    return BatchVerifier(roots, m_num_leaves).Verify(proof, target_hashes);
+}
+
+AccumulatorMemory RamForest::MemoryUsage() const
+{
+    AccumulatorMemory usage = Accumulator::MemoryUsage();
+
+    usage.m_forest_data = m_data.capacity() * sizeof(std::vector<Hash>);
+    for (const std::vector<Hash>& row : m_data) {
+        usage.m_forest_data += row.capacity() * sizeof(Hash);
     }
 
-    return true;
+    usage.m_nodes += m_roots.size() * sizeof(RamForest::Node);
+    usage.m_control_blocks += m_roots.size() * SHARED_CONTROL_BLOCK_SIZE;
+
+    std::shared_ptr<const ForestSnapshot> snapshot = GetSnapshot();
+    if (snapshot) usage.m_snapshots = snapshot->MemoryUsage();
+
+    usage.m_auxiliary += m_dirty_pages.capacity() * sizeof(std::vector<bool>);
+    for (const std::vector<bool>& row : m_dirty_pages) usage.m_auxiliary += (row.capacity() + 7) / 8;
+    if (m_undo_journal) usage.m_auxiliary += m_undo_journal->MemoryUsage();
+    return usage;
 }
 
-bool RamForest::Add(const std::vector<Leaf>& leaves)
+bool RamForest::Add(const LeafSpan& leaves)
 {
     // Preallocate data with the required size.
     ForestState next_state(m_num_leaves + leaves.size());
@@ -337,18 +404,37 @@ bool RamForest::Add(const std::vector<Leaf>& leaves)
     assert(next_state.m_num_leaves == m_num_leaves);
     assert(m_posmap.size() == m_num_leaves);
 
+    if (m_snapshots_enabled) PublishSnapshot();
+
     return ok;
 }
 
 bool RamForest::Modify(UndoBatch& undo,
                        const std::vector<Leaf>& leaves,
                        const std::vector<uint64_t>& targets)
+{
+    return ModifyLeaves(undo, leaves, targets);
+}
+
+bool RamForest::Modify(UndoBatch& undo, Span<const Hash> leaf_hashes, Span<const uint64_t> targets)
+{
+    return ModifyLeaves(undo, LeafSpan(leaf_hashes), targets);
+}
+
+bool RamForest::ModifyLeaves(UndoBatch& undo, const LeafSpan& leaves, Span<const uint64_t> targets)
 {
     if (!RamForest::Remove(targets)) return false;
     if (!BuildUndoBatch(undo, leaves.size(), targets)) return false;
-    if (!RamForest::Add(leaves)) return false;
 
-    return true;
+    // Record the undo data before the leaves are added, so that a failed append
+    // only has to roll back the removal.
+    if (m_undo_journal && !m_undo_journal->Append(m_num_leaves + leaves.size(), undo)) {
+        bool ok = Undo(UndoBatch(0, undo.GetDeletedPositions(), undo.GetDeletedHashes()));
+        assert(ok);
+        return false;
+    }
+
+    return RamForest::Add(leaves);
 }
 
 void RamForest::RestoreRoots()
@@ -360,7 +446,7 @@ void RamForest::RestoreRoots()
     }
 }
 
-bool RamForest::BuildUndoBatch(UndoBatch& undo, uint64_t num_adds, const std::vector<uint64_t>& targets) const
+bool RamForest::BuildUndoBatch(UndoBatch& undo, uint64_t num_adds, Span<const uint64_t> targets) const
 {
     ForestState prev_state(m_num_leaves + targets.size());
 
@@ -371,23 +457,47 @@ bool RamForest::BuildUndoBatch(UndoBatch& undo, uint64_t num_adds, const std::ve
         deleted_hashes.push_back(Read(prev_state, pos).value());
     }
 
-    undo = UndoBatch(num_adds, targets, deleted_hashes);
+    undo = UndoBatch(num_adds, std::vector<uint64_t>(targets.begin(), targets.end()), deleted_hashes);
     return true;
 }
 
-bool RamForest::Undo(const UndoBatch& undo)
+bool RamForest::UndoLeaves(const UndoBatch& undo, Ranges& dirty_leaves, std::vector<Hash>& added_hashes)
 {
-    if (m_data.size() == 0) return true;
+    const std::vector<uint64_t>& deleted_positions = undo.GetDeletedPositions();
+    const std::vector<Hash>& deleted_hashes = undo.GetDeletedHashes();
+    if (undo.GetNumAdds() > m_num_leaves || deleted_hashes.size() != deleted_positions.size()) return false;
+
+    ForestState prev_state(m_num_leaves - undo.GetNumAdds() + deleted_positions.size());
+    if (!prev_state.CheckTargetsSanity(deleted_positions)) return false;
+
+    // Check the undo data before anything is changed, so that a failure leaves the forest as it was.
+    // The added leaves have to be in the forest.
+    added_hashes.assign(m_data[0].begin() + (m_num_leaves - undo.GetNumAdds()), m_data[0].begin() + m_num_leaves);
+    for (const Hash& hash : added_hashes) {
+        STATS_INC(m_posmap_lookups);
+        if (m_posmap.find(hash) == m_posmap.end()) return false;
+    }
 
-    ForestState prev_state(m_num_leaves + undo.GetDeletedPositions().size() - undo.GetNumAdds());
+    // The deleted leaves must not be in the forest once the added leaves are erased.
+    std::vector<Hash> sorted_hashes = deleted_hashes;
+    std::sort(sorted_hashes.begin(), sorted_hashes.end());
+    if (std::adjacent_find(sorted_hashes.begin(), sorted_hashes.end()) != sorted_hashes.end()) return false;
+    sorted_hashes = added_hashes;
+    std::sort(sorted_hashes.begin(), sorted_hashes.end());
+    for (const Hash& hash : deleted_hashes) {
+        STATS_INC(m_posmap_lookups);
+        if (m_posmap.find(hash) != m_posmap.end() &&
+            !std::binary_search(sorted_hashes.begin(), sorted_hashes.end(), hash)) {
+            return false;
+        }
+    }
 
-    auto undo_swaps = prev_state.UndoTransform(undo.GetDeletedPositions());
+    auto undo_swaps = prev_state.UndoTransform(deleted_positions);
 
     // Erase the added leaves from the position map.
-    for (uint64_t i = m_num_leaves - undo.GetNumAdds(); i < m_num_leaves; ++i) {
-        const Hash hash = Read(i).value();
-        if (m_posmap.find(hash) == m_posmap.end()) return false;
+    for (const Hash& hash : added_hashes) {
         m_posmap.erase(hash);
+        STATS_INC(m_posmap_erases);
     }
 
     m_num_leaves -= undo.GetNumAdds();
@@ -395,20 +505,15 @@ bool RamForest::Undo(const UndoBatch& undo)
     // Place all deleted hashes at the end of the bottom row.
     // After this the forest is in the same state as right after the deletion
     // in the previous modification.
-    int i = 0;
-    std::unordered_set<uint64_t> dirt_set;
     m_data[0].resize(prev_state.m_num_leaves);
-    for (const Hash& hash : undo.GetDeletedHashes()) {
-        if ((m_num_leaves + i) >= m_data[0].size()) return false;
-        m_data[0][m_num_leaves + i] = hash;
-
-        // Check that the hash is not already in the forest.
-        if (m_posmap.find(hash) != m_posmap.end()) return false;
-        m_posmap[hash] = m_num_leaves + i;
-        dirt_set.insert(m_num_leaves + i);
-        ++i;
+    for (size_t i = 0; i < deleted_hashes.size(); ++i) {
+        m_data[0][m_num_leaves + i] = deleted_hashes[i];
+        m_posmap[deleted_hashes[i]] = m_num_leaves + i;
+        STATS_INC(m_posmap_inserts);
     }
 
+    dirty_leaves.emplace_back(m_num_leaves, prev_state.m_num_leaves);
+    MarkDirty(0, m_num_leaves, prev_state.m_num_leaves - m_num_leaves);
     m_num_leaves = prev_state.m_num_leaves;
 
     // Swap the delted hashes into their positions pre-deletion.
@@ -420,46 +525,65 @@ bool RamForest::Undo(const UndoBatch& undo)
             range = 1;
         }
 
-        for (uint64_t i = 0; i < range; ++i) {
-            dirt_set.insert(swap.m_from + i);
-            dirt_set.insert(swap.m_to + i);
-        }
+        dirty_leaves.emplace_back(swap.m_from, swap.m_from + range);
+        dirty_leaves.emplace_back(swap.m_to, swap.m_to + range);
 
         UpdatePositionMapForRange(swap.m_from, swap.m_to, range);
         SwapRange(swap.m_from, swap.m_to, range);
+        STATS_INC(m_swaps);
     }
 
+    return true;
+}
 
-    // Rehash all the "dirty" parts of the forest.
-    std::vector<uint64_t> dirt_list(dirt_set.begin(), dirt_set.end());
-    std::sort(dirt_list.begin(), dirt_list.end());
-
-    // Construct the first row of dirt.
-    std::vector<NodePtr<RamForest::Node>> dirt;
-    for (const uint64_t& pos : dirt_list) {
-        uint64_t parent_pos = prev_state.Parent(pos);
-        // Skip positions that are past the bottom row root.
-        // The parents of those positions do not exist in the new forest.
-        if (prev_state.HasRoot(0) && prev_state.RootPosition(0) <= pos) continue;
+void RamForest::ReHashDirtyLeaves(Ranges& dirty_leaves)
+{
+    ForestState state(m_num_leaves);
 
-        // Dont add the same parent to the next row dirt.
-        if (dirt.size() != 0 && dirt.back()->m_position == prev_state.Parent(pos)) continue;
+    // Rolling back several modifications can grow the forest past its previous height.
+    while (m_data.size() <= state.NumRows()) {
+        m_data.push_back(std::vector<Hash>());
+    }
 
-        dirt.push_back(Accumulator::MakeNodePtr<RamForest::Node>(this, m_num_leaves, parent_pos));
+    // Merge the overlapping and adjacent ranges of leaves.
+    std::sort(dirty_leaves.begin(), dirty_leaves.end());
+    Ranges dirt;
+    for (const auto& [begin, end] : dirty_leaves) {
+        // Skip leaves that were removed by a later rollback.
+        uint64_t clamped_end = std::min(end, m_num_leaves);
+        if (begin >= clamped_end) continue;
+
+        if (dirt.size() != 0 && begin <= dirt.back().second) {
+            dirt.back().second = std::max(dirt.back().second, clamped_end);
+        } else {
+            dirt.emplace_back(begin, clamped_end);
+        }
     }
 
-    for (uint8_t r = 1; r <= prev_state.NumRows(); ++r) {
+    for (uint8_t r = 1; r <= state.NumRows(); ++r) {
         m_data[r].resize(m_num_leaves >> r);
-        std::vector<NodePtr<RamForest::Node>> next_dirt;
-
-        for (NodePtr<RamForest::Node> dirt_node : dirt) {
-            dirt_node->ReHash();
-            auto parent = dirt_node->Parent();
-            if (parent && (next_dirt.size() == 0 || next_dirt.back()->m_position != parent->m_position)) {
-                next_dirt.push_back(std::dynamic_pointer_cast<RamForest::Node>(parent));
+        const uint64_t row_size = m_data[r].size();
+
+        // Map the dirty ranges of the row below to their parents (in row local indices).
+        // Nodes past the last pair of the row below are roots and have no parents.
+        size_t num_parent_ranges = 0;
+        for (const auto& [begin, end] : dirt) {
+            uint64_t parent_begin = begin >> 1;
+            uint64_t parent_end = std::min(((end - 1) >> 1) + 1, row_size);
+            if (parent_begin >= parent_end) continue;
+
+            if (num_parent_ranges != 0 && parent_begin <= dirt[num_parent_ranges - 1].second) {
+                dirt[num_parent_ranges - 1].second = std::max(dirt[num_parent_ranges - 1].second, parent_end);
+            } else {
+                dirt[num_parent_ranges++] = {parent_begin, parent_end};
             }
         }
-        dirt = next_dirt;
+        dirt.resize(num_parent_ranges);
+
+        for (const auto& [begin, end] : dirt) {
+            Accumulator::ParentHashes(&m_data[r][begin], &m_data[r - 1][begin << 1], end - begin);
+            MarkDirty(r, begin, end - begin);
+        }
     }
 
     RestoreRoots();
@@ -477,10 +601,164 @@ bool RamForest::Undo(const UndoBatch& undo)
 
         return true;
     }(m_posmap, m_data));
+}
+
+bool RamForest::Undo(const UndoBatch& undo)
+{
+    if (m_data.size() == 0) return true;
+
+    Ranges dirty_leaves;
+    std::vector<Hash> added_hashes;
+    if (!UndoLeaves(undo, dirty_leaves, added_hashes)) return false;
+    ReHashDirtyLeaves(dirty_leaves);
+
+    if (m_snapshots_enabled) PublishSnapshot();
+
+    return true;
+}
+
+bool RamForest::OpenUndoJournal(const std::string& file, size_t max_blocks)
+{
+    m_undo_journal = std::make_unique<UndoJournal>();
+    if (!m_undo_journal->Open(file, max_blocks, m_num_leaves)) {
+        m_undo_journal.reset();
+        return false;
+    }
 
     return true;
 }
 
+size_t RamForest::NumUndoBlocks() const
+{
+    return m_undo_journal ? m_undo_journal->Size() : 0;
+}
+
+bool RamForest::Rewind(size_t k)
+{
+    if (k == 0) return true;
+    if (!m_undo_journal || k > m_undo_journal->Size()) return false;
+
+    std::vector<UndoBatch> undos;
+    if (!m_undo_journal->Read(k, undos)) return false;
+
+    // Roll back the leaves of every modification, latest first,
+    // and rehash the union of the dirty leaves in the end.
+    Ranges dirty_leaves;
+    std::vector<std::vector<Hash>> added_hashes(undos.size());
+    for (size_t i = 0; i < undos.size(); ++i) {
+        if (UndoLeaves(undos[i], dirty_leaves, added_hashes[i])) continue;
+
+        // A failed UndoLeaves changes nothing. Redo the modifications that were rolled
+        // back already, which leaves the forest and the journal as they were.
+        ReHashDirtyLeaves(dirty_leaves);
+        while (i-- > 0) {
+            bool ok = Accumulator::Remove(undos[i].GetDeletedPositions()) &&
+                      RamForest::Add(LeafSpan(added_hashes[i]));
+            assert(ok);
+        }
+        return false;
+    }
+    ReHashDirtyLeaves(dirty_leaves);
+
+    if (m_snapshots_enabled) PublishSnapshot();
+
+    return m_undo_journal->Truncate(k);
+}
+
+void RamForest::MarkDirty(uint8_t row, uint64_t index, uint64_t count)
+{
+    if (!m_snapshots_enabled || count == 0) return;
+
+    if (row >= m_dirty_pages.size()) m_dirty_pages.resize(row + 1);
+    std::vector<bool>& pages = m_dirty_pages[row];
+
+    uint64_t last_page = (index + count - 1) / ForestSnapshot::PAGE_SIZE;
+    if (last_page >= pages.size()) pages.resize(last_page + 1, false);
+    for (uint64_t page = index / ForestSnapshot::PAGE_SIZE; page <= last_page; ++page) {
+        pages[page] = true;
+    }
+}
+
+void RamForest::PublishSnapshot()
+{
+    // Only this thread ever replaces the snapshot, so it can be read without the lock.
+    const ForestSnapshot* prev = m_snapshot.get();
+    auto snapshot = std::make_shared<ForestSnapshot>();
+
+    ForestState state(m_num_leaves);
+    snapshot->m_num_leaves = m_num_leaves;
+    Roots(snapshot->m_roots);
+
+    // The positions of the leaves on the pages that are copied.
+    auto delta = std::make_shared<ForestSnapshot::PositionDelta>();
+
+    snapshot->m_rows.resize(state.NumRows() + 1);
+    for (uint8_t row = 0; row <= state.NumRows(); ++row) {
+        const uint64_t row_size = m_num_leaves >> row;
+        const uint64_t num_pages = (row_size + ForestSnapshot::PAGE_SIZE - 1) / ForestSnapshot::PAGE_SIZE;
+        const bool has_prev_row = prev && row < prev->m_rows.size();
+        const uint64_t prev_row_size = has_prev_row ? prev->m_num_leaves >> row : 0;
+
+        std::vector<std::shared_ptr<const ForestSnapshot::Page>>& pages = snapshot->m_rows[row];
+        pages.reserve(num_pages);
+        for (uint64_t page = 0; page < num_pages; ++page) {
+            const uint64_t begin = page * ForestSnapshot::PAGE_SIZE;
+            const uint64_t end = std::min(begin + ForestSnapshot::PAGE_SIZE, row_size);
+
+            // A page can be shared if none of its hashes were written and it was
+            // used to the same extent by the previous snapshot.
+            bool dirty = row < m_dirty_pages.size() && page < m_dirty_pages[row].size() && m_dirty_pages[row][page];
+            bool same_extent = end <= prev_row_size || row_size == prev_row_size;
+            if (has_prev_row && page < prev->m_rows[row].size() && !dirty && same_extent) {
+                pages.push_back(prev->m_rows[row][page]);
+                continue;
+            }
+
+            auto copy = std::make_shared<ForestSnapshot::Page>();
+            std::copy(m_data[row].begin() + begin, m_data[row].begin() + end, copy->begin());
+            pages.push_back(std::move(copy));
+
+            if (row == 0 && prev) {
+                for (uint64_t pos = begin; pos < end; ++pos) {
+                    delta->m_positions[m_data[0][pos]] = pos;
+                }
+            }
+        }
+    }
+    m_dirty_pages.clear();
+
+    // Copy the whole position map once the deltas outgrow a fraction of it.
+    const size_t num_entries = delta->m_positions.size() +
+                               (prev && prev->m_posmap_delta ? prev->m_posmap_delta->m_num_entries : 0);
+    const size_t depth = 1 + (prev && prev->m_posmap_delta ? prev->m_posmap_delta->m_depth : 0);
+    if (!prev || depth > 64 || num_entries > prev->m_posmap_base->size() / 4 + ForestSnapshot::PAGE_SIZE) {
+        snapshot->m_posmap_base = std::make_shared<const ForestSnapshot::PositionMap>(m_posmap);
+    } else {
+        snapshot->m_posmap_base = prev->m_posmap_base;
+        delta->m_prev = prev->m_posmap_delta;
+        delta->m_depth = depth;
+        delta->m_num_entries = num_entries;
+        snapshot->m_posmap_delta = std::move(delta);
+    }
+
+    std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+    m_snapshot = std::move(snapshot);
+}
+
+void RamForest::EnableSnapshots()
+{
+    if (m_snapshots_enabled) return;
+
+    m_snapshots_enabled = true;
+    PublishSnapshot();
+}
+
+std::shared_ptr<const ForestSnapshot> RamForest::GetSnapshot() const
+{
+    std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+    return m_snapshot;
+}
+
 Hash RamForest::GetLeaf(uint64_t pos) const
 {
     assert(pos < m_num_leaves);
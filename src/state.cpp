@@ -1,7 +1,6 @@
 #include "crypto/common.h"
 
 #include <algorithm>
-#include <bitset>
 #include <check.h>
 #include <iostream>
 #include <memory>
@@ -24,85 +23,8 @@ void print_swaps(const std::vector<ForestState::Swap>& vec)
     std::cout << std::endl;
 }
 
-// Return the number of trailing one bits in n.
-uint8_t trailingOnes(uint64_t n)
-{
-    uint64_t b = ~n & (n + 1);
-    --b;
-    b = (b & 0x5555555555555555) +
-        ((b >> 1) & 0x5555555555555555);
-    b = (b & 0x3333333333333333) +
-        ((b >> 2) & 0x3333333333333333);
-    b = (b & 0x0f0f0f0f0f0f0f0f) +
-        ((b >> 4) & 0x0f0f0f0f0f0f0f0f);
-    b = (b & 0x00ff00ff00ff00ff) +
-        ((b >> 8) & 0x00ff00ff00ff00ff);
-    b = (b & 0x0000ffff0000ffff) +
-        ((b >> 16) & 0x0000ffff0000ffff);
-    b = (b & 0x00000000ffffffff) +
-        ((b >> 32) & 0x00000000ffffffff);
-
-    return b;
-}
-
-uint8_t trailingZeros(uint64_t n)
-{
-    return trailingOnes(~n);
-}
-
-// TODO: Maybe export these?
-uint64_t _rootPosition(uint8_t row, uint64_t num_leaves, uint8_t rows);
-uint8_t _numRows(uint64_t num_leaves);
-uint8_t _hasRoot(uint64_t num_leaves);
-uint64_t _maxNodes(uint64_t num_leaves);
-
 // positions
 
-uint64_t ForestState::Parent(uint64_t pos) const
-{
-    return (pos >> 1ULL) | (1ULL << this->NumRows());
-}
-
-uint64_t ForestState::Ancestor(uint64_t pos, uint8_t rise) const
-{
-    if (rise == 0) {
-        return pos;
-    }
-
-    uint8_t rows = this->NumRows();
-    uint64_t mask = this->MaxNodes();
-    return (pos >> rise | (mask << (rows - (rise - 1)))) & mask;
-}
-
-uint64_t ForestState::LeftChild(uint64_t pos) const
-{
-    CHECK_SAFE(pos >= this->m_num_leaves);
-    return (pos << 1) & (this->MaxNodes());
-}
-
-uint64_t ForestState::Child(uint64_t pos, uint64_t placement) const
-{
-    return this->LeftChild(pos) | placement;
-}
-
-uint64_t ForestState::LeftDescendant(uint64_t pos, uint8_t drop) const
-{
-    CHECK_SAFE(drop <= this->DetectRow(pos));
-
-    if (drop == 0) {
-        return pos;
-    }
-
-    uint64_t mask = this->MaxNodes();
-    return (pos << drop) & mask;
-}
-
-uint64_t ForestState::Cousin(uint64_t pos) const { return pos ^ 2; }
-
-uint64_t ForestState::RightSibling(uint64_t pos) const { return pos | 1; }
-
-uint64_t ForestState::Sibling(uint64_t pos) const { return pos ^ 1; }
-
 std::tuple<uint8_t, uint8_t, uint64_t> ForestState::Path(uint64_t pos) const
 {
     uint8_t rows = this->NumRows();
@@ -145,26 +67,115 @@ std::tuple<uint8_t, uint8_t, uint64_t> ForestState::Path(uint64_t pos) const
     return std::make_tuple(biggerTrees, rows - row, ~pos);
 }
 
+/*
+ * Walk the sorted targets [start, end) of one row (the root excluded) and call
+ * proof(pos) for every proof position and next(pos) for every target of the next row.
+ * next is called at most once per consumed target and never before the targets it is
+ * derived from have been read, so the next row may be written over the current one.
+ */
+template <typename ProofFn, typename NextFn>
+static void ProofPositionsRow(const ForestState& state,
+                              const uint64_t* start,
+                              const uint64_t* end,
+                              ProofFn&& proof,
+                              NextFn&& next)
+{
+    while (start < end) {
+        int size = end - start;
+
+        // look at the first 4 targets
+        if (size > 3 && state.Cousin(state.RightSibling(start[0])) ==
+                            state.RightSibling(start[3])) {
+            // the first and fourth target are cousins
+            // => target 2 and 3 are also targets, both parents are targets of next
+            // row
+            next(state.Parent(start[0]));
+            next(state.Parent(start[3]));
+            start += 4;
+            continue;
+        }
+
+        // look at the first 3 targets
+        if (size > 2 && state.Cousin(state.RightSibling(start[0])) ==
+                            state.RightSibling(start[2])) {
+            // the first and third target are cousins
+            // => the second target is either the sibling of the first
+            // OR the sibiling of the third
+            // => only the sibling that is not a target is appended to the proof positions
+            if (state.RightSibling(start[1]) == state.RightSibling(start[0])) {
+                proof(state.Sibling(start[2]));
+            } else {
+                proof(state.Sibling(start[0]));
+            }
+
+            next(state.Parent(start[0]));
+            next(state.Parent(start[2]));
+            start += 3;
+            continue;
+        }
+
+        // look at the first 2 targets
+        if (size > 1) {
+            if (state.RightSibling(start[0]) == start[1]) {
+                // the first and the second target are siblings
+                // => parent is a target for the next.
+                next(state.Parent(start[0]));
+                start += 2;
+                continue;
+            }
+
+            if (state.Cousin(state.RightSibling(start[0])) ==
+                state.RightSibling(start[1])) {
+                // the first and the second target are cousins
+                // => both siblings are part of the proof
+                // => both parents are targets for the next row
+                proof(state.Sibling(start[0]));
+                proof(state.Sibling(start[1]));
+                next(state.Parent(start[0]));
+                next(state.Parent(start[1]));
+                start += 2;
+                continue;
+            }
+        }
+
+        // look at the first target
+        proof(state.Sibling(start[0]));
+        next(state.Parent(start[0]));
+        ++start;
+    }
+}
+
 std::pair<std::vector<uint64_t>, std::vector<uint64_t>>
 ForestState::ProofPositions(const std::vector<uint64_t>& targets) const
 {
-    uint64_t rows = this->NumRows();
-
-    // store for the proof and computed positions
-    // proof positions are needed to verify,
-    // computed positions are the positions of the targets as well as
-    // positions that are computed while verifying.
     std::vector<uint64_t> proof, computed;
+    ProofPositions(targets, proof, computed);
+    return std::make_pair(proof, computed);
+}
 
-    std::vector<uint64_t>::const_iterator start = targets.cbegin(),
-                                          end = targets.cend();
+void ForestState::ProofPositions(const std::vector<uint64_t>& targets,
+                                 std::vector<uint64_t>& proof,
+                                 std::vector<uint64_t>& computed) const
+{
+    uint8_t rows = this->NumRows();
 
-    // saves the reference to nextTargets in the loop from being destroyed
-    std::vector<uint64_t> savior;
-    std::vector<uint64_t> nextTargets;
+    // Every row has at most as many targets as the row below it, so all rows (and the
+    // targets produced above the top row) fit into the reserved capacity and the
+    // pointers into computed stay valid.
+    proof.clear();
+    computed.clear();
+    proof.reserve(targets.size() * (rows + 1));
+    computed.reserve(targets.size() * (rows + 2));
+
+    // The targets of every row are appended to the computed positions and
+    // the targets of the next row are read back from there.
+    computed.insert(computed.end(), targets.begin(), targets.end());
+    size_t row_start = 0;
 
     for (uint8_t row = 0; row <= rows; ++row) {
-        computed.insert(computed.end(), start, end);
+        size_t row_end = computed.size();
+        const uint64_t* start = computed.data() + row_start;
+        const uint64_t* end = computed.data() + row_end;
 
         if (this->HasRoot(row) && start < end &&
             *(end - 1) == this->RootPosition(row)) {
@@ -172,109 +183,72 @@ ForestState::ProofPositions(const std::vector<uint64_t>& targets) const
             --end;
         }
 
-        while (start < end) {
-            int size = end - start;
-
-            // look at the first 4 targets
-            if (size > 3 && this->Cousin(this->RightSibling(start[0])) ==
-                                this->RightSibling(start[3])) {
-                // the first and fourth target are cousins
-                // => target 2 and 3 are also targets, both parents are targets of next
-                // row
-                nextTargets.insert(nextTargets.end(),
-                                   {this->Parent(start[0]), this->Parent(start[3])});
-                start += 4;
-                continue;
-            }
+        ProofPositionsRow(
+            *this, start, end,
+            [&proof](uint64_t pos) { proof.push_back(pos); },
+            [&computed](uint64_t pos) { computed.push_back(pos); });
 
-            // look at the first 3 targets
-            if (size > 2 && this->Cousin(this->RightSibling(start[0])) ==
-                                this->RightSibling(start[2])) {
-                // the first and third target are cousins
-                // => the second target is either the sibling of the first
-                // OR the sibiling of the third
-                // => only the sibling that is not a target is appended to the proof positions
-                if (this->RightSibling(start[1]) == this->RightSibling(start[0])) {
-                    proof.push_back(this->Sibling(start[2]));
-                } else {
-                    proof.push_back(this->Sibling(start[0]));
-                }
-
-                nextTargets.insert(nextTargets.end(),
-                                   {this->Parent(start[0]), this->Parent(start[2])});
-                start += 3;
-                continue;
-            }
+        row_start = row_end;
+    }
 
-            // look at the first 2 targets
-            if (size > 1) {
-                if (this->RightSibling(start[0]) == start[1]) {
-                    // the first and the second target are siblings
-                    // => parent is a target for the next.
-                    nextTargets.push_back(this->Parent(start[0]));
-                    start += 2;
-                    continue;
-                }
-
-                if (this->Cousin(this->RightSibling(start[0])) ==
-                    this->RightSibling(start[1])) {
-                    // the first and the second target are cousins
-                    // => both siblings are part of the proof
-                    // => both parents are targets for the next row
-                    proof.insert(proof.end(),
-                                 {this->Sibling(start[0]), this->Sibling(start[1])});
-                    nextTargets.insert(nextTargets.end(),
-                                       {this->Parent(start[0]), this->Parent(start[1])});
-                    start += 2;
-                    continue;
-                }
-            }
+    // Drop the targets for the row above the forest, which does not exist.
+    computed.resize(row_start);
+}
+
+uint64_t ForestState::NumProofPositions(const std::vector<uint64_t>& targets) const
+{
+    uint8_t rows = this->NumRows();
+    uint64_t num_proof = 0;
+
+    // The targets of the next row are compacted in place at the front of the current row.
+    std::vector<uint64_t> row_targets(targets);
+    size_t size = row_targets.size();
 
-            // look at the first target
-            proof.push_back(this->Sibling(start[0]));
-            nextTargets.push_back(this->Parent(start[0]));
-            ++start;
+    for (uint8_t row = 0; row <= rows; ++row) {
+        uint64_t* start = row_targets.data();
+        uint64_t* end = start + size;
+
+        if (this->HasRoot(row) && start < end &&
+            *(end - 1) == this->RootPosition(row)) {
+            // remove roots from targets
+            --end;
         }
 
-        savior = nextTargets;
-        start = savior.cbegin();
-        end = savior.cend();
-        nextTargets.clear();
+        uint64_t* next = start;
+        ProofPositionsRow(
+            *this, start, end,
+            [&num_proof](uint64_t) { ++num_proof; },
+            [&next](uint64_t pos) { *next++ = pos; });
+
+        size = next - start;
     }
 
-    return std::make_pair(proof, computed);
+    return num_proof;
 }
 
-// roots
-
-uint8_t ForestState::NumRoots() const
+std::vector<uint64_t> ForestState::CachedProofPositions(const std::vector<uint64_t>& remembered) const
 {
-    std::bitset<64> bits(this->m_num_leaves);
-    return bits.count();
-}
+    std::vector<uint64_t> cached;
+    cached.reserve(remembered.size() * this->NumRows() * 2);
 
-bool _hasRoot(uint64_t num_leaves, uint8_t row)
-{
-    return (num_leaves >> row) & 1;
-}
+    for (uint64_t pos : remembered) {
+        uint8_t path_length{0};
+        std::tie(std::ignore, path_length, std::ignore) = this->Path(pos);
 
-bool ForestState::HasRoot(uint8_t row) const
-{
-    return _hasRoot(this->m_num_leaves, row);
-}
+        // The pollard holds the path of the remembered leaf and the siblings needed to prove it.
+        for (uint8_t i = 0; i < path_length; ++i) {
+            cached.push_back(pos);
+            cached.push_back(this->Sibling(pos));
+            pos = this->Parent(pos);
+        }
+    }
 
-uint64_t _rootPosition(uint8_t row, uint64_t num_leaves, uint8_t rows)
-{
-    uint64_t mask = (2ULL << rows) - 1;
-    uint64_t before = num_leaves & (mask << (row + 1));
-    uint64_t shifted = (before >> row) | (mask << (rows + 1 - row));
-    return shifted & mask;
+    std::sort(cached.begin(), cached.end());
+    cached.erase(std::unique(cached.begin(), cached.end()), cached.end());
+    return cached;
 }
 
-uint64_t ForestState::RootPosition(uint8_t row) const
-{
-    return _rootPosition(row, this->m_num_leaves, this->NumRows());
-}
+// roots
 
 std::vector<uint64_t> ForestState::RootPositions() const
 {
@@ -291,8 +265,8 @@ std::vector<uint64_t> ForestState::RootPositions(uint64_t num_leaves) const
 {
     std::vector<uint64_t> roots;
     for (uint8_t row = this->NumRows(); row >= 0 && row < 64; --row) {
-        if (_hasRoot(num_leaves, row)) {
-            roots.push_back(_rootPosition(row, num_leaves, this->NumRows()));
+        if ((num_leaves >> row) & 1) {
+            roots.push_back(this->RootPosition(row, num_leaves));
         }
     }
     return roots;
@@ -305,60 +279,19 @@ uint8_t ForestState::RootIndex(uint64_t pos) const
     return root_index;
 }
 
-
-// rows
-
-uint8_t _numRows(uint64_t num_leaves)
-{
-    if (num_leaves == 0) return 0;
-    return CountBits(num_leaves - 1);
-}
-
-
-uint8_t ForestState::NumRows() const
-{
-    return _numRows(this->m_num_leaves);
-}
-
-uint8_t ForestState::DetectRow(uint64_t pos) const
-{
-    uint64_t marker = 1ULL << this->NumRows();
-    uint8_t row = 0;
-
-    for (; (pos & marker) != 0; ++row) {
-        marker >>= 1;
-    }
-
-    return row;
-}
-
-uint64_t ForestState::RowOffset(uint64_t pos) const
-{
-    return RowOffset(DetectRow(pos));
-}
-
-uint64_t ForestState::RowOffset(uint8_t row) const
-{
-    uint64_t marker = MaxNodes();
-    return (0xFFFFFFFFFFFFFFFF << (NumRows() + 1 - row)) & marker;
-}
-
 // transform
 
-std::vector<std::vector<ForestState::Swap>>
-ForestState::Transform(const std::vector<uint64_t>& targets) const
+void ForestState::Transform(Span<const uint64_t> targets, SwapBuffer& swaps) const
 {
     uint8_t rows = this->NumRows();
     uint64_t next_num_leaves = this->m_num_leaves - targets.size();
 
-    std::vector<std::vector<ForestState::Swap>> swaps;
-    std::vector<ForestState::Swap> collapses;
-    swaps.reserve(rows);
-    collapses.reserve(rows);
-
-    std::vector<uint64_t> current_row_targets(targets);
+    swaps.Clear();
+    swaps.m_row_offsets.push_back(0);
+    swaps.m_targets.assign(targets.begin(), targets.end());
 
-    for (uint8_t row = 0; row < rows && current_row_targets.size() > 0; ++row) {
+    for (uint8_t row = 0; row < rows && swaps.m_targets.size() > 0; ++row) {
+        std::vector<uint64_t>& current_row_targets = swaps.m_targets;
         bool root_present = this->HasRoot(row);
         uint64_t root_pos = this->RootPosition(row);
 
@@ -369,36 +302,32 @@ ForestState::Transform(const std::vector<uint64_t>& targets) const
 
         bool deletion_remains = current_row_targets.size() % 2 != 0;
 
-        //extract_pair.first are the parents of the siblings, extract_pair.second is the input with out siblings.
-        std::pair<std::vector<uint64_t>, std::vector<uint64_t>> extract_pair =
-            ComputeNextRowTargets(current_row_targets, deletion_remains, root_present);
+        ComputeNextRowTargets(current_row_targets, deletion_remains, root_present,
+                              swaps.m_next_targets, swaps.m_lone_targets);
 
         // TODO: avoid sorting (the go version does this differently)
-        std::sort(extract_pair.first.begin(), extract_pair.first.end());
+        std::sort(swaps.m_next_targets.begin(), swaps.m_next_targets.end());
 
-        swaps.push_back(this->MakeSwaps(extract_pair.second, deletion_remains, root_present, root_pos));
-        collapses.push_back(this->MakeCollapse(extract_pair.second, deletion_remains, root_present, row, next_num_leaves));
+        this->MakeSwaps(swaps.m_lone_targets, deletion_remains, root_present, root_pos, swaps.m_swaps);
+        swaps.m_collapses[row] = this->MakeCollapse(swaps.m_lone_targets, deletion_remains, root_present, row, next_num_leaves);
+        swaps.m_row_offsets.push_back(swaps.m_swaps.size());
 
-        current_row_targets = extract_pair.first;
+        std::swap(swaps.m_targets, swaps.m_next_targets);
     }
 
-    // Convert collapses to swaps and append them to the swaps list.
-    this->ConvertCollapses(swaps, collapses);
-
-    return swaps;
+    // Convert collapses to swaps and insert them into the swaps.
+    this->ConvertCollapses(swaps);
 }
 
 std::vector<ForestState::Swap> ForestState::UndoTransform(const std::vector<uint64_t>& targets) const
 {
     std::vector<ForestState::Swap> undo_swaps;
-    auto prev_swaps = Transform(targets);
+    SwapBuffer prev_swaps;
+    Transform(targets, prev_swaps);
 
-    for (int r = 0; r < prev_swaps.size(); ++r) {
-        auto row = prev_swaps[r];
-        for (const ForestState::Swap& swap : row) {
-            if (swap.m_from == swap.m_to) continue;
-            undo_swaps.push_back(swap.ToLeaves(*this));
-        }
+    for (const ForestState::Swap& swap : prev_swaps.Swaps()) {
+        if (swap.m_from == swap.m_to) continue;
+        undo_swaps.push_back(swap.ToLeaves(*this));
     }
 
     return undo_swaps;
@@ -406,12 +335,8 @@ std::vector<ForestState::Swap> ForestState::UndoTransform(const std::vector<uint
 
 // misc
 
-uint64_t _maxNodes(uint64_t num_leaves) { return (2ULL << _numRows(num_leaves)) - 1; }
-uint64_t ForestState::MaxNodes() const { return _maxNodes(this->m_num_leaves); }
-
-
 // Check that the targets are sorted in ascending order and dont have any duplicates.
-bool IsSortedNoDupes(const std::vector<uint64_t>& targets)
+bool IsSortedNoDupes(Span<const uint64_t> targets)
 {
     for (uint64_t i = 0; i < targets.size() - 1; ++i) {
         if (targets[i] >= targets[i + 1]) {
@@ -422,7 +347,7 @@ bool IsSortedNoDupes(const std::vector<uint64_t>& targets)
     return true;
 }
 
-bool ForestState::CheckTargetsSanity(const std::vector<uint64_t>& targets) const
+bool ForestState::CheckTargetsSanity(Span<const uint64_t> targets) const
 {
     if (targets.size() == 0) {
         // An empty target list is OK.
@@ -451,12 +376,14 @@ bool ForestState::CheckTargetsSanity(const std::vector<uint64_t>& targets) const
 
 // private
 
-std::pair<std::vector<uint64_t>, std::vector<uint64_t>>
-ForestState::ComputeNextRowTargets(const std::vector<uint64_t>& targets,
-                                   bool deletion_remains,
-                                   bool root_present) const
+void ForestState::ComputeNextRowTargets(const std::vector<uint64_t>& targets,
+                                        bool deletion_remains,
+                                        bool root_present,
+                                        std::vector<uint64_t>& parents,
+                                        std::vector<uint64_t>& lone_targets) const
 {
-    std::vector<uint64_t> targets_without_siblings, parents;
+    parents.clear();
+    lone_targets.clear();
 
     std::vector<uint64_t>::const_iterator start = targets.begin();
     while (start < targets.end()) {
@@ -470,30 +397,24 @@ ForestState::ComputeNextRowTargets(const std::vector<uint64_t>& targets,
         }
 
         // This target has no sibling.
-        targets_without_siblings.push_back(start[0]);
-        if (targets_without_siblings.size() % 2 == 0) {
+        lone_targets.push_back(start[0]);
+        if (lone_targets.size() % 2 == 0) {
             parents.push_back(this->Parent(start[0]));
         }
         ++start;
     }
 
     if (deletion_remains && !root_present) {
-        parents.push_back(this->Parent(targets_without_siblings.back()));
+        parents.push_back(this->Parent(lone_targets.back()));
     }
-
-    return std::make_pair(parents, targets_without_siblings);
 }
 
-std::vector<ForestState::Swap> ForestState::MakeSwaps(const std::vector<uint64_t>& targets,
-                                                      bool deletion_remains,
-                                                      bool root_present,
-                                                      uint64_t root_pos) const
+void ForestState::MakeSwaps(const std::vector<uint64_t>& targets,
+                            bool deletion_remains,
+                            bool root_present,
+                            uint64_t root_pos,
+                            std::vector<ForestState::Swap>& swaps) const
 {
-    // +1 for deletion_remains && root_present == true
-    uint32_t num_swaps = (targets.size() >> 1) + 1;
-    std::vector<ForestState::Swap> swaps;
-    swaps.reserve(num_swaps);
-
     std::vector<uint64_t>::const_iterator start = targets.begin();
     while (targets.end() - start > 1) {
         // Look at 2 targets at a time and create a swap that turns both deletions into siblings.
@@ -507,8 +428,6 @@ std::vector<ForestState::Swap> ForestState::MakeSwaps(const std::vector<uint64_t
         // => swap target with the root.
         swaps.push_back(ForestState::Swap(root_pos, start[0]));
     }
-
-    return swaps;
 }
 
 ForestState::Swap ForestState::MakeCollapse(const std::vector<uint64_t>& targets,
@@ -518,7 +437,7 @@ ForestState::Swap ForestState::MakeCollapse(const std::vector<uint64_t>& targets
                                             uint64_t next_num_leaves) const
 {
     // The position of the root on this row after the deletion.
-    uint64_t root_dest = _rootPosition(row, next_num_leaves, this->NumRows());
+    uint64_t root_dest = this->RootPosition(row, next_num_leaves);
 
     if (!deletion_remains && root_present) {
         // No deletion remaining but there is a root.
@@ -538,50 +457,79 @@ ForestState::Swap ForestState::MakeCollapse(const std::vector<uint64_t>& targets
     return ForestState::Swap(0, 0);
 }
 
-void ForestState::ConvertCollapses(std::vector<std::vector<ForestState::Swap>>& swaps,
-                                   std::vector<ForestState::Swap>& collapses) const
+void ForestState::ConvertCollapses(SwapBuffer& swaps) const
 {
-    if (collapses.size() == 0) {
+    uint8_t num_rows = swaps.NumRows();
+    std::array<ForestState::Swap, 64>& collapses = swaps.m_collapses;
+
+    // Bit r is set if row r has a collapse.
+    uint64_t collapse_rows = 0;
+    for (uint8_t row = 0; row < num_rows; ++row) {
+        if (collapses[row].m_collapse) collapse_rows |= 1ULL << row;
+    }
+
+    if (collapse_rows == 0) {
         // If there is nothing to collapse, we're done
         return;
     }
 
+    for (uint8_t row = num_rows - 1; row != 0; --row) {
+        // Only the collapses below this row can be affected.
+        uint64_t lower_collapse_rows = collapse_rows & ((1ULL << row) - 1);
+        if (lower_collapse_rows == 0) break;
 
-    for (uint8_t row = collapses.size() - 1; row != 0; --row) {
-        for (ForestState::Swap swap : swaps.at(row)) {
+        for (const ForestState::Swap* swap = swaps.RowBegin(row); swap != swaps.RowEnd(row); ++swap) {
             // For every swap in the row, convert the collapses below the swap.
-            this->SwapInRow(swap, collapses, row);
+            this->SwapInRow(*swap, collapses, lower_collapse_rows, row);
         }
 
-        if (!collapses.at(row).m_collapse) {
+        if (!collapses[row].m_collapse) {
             // There is no collapse in this row.
             continue;
         }
 
         // For the collapse on this row, convert the other collapses located below.
-        this->SwapInRow(collapses.at(row), collapses, row);
+        this->SwapInRow(collapses[row], collapses, lower_collapse_rows, row);
+    }
+
+    // Insert every collapse at the end of its row. The swaps are moved up in place,
+    // starting at the top row, so every swap is moved at most once.
+    size_t num_collapses = 0;
+    for (uint8_t row = 0; row < num_rows; ++row) {
+        const ForestState::Swap& collapse = collapses[row];
+        if (collapse.m_collapse && collapse.m_from != collapse.m_to) {
+            ++num_collapses;
+        } else {
+            collapse_rows &= ~(1ULL << row);
+        }
     }
 
-    // Append collapses to swaps.
-    uint8_t row = 0;
-    for (ForestState::Swap collapse : collapses) {
-        if (collapse.m_from != collapse.m_to && collapse.m_collapse) {
-            swaps.at(row).push_back(collapse);
+    std::vector<ForestState::Swap>& flat = swaps.m_swaps;
+    std::vector<size_t>& offsets = swaps.m_row_offsets;
+    flat.resize(flat.size() + num_collapses);
+
+    size_t shift = num_collapses;
+    for (uint8_t row = num_rows; row-- > 0 && shift > 0;) {
+        size_t begin = offsets[row], end = offsets[row + 1];
+        offsets[row + 1] = end + shift;
+
+        if ((collapse_rows >> row) & 1) {
+            flat[end + shift - 1] = collapses[row];
+            --shift;
         }
-        ++row;
+
+        std::move_backward(flat.begin() + begin, flat.begin() + end, flat.begin() + end + shift);
     }
 }
 
 void ForestState::SwapInRow(ForestState::Swap swap,
-                            std::vector<ForestState::Swap>& collapses,
+                            std::array<ForestState::Swap, 64>& collapses,
+                            uint64_t collapse_rows,
                             uint8_t swap_row) const
 {
-    for (uint8_t collapse_row = 0; collapse_row < swap_row; ++collapse_row) {
-        if (!collapses.at(collapse_row).m_collapse) {
-            continue;
-        }
-
-        this->SwapIfDescendant(swap, collapses.at(collapse_row), swap_row, collapse_row);
+    for (; collapse_rows != 0; collapse_rows &= collapse_rows - 1) {
+        uint8_t collapse_row = TrailingZeros(collapse_rows);
+        this->SwapIfDescendant(swap, collapses[collapse_row], swap_row, collapse_row);
     }
 }
 
@@ -2,11 +2,19 @@
 #ifndef UTREEXO_STATE_H
 #define UTREEXO_STATE_H
 
+#include "check.h"
+#include "include/span.h"
+
+#include <array>
+#include <stddef.h>
 #include <stdint.h>
+#include <tuple>
 #include <vector>
 
 namespace utreexo {
 
+class SwapBuffer;
+
 /**
  * A wrapper around the number of leaves the accumulator forest
  * that provides utility functions to compute positions and swaps,
@@ -30,6 +38,7 @@ public:
         bool m_is_range_swap;
         uint64_t m_range;
 
+        Swap() : Swap(0, 0) {}
         explicit Swap(uint64_t from, uint64_t to)
             : m_from(from), m_to(to), m_collapse(false), m_is_range_swap(false), m_range(0) {}
         explicit Swap(uint64_t from, uint64_t to, bool collapse)
@@ -42,30 +51,96 @@ public:
 
     // The number of leaves in the forest.
     // TODO: make this private.
+    // (Do not modify it, the derived fields below would go stale.)
     uint64_t m_num_leaves;
 
-    ForestState() : m_num_leaves(0) {}
-    ForestState(uint64_t n) : m_num_leaves(n) {}
+private:
+    // Derived from m_num_leaves on construction, because they are needed by
+    // almost every position computation.
+    uint8_t m_rows;
+    uint64_t m_max_nodes;
+
+    static_assert(sizeof(unsigned long long) == sizeof(uint64_t), "the bit builtins operate on unsigned long long");
+
+    // Return the number of leading zero bits in n (64 if n is zero).
+    static constexpr uint8_t LeadingZeros(uint64_t n)
+    {
+#if defined(__GNUC__)
+        return n ? __builtin_clzll(n) : 64;
+#else
+        uint8_t zeros = 0;
+        for (uint64_t bit = 1ULL << 63; bit != 0 && (n & bit) == 0; bit >>= 1) ++zeros;
+        return zeros;
+#endif
+    }
+
+    // Return the number of trailing zero bits in n (64 if n is zero).
+    static constexpr uint8_t TrailingZeros(uint64_t n)
+    {
+#if defined(__GNUC__)
+        return n ? __builtin_ctzll(n) : 64;
+#else
+        uint8_t zeros = 0;
+        for (uint64_t bit = 1; bit != 0 && (n & bit) == 0; bit <<= 1) ++zeros;
+        return zeros;
+#endif
+    }
+
+    // Return the number of set bits in n.
+    static constexpr uint8_t PopCount(uint64_t n)
+    {
+#if defined(__GNUC__)
+        return __builtin_popcountll(n);
+#else
+        uint8_t count = 0;
+        for (; n != 0; n &= n - 1) ++count;
+        return count;
+#endif
+    }
+
+    static constexpr uint8_t ComputeNumRows(uint64_t num_leaves)
+    {
+        // The number of bits needed to represent num_leaves - 1.
+        return num_leaves <= 1 ? 0 : 64 - LeadingZeros(num_leaves - 1);
+    }
+
+public:
+    constexpr ForestState() : ForestState(0) {}
+    constexpr ForestState(uint64_t n)
+        : m_num_leaves(n), m_rows(ComputeNumRows(n)), m_max_nodes((2ULL << m_rows) - 1) {}
 
     // Functions to compute positions:
 
     // Return the parent positon.
     // Same as ancestor(pos, 1)
-    uint64_t Parent(uint64_t pos) const;
-    uint64_t Ancestor(uint64_t pos, uint8_t rise) const;
+    constexpr uint64_t Parent(uint64_t pos) const { return (pos >> 1) | (1ULL << m_rows); }
+    constexpr uint64_t Ancestor(uint64_t pos, uint8_t rise) const
+    {
+        if (rise == 0) return pos;
+        return (pos >> rise | (m_max_nodes << (m_rows - (rise - 1)))) & m_max_nodes;
+    }
     // Return the position of the left child.
     // Same as leftDescendant(pos, 1).
-    uint64_t LeftChild(uint64_t pos) const;
-    uint64_t Child(uint64_t pos, uint64_t placement) const;
-    uint64_t LeftDescendant(uint64_t pos, uint8_t drop) const;
+    constexpr uint64_t LeftChild(uint64_t pos) const
+    {
+        CHECK_SAFE(pos >= m_num_leaves);
+        return (pos << 1) & m_max_nodes;
+    }
+    constexpr uint64_t Child(uint64_t pos, uint64_t placement) const { return LeftChild(pos) | placement; }
+    constexpr uint64_t LeftDescendant(uint64_t pos, uint8_t drop) const
+    {
+        CHECK_SAFE(drop <= DetectRow(pos));
+        if (drop == 0) return pos;
+        return (pos << drop) & m_max_nodes;
+    }
     // Return the position of the cousin.
     // Placement (left,right) remains.
-    uint64_t Cousin(uint64_t pos) const;
+    constexpr uint64_t Cousin(uint64_t pos) const { return pos ^ 2; }
     // Return the position of the right sibling.
     // A right position is its own right sibling.
-    uint64_t RightSibling(uint64_t pos) const;
+    constexpr uint64_t RightSibling(uint64_t pos) const { return pos | 1; }
     // Return the position of the sibling.
-    uint64_t Sibling(uint64_t pos) const;
+    constexpr uint64_t Sibling(uint64_t pos) const { return pos ^ 1; }
 
     /**
      * Compute the path to the position.
@@ -81,16 +156,40 @@ public:
      */
     std::pair<std::vector<uint64_t>, std::vector<uint64_t>>
     ProofPositions(const std::vector<uint64_t>& targets) const;
+    /**
+     * Same as above but write into the provided buffers, which are cleared first.
+     * Reusing the buffers avoids all allocations once their capacity has grown to
+     * targets.size() * (NumRows() + 2).
+     */
+    void ProofPositions(const std::vector<uint64_t>& targets,
+                        std::vector<uint64_t>& proof,
+                        std::vector<uint64_t>& computed) const;
+    /** Return the number of proof positions needed to proof the existence of some targets. */
+    uint64_t NumProofPositions(const std::vector<uint64_t>& targets) const;
+
+    /**
+     * Compute the proof positions a pollard has cached when it remembers the given leaves.
+     * These are the nodes on the path from a remembered leaf up to (but excluding) its root
+     * and their siblings.
+     * Return the positions sorted in ascending order.
+     */
+    std::vector<uint64_t> CachedProofPositions(const std::vector<uint64_t>& remembered) const;
 
     // Functions for root stuff:
 
     // Return the number of roots.
-    uint8_t NumRoots() const;
+    constexpr uint8_t NumRoots() const { return PopCount(m_num_leaves); }
     // Check if there is a root on a row.
-    bool HasRoot(uint8_t row) const;
+    constexpr bool HasRoot(uint8_t row) const { return (m_num_leaves >> row) & 1; }
     // Return the root position on a row.
-    uint64_t RootPosition(uint8_t row) const;
-    uint64_t RootPosition(uint8_t row, uint64_t num_leaves) const;
+    constexpr uint64_t RootPosition(uint8_t row) const { return RootPosition(row, m_num_leaves); }
+    // Return the root position on a row for a forest with num_leaves leaves but the rows of this forest.
+    constexpr uint64_t RootPosition(uint8_t row, uint64_t num_leaves) const
+    {
+        uint64_t before = num_leaves & (m_max_nodes << (row + 1));
+        uint64_t shifted = (before >> row) | (m_max_nodes << (m_rows + 1 - row));
+        return shifted & m_max_nodes;
+    }
     // Return the positions of the roots in the forest
     std::vector<uint64_t> RootPositions() const;
     std::vector<uint64_t> RootPositions(uint64_t num_leaves) const;
@@ -100,46 +199,56 @@ public:
     // Functions for rows:
 
     // Return the number of rows.
-    uint8_t NumRows() const;
+    constexpr uint8_t NumRows() const { return m_rows; }
     // Return the row of the position.
-    uint8_t DetectRow(uint64_t pos) const;
+    constexpr uint8_t DetectRow(uint64_t pos) const
+    {
+        // The row is the number of consecutive set bits, starting at bit NumRows().
+        return LeadingZeros(~(pos << (63 - m_rows)));
+    }
     // Return the position of the first node in the row.
-    uint64_t RowOffset(uint64_t pos) const;
-    uint64_t RowOffset(uint8_t row) const;
+    constexpr uint64_t RowOffset(uint64_t pos) const { return RowOffset(DetectRow(pos)); }
+    constexpr uint64_t RowOffset(uint8_t row) const
+    {
+        return (0xFFFFFFFFFFFFFFFF << (m_rows + 1 - row)) & m_max_nodes;
+    }
 
     /**
      * Compute the remove transformation swaps.
-     * Return a vector of swaps for every row in the forest (from bottom to top).
+     * Write the swaps for every row in the forest (from bottom to top) into the buffer,
+     * which is cleared first.
      */
-    std::vector<std::vector<ForestState::Swap>>
-    Transform(const std::vector<uint64_t>& targets) const;
+    void Transform(Span<const uint64_t> targets, SwapBuffer& swaps) const;
 
     std::vector<ForestState::Swap> UndoTransform(const std::vector<uint64_t>& targets) const;
 
     // Misc:
 
     // Return the maximum number of nodes in the forest.
-    uint64_t MaxNodes() const;
+    constexpr uint64_t MaxNodes() const { return m_max_nodes; }
 
-    bool CheckTargetsSanity(const std::vector<uint64_t>& targets) const;
+    bool CheckTargetsSanity(Span<const uint64_t> targets) const;
 
 private:
     /*
-     * Return all targets of this row and all targets of the next row.
+     * Compute the targets of the next row (parents) and the targets of this row
+     * that do not have their sibling as a target (lone_targets).
      * (targets are the nodes that will be deleted)
      */
-    std::pair<std::vector<uint64_t>, std::vector<uint64_t>>
-    ComputeNextRowTargets(const std::vector<uint64_t>& targets,
-                          bool deletion_remains,
-                          bool root_present) const;
+    void ComputeNextRowTargets(const std::vector<uint64_t>& targets,
+                               bool deletion_remains,
+                               bool root_present,
+                               std::vector<uint64_t>& parents,
+                               std::vector<uint64_t>& lone_targets) const;
 
     /*
-     * 
+     * Append the swaps that turn the lone targets of a row into siblings to swaps.
      */
-    std::vector<ForestState::Swap> MakeSwaps(const std::vector<uint64_t>& targets,
-                                             bool deletion_remains,
-                                             bool root_present,
-                                             uint64_t rootPos) const;
+    void MakeSwaps(const std::vector<uint64_t>& targets,
+                   bool deletion_remains,
+                   bool root_present,
+                   uint64_t rootPos,
+                   std::vector<ForestState::Swap>& swaps) const;
 
     /*
      * 
@@ -151,13 +260,18 @@ private:
                                    uint64_t next_num_leaves) const;
 
     /*
-     * 
+     * Apply the swaps of every row to the collapses below it, in a single pass
+     * from the top row down, and insert the collapses at the end of their rows.
      */
-    void ConvertCollapses(std::vector<std::vector<ForestState::Swap>>& swaps,
-                          std::vector<ForestState::Swap>& collapses) const;
+    void ConvertCollapses(SwapBuffer& swaps) const;
 
+    /*
+     * Apply a swap on swap_row to the collapses below it.
+     * collapse_rows has a bit set for every row with a collapse.
+     */
     void SwapInRow(ForestState::Swap swap,
-                   std::vector<ForestState::Swap>& collapses,
+                   std::array<ForestState::Swap, 64>& collapses,
+                   uint64_t collapse_rows,
                    uint8_t swapRow) const;
 
     void SwapIfDescendant(ForestState::Swap swap,
@@ -166,6 +280,50 @@ private:
                           uint8_t collapse_row) const;
 };
 
+/**
+ * SwapBuffer holds the swaps of a remove transformation in a single flat buffer.
+ * The swaps of a row are stored consecutively, the rows from bottom to top, with
+ * the row boundaries kept as offsets. A collapse is the last swap of its row.
+ * Reusing a buffer across transformations avoids reallocating the swaps and the
+ * scratch space needed to compute them.
+ */
+class SwapBuffer
+{
+private:
+    std::vector<ForestState::Swap> m_swaps;
+    // The swaps of row r are [m_row_offsets[r], m_row_offsets[r + 1]).
+    std::vector<size_t> m_row_offsets;
+
+    // Scratch space for ForestState::Transform.
+    std::vector<uint64_t> m_targets, m_next_targets, m_lone_targets;
+    std::array<ForestState::Swap, 64> m_collapses;
+
+    friend class ForestState;
+
+public:
+    // Return the number of rows the transformation touches. (Higher rows have no swaps.)
+    uint8_t NumRows() const { return m_row_offsets.empty() ? 0 : m_row_offsets.size() - 1; }
+
+    const ForestState::Swap* RowBegin(uint8_t row) const { return m_swaps.data() + m_row_offsets[row]; }
+    const ForestState::Swap* RowEnd(uint8_t row) const { return m_swaps.data() + m_row_offsets[row + 1]; }
+
+    // Return the swaps of all rows.
+    const std::vector<ForestState::Swap>& Swaps() const { return m_swaps; }
+
+    // Return the heap memory held by the buffers.
+    size_t MemoryUsage() const
+    {
+        return m_swaps.capacity() * sizeof(ForestState::Swap) + m_row_offsets.capacity() * sizeof(size_t) +
+               (m_targets.capacity() + m_next_targets.capacity() + m_lone_targets.capacity()) * sizeof(uint64_t);
+    }
+
+    void Clear()
+    {
+        m_swaps.clear();
+        m_row_offsets.clear();
+    }
+};
+
 // TODO: remove these
 void print_vector(const std::vector<uint64_t>& vec);
 void print_swaps(const std::vector<ForestState::Swap>& vec);
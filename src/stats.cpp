@@ -0,0 +1,47 @@
+#include "counters.h"
+
+namespace utreexo {
+
+#ifdef UTREEXO_STATS
+AtomicStats g_stats;
+
+bool StatsEnabled() { return true; }
+
+Stats GetStats()
+{
+    Stats stats;
+    stats.m_hashes = g_stats.m_hashes.load(std::memory_order_relaxed);
+    stats.m_leaf_hashes = g_stats.m_leaf_hashes.load(std::memory_order_relaxed);
+    stats.m_nodes_allocated = g_stats.m_nodes_allocated.load(std::memory_order_relaxed);
+    stats.m_nodes_freed = g_stats.m_nodes_freed.load(std::memory_order_relaxed);
+    stats.m_posmap_lookups = g_stats.m_posmap_lookups.load(std::memory_order_relaxed);
+    stats.m_posmap_inserts = g_stats.m_posmap_inserts.load(std::memory_order_relaxed);
+    stats.m_posmap_erases = g_stats.m_posmap_erases.load(std::memory_order_relaxed);
+    stats.m_swaps = g_stats.m_swaps.load(std::memory_order_relaxed);
+    stats.m_proof_hashes_consumed = g_stats.m_proof_hashes_consumed.load(std::memory_order_relaxed);
+    stats.m_proof_hashes_cached = g_stats.m_proof_hashes_cached.load(std::memory_order_relaxed);
+    stats.m_bytes_committed = g_stats.m_bytes_committed.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ResetStats()
+{
+    g_stats.m_hashes = 0;
+    g_stats.m_leaf_hashes = 0;
+    g_stats.m_nodes_allocated = 0;
+    g_stats.m_nodes_freed = 0;
+    g_stats.m_posmap_lookups = 0;
+    g_stats.m_posmap_inserts = 0;
+    g_stats.m_posmap_erases = 0;
+    g_stats.m_swaps = 0;
+    g_stats.m_proof_hashes_consumed = 0;
+    g_stats.m_proof_hashes_cached = 0;
+    g_stats.m_bytes_committed = 0;
+}
+#else
+bool StatsEnabled() { return false; }
+Stats GetStats() { return Stats(); }
+void ResetStats() {}
+#endif
+
+}; // namespace utreexo
@@ -1,10 +1,22 @@
 #include "../../include/utreexo.h"
+#include <algorithm>
+#include <atomic>
 #include <boost/test/unit_test.hpp>
 #include <chrono>
+#include <csignal>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
 #include <random>
+#include <sstream>
+#include <thread>
+#include <tuple>
 #include <vector>
 
+#include <sys/resource.h>
+
+#include "crypto/sha512.h"
 #include "state.h"
 
 BOOST_AUTO_TEST_SUITE(accumulator_tests)
@@ -192,6 +204,65 @@ BOOST_AUTO_TEST_CASE(batchproof_serialization)
     BatchProof proof2;
     BOOST_CHECK(proof2.Unserialize(proof_bytes));
     BOOST_CHECK(proof1 == proof2);
+
+    // Verify the serialized proof without copying it.
+    std::vector<Hash> roots;
+    full.Roots(roots);
+    Pollard pruned(roots, 32);
+    BatchProofView view;
+    BOOST_CHECK(view.Unserialize(proof_bytes.data(), proof_bytes.size()));
+    BOOST_CHECK_EQUAL(view.NumTargets(), 2);
+    BOOST_CHECK_EQUAL(view.NumHashes(), proof1.GetHashes().size());
+    BOOST_CHECK(view.GetHashes()[0] == proof1.GetHashes()[0]);
+    BOOST_CHECK(pruned.Verify(view, {leaves[0].first, leaves[1].first}));
+    BOOST_CHECK(!pruned.Verify(view, {leaves[1].first, leaves[0].first}));
+
+    // Targets keep their full 64 bit range and their order.
+    BatchProof large({uint64_t(1) << 40, 3, std::numeric_limits<uint64_t>::max()}, {leaves[2].first});
+    large.Serialize(proof_bytes);
+    BOOST_CHECK(proof2.Unserialize(proof_bytes));
+    BOOST_CHECK(large == proof2);
+
+    // Truncated proofs, unknown versions and overlong varints are rejected.
+    proof_bytes.pop_back();
+    BOOST_CHECK(!proof2.Unserialize(proof_bytes));
+    BOOST_CHECK(!view.Unserialize(proof_bytes.data(), proof_bytes.size()));
+    BOOST_CHECK(!proof2.Unserialize({2, 0, 0}));
+    BOOST_CHECK(proof2.Unserialize({1, 0, 0}));
+    BOOST_CHECK(!proof2.Unserialize({1, 0x80, 0, 0}));
+}
+
+BOOST_AUTO_TEST_CASE(batchproof_positions)
+{
+    RamForest full(0);
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 15);
+    full.Modify(unused_undo, leaves, {});
+
+    BatchProof proof;
+    BOOST_CHECK(full.Prove(proof, {leaves[7].first, leaves[2].first, leaves[12].first}));
+
+    // The positions are computed for one number of leaves at a time.
+    for (uint64_t num_leaves : {15, 16, 15}) {
+        auto expected = ForestState(num_leaves).ProofPositions(proof.GetSortedTargets());
+        const BatchProofPositions positions(proof, num_leaves);
+        BOOST_CHECK(positions.GetProofPositions() == expected.first);
+        BOOST_CHECK(positions.GetComputedPositions() == expected.second);
+
+        proof.ComputePositions(num_leaves);
+        BOOST_CHECK(proof.HasPositions(num_leaves));
+        BOOST_CHECK(!proof.HasPositions(num_leaves + 1));
+        BOOST_CHECK(proof.GetProofPositions() == expected.first);
+        BOOST_CHECK(proof.GetComputedPositions() == expected.second);
+    }
+
+    // Unserializing a different proof drops the computed positions.
+    std::vector<uint8_t> proof_bytes;
+    BatchProof({0, 1}, {}).Serialize(proof_bytes);
+    BOOST_CHECK(proof.Unserialize(proof_bytes));
+    BOOST_CHECK(!proof.HasPositions(15));
+    BOOST_CHECK(BatchProofPositions(proof, 15).GetProofPositions() == ForestState(15).ProofPositions({0, 1}).first);
 }
 
 BOOST_AUTO_TEST_CASE(singular_leaf_prove)
@@ -273,6 +344,81 @@ BOOST_AUTO_TEST_CASE(simple_cached_proof)
     BOOST_CHECK(pruned.Verify(BatchProof(proof.GetSortedTargets(), {}), {leaves[0].first}));
 }
 
+BOOST_AUTO_TEST_CASE(trimmed_proof)
+{
+    Pollard pruned(0);
+    RamForest full(0);
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 16);
+
+    // Remember leaf 0 and 7 in the pollard.
+    leaves[0].second = true;
+    leaves[7].second = true;
+    full.Modify(unused_undo, leaves, {});
+    pruned.Modify(leaves, {});
+
+    std::vector<uint64_t> remembered;
+    pruned.RememberedLeaves(remembered);
+    BOOST_CHECK(remembered == std::vector<uint64_t>({0, 7}));
+
+    // The proof for leaf 4 consists of 5, 19, 24 and 29, but the pollard already
+    // caches 24 and 29 to prove leaf 0 and 7 and 19 on the path of leaf 7.
+    BatchProof proof, trimmed;
+    BOOST_CHECK(full.Prove(proof, {leaves[4].first}));
+    BOOST_CHECK(full.ProveTrimmed(trimmed, {leaves[4].first}, remembered));
+    BOOST_CHECK(proof.GetHashes().size() == 4);
+    BOOST_CHECK(trimmed.GetHashes().size() == 1);
+    BOOST_CHECK(trimmed.GetHashes()[0] == proof.GetHashes()[0]);
+
+    // The trimmed proof does not verify against a wrong description of the cache.
+    BOOST_CHECK(!pruned.VerifyTrimmed(trimmed, {leaves[4].first}, {0}));
+    BOOST_CHECK(!pruned.VerifyTrimmed(proof, {leaves[4].first}, remembered));
+
+    // A trimmed proof with an invalid hash fails.
+    Hash invalid_hash;
+    invalid_hash.fill(0xff);
+    BOOST_CHECK(!pruned.VerifyTrimmed(BatchProof(trimmed.GetTargets(), {invalid_hash}), {leaves[4].first}, remembered));
+
+    // Only leaves can be remembered.
+    BOOST_CHECK(!full.ProveTrimmed(trimmed, {leaves[4].first}, {0, 16}));
+    BOOST_CHECK(!pruned.VerifyTrimmed(trimmed, {leaves[4].first}, {0, 16}));
+
+    BOOST_CHECK(pruned.VerifyTrimmed(trimmed, {leaves[4].first}, remembered));
+}
+
+BOOST_AUTO_TEST_CASE(trimmed_proof_ancestor)
+{
+    Pollard pruned(0);
+    RamForest full(0);
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 4);
+    leaves[2].second = true;
+    full.Modify(unused_undo, leaves, {});
+    pruned.Modify(leaves, {});
+
+    // The proof for leaf 0 consists of 1 and 5. The pollard caches 5, the parent of
+    // the remembered leaf 2, so only 1 is left.
+    BOOST_CHECK(ForestState(4).CachedProofPositions({2}) == std::vector<uint64_t>({2, 3, 4, 5}));
+    BatchProof proof, trimmed;
+    BOOST_CHECK(full.Prove(proof, {leaves[0].first}));
+    BOOST_CHECK(full.ProveTrimmed(trimmed, {leaves[0].first}, {2}));
+    BOOST_CHECK(proof.GetHashes().size() == 2);
+    BOOST_CHECK(trimmed.GetHashes().size() == 1);
+    BOOST_CHECK(trimmed.GetHashes()[0] == proof.GetHashes()[0]);
+
+    BOOST_CHECK(pruned.VerifyTrimmed(trimmed, {leaves[0].first}, {2}));
+    const std::vector<uint64_t> targets = {0};
+    BOOST_CHECK(full.Modify(unused_undo, {}, targets));
+    BOOST_CHECK(pruned.Modify({}, targets));
+
+    std::vector<Hash> full_roots, pruned_roots;
+    full.Roots(full_roots);
+    pruned.Roots(pruned_roots);
+    BOOST_CHECK(full_roots == pruned_roots);
+}
+
 BOOST_AUTO_TEST_CASE(simple_batch_proof)
 {
     Pollard pruned(0);
@@ -505,6 +651,104 @@ BOOST_AUTO_TEST_CASE(pollard_restore)
     BOOST_CHECK(restored.Verify(proof, leaf_hashes));
 }
 
+BOOST_AUTO_TEST_CASE(pollard_serialization)
+{
+    RamForest full(0);
+    Pollard pruned(0);
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 15);
+    leaves[3].second = true;
+    leaves[14].second = true;
+
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+    BOOST_CHECK(pruned.Modify(leaves, {}));
+
+    BatchProof proof;
+    std::vector<Hash> leaf_hashes = {leaves[8].first, leaves[9].first};
+    BOOST_CHECK(full.Prove(proof, leaf_hashes));
+    BOOST_CHECK(pruned.Verify(proof, leaf_hashes));
+
+    std::stringstream snapshot;
+    BOOST_CHECK(pruned.Serialize(snapshot));
+
+    Pollard restored(0);
+    BOOST_CHECK(restored.Unserialize(snapshot));
+
+    std::vector<Hash> pruned_roots, restored_roots;
+    pruned.Roots(pruned_roots);
+    restored.Roots(restored_roots);
+    BOOST_CHECK(pruned_roots == restored_roots);
+    BOOST_CHECK(restored.NumLeaves() == pruned.NumLeaves());
+    BOOST_CHECK(restored.NumCachedLeaves() == pruned.NumCachedLeaves());
+    BOOST_CHECK(restored.CountNodes() == pruned.CountNodes());
+    BOOST_CHECK(restored.ComparePositionMap(pruned));
+
+    // A snapshot of the restored pollard is identical to the original snapshot.
+    std::stringstream copy;
+    BOOST_CHECK(restored.Serialize(copy));
+    BOOST_CHECK(copy.str() == snapshot.str());
+
+    // The cached branches survived, so the restored pollard can prove and delete the cached leaves.
+    BatchProof cached_proof;
+    BOOST_CHECK(restored.Prove(cached_proof, {leaves[3].first}));
+    BOOST_CHECK(restored.Verify(BatchProof(proof.GetSortedTargets(), {}), leaf_hashes));
+    BOOST_CHECK(full.Modify(unused_undo, {}, proof.GetSortedTargets()));
+    BOOST_CHECK(restored.Modify({}, proof.GetSortedTargets()));
+    full.Roots(pruned_roots);
+    restored.Roots(restored_roots);
+    BOOST_CHECK(pruned_roots == restored_roots);
+
+    // Truncated snapshots are rejected.
+    std::string bytes = snapshot.str();
+    std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+    BOOST_CHECK(!restored.Unserialize(truncated));
+}
+
+BOOST_AUTO_TEST_CASE(pollard_malformed_snapshot)
+{
+    Pollard pruned(0);
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 7);
+    leaves[2].second = true;
+    leaves[6].second = true;
+    BOOST_CHECK(pruned.Modify(leaves, {}));
+
+    std::stringstream snapshot;
+    BOOST_CHECK(pruned.Serialize(snapshot));
+    const std::string bytes = snapshot.str();
+
+    // Every truncation of a valid snapshot is rejected.
+    Pollard restored(0);
+    for (size_t size = 0; size < bytes.size(); ++size) {
+        std::stringstream truncated(bytes.substr(0, size));
+        BOOST_CHECK(!restored.Unserialize(truncated));
+    }
+
+    auto be64 = [](uint64_t value) {
+        std::string res(8, '\0');
+        for (int i = 7; i >= 0; --i, value >>= 8) res[i] = static_cast<char>(value & 0xff);
+        return res;
+    };
+    auto node = [](uint8_t flags) { return std::string(1, static_cast<char>(flags)) + std::string(32, '\0'); };
+
+    // A single remembered leaf is a valid snapshot.
+    std::stringstream single(be64(1) + node(4) + be64(0));
+    BOOST_CHECK(restored.Unserialize(single));
+
+    // The remember marker is only valid on the bottom row.
+    std::stringstream remember_above_leaves(be64(2) + node(4) + be64(0));
+    BOOST_CHECK(!restored.Unserialize(remember_above_leaves));
+
+    // Unknown flags are rejected.
+    std::stringstream unknown_flags(be64(1) + node(8) + be64(0));
+    BOOST_CHECK(!restored.Unserialize(unknown_flags));
+
+    // A huge number of position map entries fails on the missing entries instead of allocating them.
+    std::stringstream huge_posmap(be64(uint64_t{1} << 62) + node(0) + be64(uint64_t{1} << 61));
+    BOOST_CHECK(!restored.Unserialize(huge_posmap));
+}
+
 BOOST_AUTO_TEST_CASE(pollard_remember)
 {
     RamForest full(0);
@@ -542,6 +786,42 @@ BOOST_AUTO_TEST_CASE(pollard_remember)
     BOOST_CHECK(full_roots == pruned_roots);
 }
 
+BOOST_AUTO_TEST_CASE(pollard_remember_rehash)
+{
+    RamForest full(0);
+    Pollard pruned(0);
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 4);
+    leaves[0].second = true;
+
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+    BOOST_CHECK(pruned.Modify(leaves, {}));
+
+    // Deleting 1 and 2 moves 3 next to 0. Rehashing their parent must keep
+    // the remembered leaf 0 and not only its sibling.
+    BatchProof proof;
+    BOOST_CHECK(full.Prove(proof, {leaves[1].first, leaves[2].first}));
+    BOOST_CHECK(pruned.Verify(proof, {leaves[1].first, leaves[2].first}));
+    PollardUndoBatch undo;
+    BOOST_CHECK(pruned.Modify(undo, {}, proof.GetSortedTargets()));
+    BOOST_CHECK(full.Modify(unused_undo, {}, proof.GetSortedTargets()));
+
+    std::vector<uint64_t> remembered;
+    pruned.RememberedLeaves(remembered);
+    BOOST_CHECK(remembered == std::vector<uint64_t>({0}));
+
+    // Deleting the remembered leaf and its sibling without a proof needs their hashes.
+    const std::vector<uint64_t> targets = {0, 1};
+    BOOST_CHECK(pruned.Modify(undo, {}, targets));
+    BOOST_CHECK(full.Modify(unused_undo, {}, targets));
+
+    std::vector<Hash> full_roots, pruned_roots;
+    full.Roots(full_roots);
+    pruned.Roots(pruned_roots);
+    BOOST_CHECK(full_roots == pruned_roots);
+}
+
 BOOST_AUTO_TEST_CASE(simple_pollard_prove)
 {
     RamForest full(0);
@@ -620,6 +900,957 @@ BOOST_AUTO_TEST_CASE(ramforest_undo)
     BOOST_CHECK(full == full_prev);
 }
 
+BOOST_AUTO_TEST_CASE(ramforest_undo_journal)
+{
+    std::remove("./test_undo_journal");
+    RamForest full(0);
+    BOOST_CHECK(full.OpenUndoJournal("./test_undo_journal", 20));
+
+    std::default_random_engine generator;
+    std::uniform_int_distribution<int> add_distribution(1, 32);
+    int unique_hash = 0;
+
+    // The roots after every block.
+    std::vector<std::vector<Hash>> block_roots;
+    for (int i = 0; i < 50; ++i) {
+        std::vector<Leaf> adds;
+        CreateTestLeaves(adds, add_distribution(generator), unique_hash);
+        unique_hash += adds.size();
+
+        // Delete every third leaf.
+        std::vector<Hash> leaf_hashes;
+        for (uint64_t pos = i % 3; pos < full.NumLeaves(); pos += 3) {
+            leaf_hashes.push_back(full.GetLeaf(pos));
+        }
+
+        BatchProof proof;
+        UndoBatch undo;
+        BOOST_CHECK(full.Prove(proof, leaf_hashes));
+        BOOST_CHECK(full.Modify(undo, adds, proof.GetSortedTargets()));
+
+        block_roots.emplace_back();
+        full.Roots(block_roots.back());
+    }
+
+    // Only the latest blocks are kept.
+    BOOST_CHECK_EQUAL(full.NumUndoBlocks(), 20);
+    BOOST_CHECK(!full.Rewind(21));
+
+    std::vector<Hash> roots;
+    BOOST_CHECK(full.Rewind(1));
+    full.Roots(roots);
+    BOOST_CHECK(roots == block_roots[48]);
+
+    // Rewind several blocks at once.
+    BOOST_CHECK(full.Rewind(7));
+    full.Roots(roots);
+    BOOST_CHECK(roots == block_roots[41]);
+    BOOST_CHECK_EQUAL(full.NumUndoBlocks(), 12);
+
+    // The journal is reused when it is reopened at the same state.
+    // (Records that were dropped but not compacted away yet are indexed again, up to max_blocks.)
+    BOOST_CHECK(full.OpenUndoJournal("./test_undo_journal", 20));
+    BOOST_CHECK(full.NumUndoBlocks() >= 12);
+    BOOST_CHECK(full.NumUndoBlocks() <= 20);
+    BOOST_CHECK(full.Rewind(12));
+    full.Roots(roots);
+    BOOST_CHECK(roots == block_roots[29]);
+
+    // The rewound forest can be modified again.
+    size_t num_undo_blocks = full.NumUndoBlocks();
+    std::vector<Leaf> adds;
+    CreateTestLeaves(adds, 4, unique_hash);
+    BOOST_CHECK(full.Modify(unused_undo, adds, {}));
+    BOOST_CHECK_EQUAL(full.NumUndoBlocks(), num_undo_blocks + 1);
+    BOOST_CHECK(full.Rewind(1));
+    full.Roots(roots);
+    BOOST_CHECK(roots == block_roots[29]);
+
+    // Reopening with fewer blocks only indexes the latest records.
+    BOOST_CHECK_EQUAL(full.NumUndoBlocks(), num_undo_blocks);
+    BOOST_CHECK(full.OpenUndoJournal("./test_undo_journal", 2));
+    BOOST_CHECK_EQUAL(full.NumUndoBlocks(), std::min<size_t>(num_undo_blocks, 2));
+
+    std::remove("./test_undo_journal");
+}
+
+BOOST_AUTO_TEST_CASE(ramforest_undo_journal_failures)
+{
+    std::remove("./test_undo_journal");
+    RamForest full(0);
+    BOOST_CHECK(full.OpenUndoJournal("./test_undo_journal", 10));
+
+    // The first block adds 16 leaves that are never spent, every later block
+    // spends two of the leaves the block before it added.
+    std::vector<Leaf> adds;
+    CreateTestLeaves(adds, 16);
+    const Hash unspent = adds[15].first;
+    BOOST_CHECK(full.Modify(unused_undo, adds, {}));
+
+    std::vector<std::vector<Hash>> block_roots(1);
+    full.Roots(block_roots.back());
+    for (int i = 1; i <= 4; ++i) {
+        std::vector<Hash> spends{adds[0].first, adds[2].first};
+        adds.clear();
+        CreateTestLeaves(adds, 4, 100 * i);
+
+        BatchProof proof;
+        BOOST_CHECK(full.Prove(proof, spends));
+        BOOST_CHECK(full.Modify(unused_undo, adds, proof.GetSortedTargets()));
+        block_roots.emplace_back();
+        full.Roots(block_roots.back());
+    }
+
+    // Replace the last deleted hash of the second block with a leaf that is still in the forest.
+    // Every record ends with the deleted hashes of its block (see UndoJournal and UndoBatch::Serialize).
+    {
+        std::fstream journal("./test_undo_journal", std::fstream::in | std::fstream::out | std::fstream::binary);
+        uint64_t offset = 0;
+        for (int record = 0; record < 3; ++record) {
+            uint8_t header[12];
+            journal.seekg(offset);
+            journal.read(reinterpret_cast<char*>(header), sizeof(header));
+            const uint32_t length = uint32_t(header[8]) << 24 | uint32_t(header[9]) << 16 | uint32_t(header[10]) << 8 | header[11];
+            offset += sizeof(header) + length;
+        }
+        journal.seekp(offset - sizeof(Hash));
+        journal.write(reinterpret_cast<const char*>(unspent.data()), unspent.size());
+        BOOST_CHECK(journal.good());
+    }
+
+    // Rewinding past the corrupted block fails and leaves the forest and the journal as they were.
+    std::vector<Hash> roots;
+    BOOST_CHECK(!full.Rewind(4));
+    full.Roots(roots);
+    BOOST_CHECK(roots == block_roots[4]);
+    BOOST_CHECK_EQUAL(full.NumUndoBlocks(), 5);
+    BOOST_CHECK(full.Rewind(2));
+    full.Roots(roots);
+    BOOST_CHECK(roots == block_roots[2]);
+
+    // A modification whose undo data can not be written to the journal is not applied.
+    // Limit the size of the files the process writes to the current journal size, so that
+    // appending the record fails (with EFBIG instead of SIGXFSZ, which is ignored).
+    struct rlimit prev_limit;
+    BOOST_REQUIRE(getrlimit(RLIMIT_FSIZE, &prev_limit) == 0);
+    void (*prev_handler)(int) = std::signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit = prev_limit;
+    limit.rlim_cur = std::filesystem::file_size("./test_undo_journal");
+    BOOST_REQUIRE(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+    adds.clear();
+    CreateTestLeaves(adds, 3, 1000);
+    BatchProof proof;
+    BOOST_CHECK(full.Prove(proof, {unspent}));
+    const bool modified = full.Modify(unused_undo, adds, proof.GetSortedTargets());
+
+    setrlimit(RLIMIT_FSIZE, &prev_limit);
+    std::signal(SIGXFSZ, prev_handler);
+
+    BOOST_CHECK(!modified);
+    full.Roots(roots);
+    BOOST_CHECK(roots == block_roots[2]);
+    BOOST_CHECK_EQUAL(full.NumUndoBlocks(), 3);
+    BOOST_CHECK(full.Prove(proof, {unspent}));
+
+    // The journal is still usable after the failed append.
+    BOOST_CHECK(full.Modify(unused_undo, adds, proof.GetSortedTargets()));
+    BOOST_CHECK_EQUAL(full.NumUndoBlocks(), 4);
+    BOOST_CHECK(full.Rewind(1));
+    full.Roots(roots);
+    BOOST_CHECK(roots == block_roots[2]);
+
+    // The journal is still usable after a failed read. Cut the last record short, so reading it fails.
+    std::filesystem::resize_file("./test_undo_journal", std::filesystem::file_size("./test_undo_journal") - 1);
+    BOOST_CHECK(!full.Rewind(1));
+    full.Roots(roots);
+    BOOST_CHECK(roots == block_roots[2]);
+
+    adds.clear();
+    CreateTestLeaves(adds, 2, 2000);
+    BOOST_CHECK(full.Modify(unused_undo, adds, {}));
+    BOOST_CHECK_EQUAL(full.NumUndoBlocks(), 4);
+    BOOST_CHECK(full.Rewind(1));
+    full.Roots(roots);
+    BOOST_CHECK(roots == block_roots[2]);
+
+    std::remove("./test_undo_journal");
+}
+
+/** Return the serialized proof a pollard creates for some of its remembered leaves. */
+static std::vector<uint8_t> PollardProof(const Pollard& pruned, const std::vector<Hash>& hashes)
+{
+    BatchProof proof;
+    BOOST_CHECK(pruned.Prove(proof, hashes));
+    std::vector<uint8_t> bytes;
+    proof.Serialize(bytes);
+    return bytes;
+}
+
+BOOST_AUTO_TEST_CASE(pollard_undo)
+{
+    RamForest full(0);
+    Pollard pruned(0);
+    int unique_hash = 0;
+
+    std::default_random_engine generator;
+    std::uniform_int_distribution<int> add_distribution(1, 32);
+    std::bernoulli_distribution remember_distribution(0.2);
+
+    // Keep the undo data of every block with the roots, the remembered leaves and the proof
+    // for them of the pollard that it rolls back to.
+    struct PollardState {
+        PollardUndoBatch m_undo;
+        std::vector<Hash> m_roots;
+        std::vector<uint64_t> m_remembered;
+        std::vector<Hash> m_remembered_hashes;
+        std::vector<uint8_t> m_proof;
+    };
+    std::vector<PollardState> undos;
+    for (int i = 0; i < 50; ++i) {
+        std::vector<Leaf> adds;
+        CreateTestLeaves(adds, add_distribution(generator), unique_hash);
+        unique_hash += adds.size();
+        for (Leaf& leaf : adds) leaf.second = remember_distribution(generator);
+
+        // Delete every third leaf.
+        std::vector<Hash> leaf_hashes;
+        for (uint64_t pos = i % 3; pos < full.NumLeaves(); pos += 3) {
+            leaf_hashes.push_back(full.GetLeaf(pos));
+        }
+
+        BatchProof proof;
+        BOOST_CHECK(full.Prove(proof, leaf_hashes));
+        BOOST_CHECK(pruned.Verify(proof, leaf_hashes));
+
+        PollardState state;
+        pruned.Roots(state.m_roots);
+        pruned.RememberedLeaves(state.m_remembered);
+        for (const uint64_t pos : state.m_remembered) state.m_remembered_hashes.push_back(full.GetLeaf(pos));
+        state.m_proof = PollardProof(pruned, state.m_remembered_hashes);
+
+        PollardUndoBatch undo;
+        BOOST_CHECK(pruned.Modify(undo, adds, proof.GetSortedTargets()));
+        BOOST_CHECK(full.Modify(unused_undo, adds, proof.GetSortedTargets()));
+        BOOST_CHECK(undo.GetUndoBatch().GetDeletedPositions() == proof.GetSortedTargets());
+
+        // The undo data survives a round trip through its wire format.
+        std::vector<uint8_t> bytes;
+        undo.Serialize(bytes);
+        PollardUndoBatch parsed;
+        BOOST_CHECK(parsed.Unserialize(bytes));
+        bytes.pop_back();
+        BOOST_CHECK(!PollardUndoBatch().Unserialize(bytes));
+
+        state.m_undo = parsed;
+        undos.push_back(state);
+    }
+
+    std::vector<Hash> full_roots, pruned_roots;
+    full.Roots(full_roots);
+    pruned.Roots(pruned_roots);
+    BOOST_CHECK(full_roots == pruned_roots);
+
+    // Undo data can not be applied to the wrong state.
+    BOOST_CHECK(!pruned.Undo(undos.front().m_undo));
+    pruned.Roots(pruned_roots);
+    BOOST_CHECK(full_roots == pruned_roots);
+
+    // Rolling back restores the roots, the remembered leaves and their cached branches.
+    for (auto it = undos.crbegin(); it != undos.crend(); ++it) {
+        BOOST_CHECK(pruned.Undo(it->m_undo));
+
+        pruned.Roots(pruned_roots);
+        BOOST_CHECK(pruned_roots == it->m_roots);
+
+        // The leaves that the later blocks verified stay remembered.
+        std::vector<uint64_t> remembered;
+        pruned.RememberedLeaves(remembered);
+        BOOST_CHECK(std::includes(remembered.begin(), remembered.end(), it->m_remembered.begin(), it->m_remembered.end()));
+        BOOST_CHECK(PollardProof(pruned, it->m_remembered_hashes) == it->m_proof);
+    }
+
+    // A deleted leaf that was only cached as the sibling of a remembered leaf is not
+    // remembered after the undo.
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 8, unique_hash);
+    leaves[4].second = true;
+    Pollard sibling_cached(0);
+    BOOST_CHECK(sibling_cached.Modify(leaves, {}));
+
+    PollardUndoBatch undo;
+    std::vector<Hash> roots;
+    sibling_cached.Roots(roots);
+    BOOST_CHECK(sibling_cached.Modify(undo, {}, {5}));
+    BOOST_CHECK(sibling_cached.Undo(undo));
+    sibling_cached.Roots(pruned_roots);
+    BOOST_CHECK(pruned_roots == roots);
+
+    std::vector<uint64_t> remembered;
+    sibling_cached.RememberedLeaves(remembered);
+    BOOST_CHECK(remembered == std::vector<uint64_t>({4}));
+    BatchProof proof;
+    BOOST_CHECK(sibling_cached.Prove(proof, {leaves[4].first}));
+    BOOST_CHECK(!sibling_cached.Prove(proof, {leaves[5].first}));
+}
+
+BOOST_AUTO_TEST_CASE(pollard_undo_reapply)
+{
+    RamForest full(0);
+    Pollard pruned(0);
+    int unique_hash = 0;
+
+    std::default_random_engine generator;
+    std::uniform_int_distribution<int> add_distribution(1, 32);
+    std::bernoulli_distribution remember_distribution(0.2);
+
+    for (int i = 0; i < 50; ++i) {
+        std::vector<Leaf> adds;
+        CreateTestLeaves(adds, add_distribution(generator), unique_hash);
+        unique_hash += adds.size();
+        for (Leaf& leaf : adds) leaf.second = remember_distribution(generator);
+
+        // Delete every third leaf.
+        std::vector<Hash> leaf_hashes;
+        for (uint64_t pos = i % 3; pos < full.NumLeaves(); pos += 3) {
+            leaf_hashes.push_back(full.GetLeaf(pos));
+        }
+
+        BatchProof proof;
+        BOOST_CHECK(full.Prove(proof, leaf_hashes));
+        BOOST_CHECK(pruned.Verify(proof, leaf_hashes));
+        const uint64_t verified_nodes = pruned.CountNodes();
+
+        PollardUndoBatch undo;
+        BOOST_CHECK(pruned.Modify(undo, adds, proof.GetSortedTargets()));
+        const uint64_t modified_nodes = pruned.CountNodes();
+
+        // The undo leaves a pruned cache, verifying the proof again restores its shape.
+        BOOST_CHECK(pruned.Undo(undo));
+        BOOST_CHECK(pruned.CountNodes() <= verified_nodes);
+        BOOST_CHECK(pruned.Verify(proof, leaf_hashes));
+        BOOST_CHECK(pruned.CountNodes() == verified_nodes);
+
+        // Re-applying the block gives the same pollard as the first time.
+        BOOST_CHECK(pruned.Modify(undo, adds, proof.GetSortedTargets()));
+        BOOST_CHECK(full.Modify(unused_undo, adds, proof.GetSortedTargets()));
+        BOOST_CHECK(pruned.CountNodes() == modified_nodes);
+
+        std::vector<Hash> full_roots, pruned_roots;
+        full.Roots(full_roots);
+        pruned.Roots(pruned_roots);
+        BOOST_CHECK(full_roots == pruned_roots);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ramforest_snapshot)
+{
+    RamForest full(0);
+    int unique_hash = 0;
+
+    // Enough leaves to span several pages.
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 3000, unique_hash);
+    unique_hash += leaves.size();
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+
+    BOOST_CHECK(!full.GetSnapshot());
+    full.EnableSnapshots();
+
+    std::default_random_engine generator;
+    std::vector<std::shared_ptr<const ForestSnapshot>> snapshots;
+    std::vector<std::vector<Hash>> snapshot_roots;
+    for (int i = 0; i < 20; ++i) {
+        std::shared_ptr<const ForestSnapshot> snapshot = full.GetSnapshot();
+        BOOST_CHECK(snapshot->NumLeaves() == full.NumLeaves());
+
+        std::vector<Hash> roots, full_roots;
+        snapshot->Roots(roots);
+        full.Roots(full_roots);
+        BOOST_CHECK(roots == full_roots);
+        snapshots.push_back(snapshot);
+        snapshot_roots.push_back(roots);
+
+        // The snapshot produces the same proofs as the forest.
+        std::vector<Hash> leaf_hashes;
+        std::uniform_int_distribution<uint64_t> leaf_distribution(0, full.NumLeaves() - 1);
+        for (int j = 0; j < 50; ++j) {
+            Hash hash = full.GetLeaf(leaf_distribution(generator));
+            if (std::find(leaf_hashes.begin(), leaf_hashes.end(), hash) == leaf_hashes.end()) leaf_hashes.push_back(hash);
+        }
+
+        BatchProof proof, snapshot_proof;
+        BOOST_CHECK(full.Prove(proof, leaf_hashes));
+        BOOST_CHECK(snapshot->Prove(snapshot_proof, leaf_hashes));
+        BOOST_CHECK(proof == snapshot_proof);
+
+        std::vector<Leaf> adds;
+        CreateTestLeaves(adds, 40, unique_hash);
+        unique_hash += adds.size();
+
+        UndoBatch undo;
+        BOOST_CHECK(full.Modify(undo, adds, proof.GetSortedTargets()));
+
+        // Every other block is rolled back and applied again.
+        if (i % 2 == 1) {
+            BOOST_CHECK(full.Undo(undo));
+            BOOST_CHECK(full.Modify(unused_undo, adds, proof.GetSortedTargets()));
+        }
+
+        // The deleted leaves can not be proven with the latest snapshot.
+        BatchProof deleted_proof;
+        BOOST_CHECK(!full.GetSnapshot()->Prove(deleted_proof, {leaf_hashes[0]}));
+    }
+
+    // Old snapshots stay consistent: their proofs verify against their own roots.
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+        std::vector<Hash> leaf_hashes;
+        for (uint64_t pos = i; pos < snapshots[i]->NumLeaves(); pos += 97) {
+            leaf_hashes.push_back(snapshots[i]->Read(pos).value());
+        }
+
+        BatchProof proof;
+        BOOST_CHECK(snapshots[i]->Prove(proof, leaf_hashes));
+
+        Pollard pollard(snapshot_roots[i], snapshots[i]->NumLeaves());
+        std::vector<Hash> sorted_hashes;
+        for (uint64_t pos : proof.GetSortedTargets()) sorted_hashes.push_back(snapshots[i]->Read(pos).value());
+        BOOST_CHECK(pollard.Verify(proof, sorted_hashes));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ramforest_snapshot_concurrent)
+{
+    RamForest full(0);
+    int unique_hash = 0;
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 2048, unique_hash);
+    unique_hash += leaves.size();
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+    full.EnableSnapshots();
+
+    // Readers prove against the latest snapshot while blocks are connected.
+    std::atomic<bool> done{false};
+    std::atomic<int> failures{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&full, &done, &failures, t]() {
+            uint64_t pos = t;
+            while (!done) {
+                std::shared_ptr<const ForestSnapshot> snapshot = full.GetSnapshot();
+                pos = (pos * 31 + 7) % snapshot->NumLeaves();
+                Hash hash = snapshot->Read(pos).value();
+
+                BatchProof proof;
+                std::vector<Hash> roots;
+                snapshot->Roots(roots);
+                Pollard pollard(roots, snapshot->NumLeaves());
+                if (!snapshot->Prove(proof, {hash}) || !pollard.Verify(proof, {hash})) ++failures;
+            }
+        });
+    }
+
+    for (int i = 0; i < 200; ++i) {
+        std::vector<Leaf> adds;
+        CreateTestLeaves(adds, 16, unique_hash);
+        unique_hash += adds.size();
+
+        std::vector<uint64_t> targets;
+        for (uint64_t pos = i % 5; pos < full.NumLeaves() && targets.size() < 12; pos += 101) {
+            targets.push_back(pos);
+        }
+        BOOST_CHECK(full.Modify(unused_undo, adds, targets));
+    }
+
+    done = true;
+    for (std::thread& reader : readers) reader.join();
+    BOOST_CHECK(failures == 0);
+}
+
+BOOST_AUTO_TEST_CASE(ramforest_read_many)
+{
+    RamForest full(0);
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 45);
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+    BOOST_CHECK(full.Modify(unused_undo, {}, {3, 17, 30}));
+
+    // Every position that Read finds, on all rows, in an order that switches rows.
+    std::vector<uint64_t> positions;
+    std::vector<Hash> expected;
+    for (uint64_t pos = 0; pos < 256; ++pos) {
+        std::vector<Hash> hash;
+        std::optional<const Hash> read = full.Read(pos);
+        BOOST_CHECK_EQUAL(full.ReadMany({pos}, hash), read.has_value());
+        if (!read) continue;
+        BOOST_CHECK(hash[0] == *read);
+        positions.push_back(pos);
+        expected.push_back(*read);
+    }
+    BOOST_CHECK(positions.size() > leaves.size());
+    for (size_t i = 0; i + 1 < positions.size(); i += 2) {
+        std::swap(positions[i], positions[positions.size() - 1 - i]);
+        std::swap(expected[i], expected[expected.size() - 1 - i]);
+    }
+
+    std::vector<Hash> hashes;
+    BOOST_CHECK(full.ReadMany(positions, hashes));
+    BOOST_CHECK(hashes == expected);
+
+    // A single position outside of the forest fails the whole read.
+    for (const uint64_t out_of_range : {uint64_t{255}, uint64_t{1} << 40, ~uint64_t{0}}) {
+        BOOST_CHECK(!full.Read(out_of_range));
+        const size_t middle = positions.size() / 2;
+        positions.insert(positions.begin() + middle, out_of_range);
+        BOOST_CHECK(!full.ReadMany(positions, hashes));
+        positions.erase(positions.begin() + middle);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(prove_many)
+{
+    RamForest full(0);
+    Pollard pruned(0);
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 500);
+    for (int i = 0; i < 500; i += 7) leaves[i].second = true;
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+    BOOST_CHECK(pruned.Modify(leaves, {}));
+    full.EnableSnapshots();
+
+    // One large request, many small overlapping ones and an empty one.
+    std::vector<std::vector<Hash>> requests(1);
+    for (int i = 0; i < 500; i += 3) requests[0].push_back(leaves[i].first);
+    for (int i = 0; i < 100; ++i) {
+        requests.push_back({leaves[(i * 13) % 500].first, leaves[(i * 29 + 1) % 500].first});
+    }
+    requests.emplace_back();
+
+    for (int num_threads : {1, 4}) {
+        std::vector<BatchProof> proofs, snapshot_proofs;
+        BOOST_CHECK(full.ProveMany(proofs, requests, num_threads));
+        BOOST_CHECK(full.GetSnapshot()->ProveMany(snapshot_proofs, requests, num_threads));
+        BOOST_CHECK_EQUAL(proofs.size(), requests.size());
+
+        for (size_t i = 0; i < requests.size(); ++i) {
+            BatchProof proof;
+            BOOST_CHECK(full.Prove(proof, requests[i]));
+            BOOST_CHECK(proofs[i] == proof);
+            BOOST_CHECK(snapshot_proofs[i] == proof);
+        }
+    }
+
+    // A pollard can prove its remembered leaves in bulk.
+    std::vector<std::vector<Hash>> remembered = {{leaves[0].first, leaves[7].first}, {leaves[497].first}};
+    std::vector<BatchProof> proofs;
+    BOOST_CHECK(pruned.ProveMany(proofs, remembered, 2));
+    for (size_t i = 0; i < remembered.size(); ++i) {
+        BatchProof proof;
+        BOOST_CHECK(full.Prove(proof, remembered[i]));
+        BOOST_CHECK(proofs[i] == proof);
+    }
+
+    // Unknown leaves and duplicate targets fail the whole batch.
+    Hash unknown;
+    SetHash(unknown, 1000);
+    BOOST_CHECK(!full.ProveMany(proofs, {{leaves[0].first}, {unknown}}));
+    BOOST_CHECK(!full.ProveMany(proofs, {{leaves[0].first, leaves[0].first}}));
+    BOOST_CHECK(!pruned.ProveMany(proofs, {{leaves[1].first}}));
+}
+
+BOOST_AUTO_TEST_CASE(batch_verifier)
+{
+    RamForest full(0);
+
+    // 501 leaves make trees of 256, 128, 64, 32, 16, 4 and 1 leaves.
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 501);
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+
+    std::vector<Hash> roots;
+    full.Roots(roots);
+    BatchVerifier verifier(roots, full.NumLeaves());
+
+    // Unsorted targets in every tree, including the single leaf tree.
+    std::vector<Hash> target_hashes;
+    for (int i = 500; i >= 0; i -= 11) target_hashes.push_back(leaves[i].first);
+    target_hashes.push_back(leaves[498].first);
+
+    BatchProof proof;
+    BOOST_CHECK(full.Prove(proof, target_hashes));
+
+    // The hashes are verified in the order of the sorted targets.
+    target_hashes.clear();
+    for (const uint64_t pos : proof.GetSortedTargets()) target_hashes.push_back(full.GetLeaf(pos));
+    BOOST_CHECK(full.Verify(proof, target_hashes));
+    BOOST_CHECK(verifier.Verify(proof, target_hashes));
+    BOOST_CHECK(verifier.Verify(proof, target_hashes, 4));
+    BOOST_CHECK(verifier.Verify(BatchProof(), {}));
+
+    // Hashes out of order, invalid or missing proof hashes and other roots fail.
+    std::vector<Hash> swapped(target_hashes);
+    std::swap(swapped[0], swapped[1]);
+    BOOST_CHECK(!full.Verify(proof, swapped));
+
+    for (int num_threads : {1, 4}) {
+        BOOST_CHECK(!verifier.Verify(proof, swapped, num_threads));
+
+        std::vector<Hash> proof_hashes(proof.GetHashes());
+        proof_hashes.back()[0] ^= 1;
+        BOOST_CHECK(!verifier.Verify(BatchProof(proof.GetTargets(), proof_hashes), target_hashes, num_threads));
+        proof_hashes.pop_back();
+        BOOST_CHECK(!verifier.Verify(BatchProof(proof.GetTargets(), proof_hashes), target_hashes, num_threads));
+
+        std::vector<Hash> other_roots(roots);
+        other_roots[2][0] ^= 1;
+        BOOST_CHECK(!BatchVerifier(other_roots, full.NumLeaves()).Verify(proof, target_hashes, num_threads));
+    }
+
+    // Proofs are verified against the roots after a removal.
+    BOOST_CHECK(full.Modify(unused_undo, {}, {0, 1, 2, 100, 300}));
+    full.Roots(roots);
+    target_hashes = {leaves[400].first, leaves[3].first, leaves[250].first};
+    BOOST_CHECK(full.Prove(proof, target_hashes));
+    target_hashes.clear();
+    for (const uint64_t pos : proof.GetSortedTargets()) target_hashes.push_back(full.GetLeaf(pos));
+    BOOST_CHECK(BatchVerifier(roots, full.NumLeaves()).Verify(proof, target_hashes, 2));
+    BOOST_CHECK(!verifier.Verify(proof, target_hashes, 2));
+}
+
+BOOST_AUTO_TEST_CASE(verify_against_roots)
+{
+    RamForest full(0);
+    Pollard pruned(0);
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 15);
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+    BOOST_CHECK(pruned.Modify(leaves, {}));
+
+    std::vector<Hash> roots;
+    full.Roots(roots);
+
+    BatchProof proof;
+    std::vector<Hash> target_hashes{leaves[0].first, leaves[7].first, leaves[8].first, leaves[14].first};
+    BOOST_CHECK(full.Prove(proof, target_hashes));
+    BOOST_CHECK(VerifyAgainstRoots(roots, 15, proof, target_hashes) == VerifyResult::OK);
+    BOOST_CHECK(pruned.Verify(proof, target_hashes));
+
+    // Unsorted targets are matched with the hashes in the order of the sorted targets.
+    std::vector<Hash> unsorted{leaves[14].first, leaves[3].first, leaves[9].first};
+    BOOST_CHECK(full.Prove(proof, unsorted));
+    BOOST_CHECK(VerifyAgainstRoots(roots, 15, proof, unsorted) == VerifyResult::ROOT_MISMATCH);
+    BOOST_CHECK(VerifyAgainstRoots(roots, 15, proof, {leaves[3].first, leaves[9].first, leaves[14].first}) ==
+                VerifyResult::OK);
+
+    BOOST_CHECK(VerifyAgainstRoots({}, 15, proof, unsorted) == VerifyResult::INVALID_ROOTS);
+    BOOST_CHECK(VerifyAgainstRoots(roots, 15, proof, {leaves[14].first}) == VerifyResult::INVALID_TARGETS);
+    BOOST_CHECK(VerifyAgainstRoots(roots, 15, BatchProof({3, 3}, {}), {leaves[3].first, leaves[3].first}) ==
+                VerifyResult::INVALID_TARGETS);
+    BOOST_CHECK(VerifyAgainstRoots(roots, 15, BatchProof({3}, {}), {leaves[3].first}) == VerifyResult::INVALID_PROOF);
+    BOOST_CHECK(VerifyAgainstRoots(roots, 15, BatchProof(), {}) == VerifyResult::OK);
+}
+
+BOOST_AUTO_TEST_CASE(memory_usage)
+{
+    RamForest full(0);
+    Pollard pruned(0), remembering(0);
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 64);
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+    BOOST_CHECK(pruned.Modify(leaves, {}));
+    for (Leaf& leaf : leaves) leaf.second = true;
+    BOOST_CHECK(remembering.Modify(leaves, {}));
+
+    // The forest holds the hashes of all 127 nodes and a position for every leaf.
+    AccumulatorMemory forest_usage = full.MemoryUsage();
+    BOOST_CHECK(forest_usage.m_forest_data >= 127 * sizeof(Hash));
+    BOOST_CHECK(forest_usage.m_posmap >= 64 * (sizeof(Hash) + sizeof(uint64_t)));
+    BOOST_CHECK(forest_usage.m_nodes > 0);
+    BOOST_CHECK_EQUAL(forest_usage.m_snapshots, 0);
+    BOOST_CHECK_EQUAL(forest_usage.Total(), forest_usage.m_forest_data + forest_usage.m_posmap +
+                                                forest_usage.m_nodes + forest_usage.m_control_blocks +
+                                                forest_usage.m_auxiliary);
+
+    // A snapshot holds its own copy of the hashes and the positions, the removal fills the swap buffer.
+    full.EnableSnapshots();
+    BOOST_CHECK(full.Modify(unused_undo, {}, std::vector<uint64_t>{0, 5}));
+    AccumulatorMemory snapshot_usage = full.MemoryUsage();
+    BOOST_CHECK(snapshot_usage.m_snapshots >= 62 * (2 * sizeof(Hash) + sizeof(uint64_t)));
+    BOOST_CHECK(snapshot_usage.m_auxiliary > forest_usage.m_auxiliary);
+
+    // A pollard that remembers every leaf holds a node for each of them.
+    AccumulatorMemory pruned_usage = pruned.MemoryUsage();
+    AccumulatorMemory remembering_usage = remembering.MemoryUsage();
+    BOOST_CHECK_EQUAL(pruned_usage.m_forest_data, 0);
+    BOOST_CHECK(pruned_usage.m_posmap < sizeof(Hash));
+    BOOST_CHECK(remembering_usage.m_nodes > pruned_usage.m_nodes + 64 * sizeof(Hash));
+    BOOST_CHECK(remembering_usage.m_control_blocks > pruned_usage.m_control_blocks);
+    BOOST_CHECK(remembering_usage.m_posmap >= 64 * (sizeof(Hash) + sizeof(uint64_t)));
+}
+
+BOOST_AUTO_TEST_CASE(operation_stats)
+{
+    RamForest full(0);
+    Pollard pruned(0);
+
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 16);
+    leaves[3].second = true;
+
+    ResetStats();
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+    BOOST_CHECK(pruned.Modify(leaves, {}));
+
+    BatchProof proof;
+    std::vector<Hash> target_hashes{leaves[0].first, leaves[3].first};
+    BOOST_CHECK(full.Prove(proof, target_hashes));
+    BOOST_CHECK(pruned.Verify(proof, target_hashes));
+    BOOST_CHECK(full.Modify(unused_undo, {}, proof.GetSortedTargets()));
+
+    Stats stats = GetStats();
+    if (!StatsEnabled()) {
+        BOOST_CHECK_EQUAL(stats.m_hashes, 0);
+        BOOST_CHECK_EQUAL(stats.m_posmap_inserts, 0);
+        return;
+    }
+
+    // Adding 16 leaves computes 15 parents in each accumulator.
+    BOOST_CHECK(stats.m_hashes >= 30);
+    // The forest inserts every leaf, the pollard the remembered leaf and the verified targets.
+    BOOST_CHECK_EQUAL(stats.m_posmap_inserts, 16 + 1 + 2);
+    BOOST_CHECK(stats.m_posmap_lookups >= 2);
+    BOOST_CHECK_EQUAL(stats.m_posmap_erases, 2);
+    BOOST_CHECK(stats.m_swaps > 0);
+    BOOST_CHECK(stats.m_nodes_allocated > stats.m_nodes_freed);
+    // The pollard remembers leaf 3, so it has the proof hashes on its path cached.
+    BOOST_CHECK_EQUAL(stats.m_proof_hashes_consumed, proof.GetHashes().size());
+    BOOST_CHECK(stats.m_proof_hashes_cached >= 1);
+
+    ResetStats();
+    BOOST_CHECK_EQUAL(GetStats().m_hashes, 0);
+}
+
+BOOST_AUTO_TEST_CASE(hash_leaves)
+{
+    // Inputs of every length around the chunk and padding boundaries of SHA-512.
+    std::vector<std::vector<uint8_t>> utxos;
+    for (size_t len = 0; len <= 260; ++len) {
+        std::vector<uint8_t> data(len);
+        for (size_t i = 0; i < len; ++i) data[i] = static_cast<uint8_t>(len * 31 + i);
+        utxos.push_back(data);
+    }
+    utxos.push_back({'a', 'b', 'c'});
+
+    std::vector<ByteSpan> utxo_data;
+    for (const std::vector<uint8_t>& utxo : utxos) utxo_data.emplace_back(utxo);
+    std::vector<Hash> hashes(utxo_data.size());
+    ResetStats();
+    BOOST_CHECK(HashLeaves(utxo_data, hashes));
+    // Leaf hashes are counted apart from the parent hashes.
+    BOOST_CHECK_EQUAL(GetStats().m_hashes, 0);
+    if (StatsEnabled()) BOOST_CHECK_EQUAL(GetStats().m_leaf_hashes, utxo_data.size());
+
+    for (size_t i = 0; i < utxos.size(); ++i) {
+        Hash expected;
+        CSHA512(CSHA512::OUTPUT_SIZE_256).Write(utxos[i].data(), utxos[i].size()).Finalize256(expected.data());
+        BOOST_CHECK(hashes[i] == expected);
+    }
+
+    // SHA-512/256("abc") from FIPS 180-4.
+    const Hash abc = {0x53, 0x04, 0x8e, 0x26, 0x81, 0x94, 0x1e, 0xf9, 0x9b, 0x2e, 0x29, 0xb7, 0x6b, 0x4c, 0x7d, 0xab,
+                      0xe4, 0xc2, 0xd0, 0xc6, 0x34, 0xfc, 0x6d, 0x46, 0xe0, 0xe2, 0xf1, 0x31, 0x07, 0xe7, 0xaf, 0x23};
+    BOOST_CHECK(hashes.back() == abc);
+
+    // The hashes can be added to the accumulator.
+    std::vector<Leaf> leaves;
+    for (const Hash& hash : hashes) leaves.emplace_back(hash, false);
+    RamForest full(0);
+    UndoBatch unused_undo;
+    BOOST_CHECK(full.Modify(unused_undo, leaves, {}));
+    BatchProof proof;
+    BOOST_CHECK(full.Prove(proof, {hashes[0], hashes[200]}));
+
+    // Every UTXO needs a hash.
+    hashes.pop_back();
+    BOOST_CHECK(!HashLeaves(utxo_data, hashes));
+
+    // A block without UTXOs has no hashes.
+    BOOST_CHECK(HashLeaves({}, {}));
+}
+
+BOOST_AUTO_TEST_CASE(modify_spans)
+{
+    std::vector<Leaf> leaves;
+    CreateTestLeaves(leaves, 20);
+    for (const int i : {1, 9, 10, 19}) leaves[i].second = true;
+
+    // The same leaves as separate hashes and packed remember flags.
+    std::vector<Hash> hashes;
+    std::vector<uint8_t> remember((leaves.size() + 7) / 8);
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        hashes.push_back(leaves[i].first);
+        if (leaves[i].second) remember[i / 8] |= 1 << (i % 8);
+    }
+
+    RamForest full(0), full_spans(0);
+    Pollard pruned(0), pruned_spans(0);
+    UndoBatch undo;
+    PollardUndoBatch pollard_undo;
+    BOOST_CHECK(full.Modify(undo, leaves, {}));
+    BOOST_CHECK(full_spans.Modify(undo, hashes, {}));
+    BOOST_CHECK(pruned.Modify(pollard_undo, leaves, {}));
+    BOOST_CHECK(pruned_spans.Modify(pollard_undo, hashes, remember, {}));
+
+    std::vector<uint64_t> remembered, remembered_spans;
+    pruned.RememberedLeaves(remembered);
+    pruned_spans.RememberedLeaves(remembered_spans);
+    BOOST_CHECK(remembered == std::vector<uint64_t>({1, 9, 10, 19}));
+    BOOST_CHECK(remembered_spans == remembered);
+
+    // Remove a few leaves through the spans.
+    BatchProof proof;
+    BOOST_CHECK(full.Prove(proof, {leaves[1].first, leaves[4].first, leaves[19].first}));
+    BOOST_CHECK(pruned_spans.Verify(proof, {leaves[1].first, leaves[4].first, leaves[19].first}));
+    const std::vector<uint64_t>& targets = proof.GetSortedTargets();
+    BOOST_CHECK(full.Modify(undo, std::vector<Leaf>(), targets));
+    BOOST_CHECK(full_spans.Modify(undo, Span<const Hash>(), targets));
+    BOOST_CHECK(pruned_spans.Modify(pollard_undo, Span<const Hash>(), Span<const uint8_t>(), targets));
+
+    std::vector<Hash> roots, roots_spans, pruned_roots;
+    full.Roots(roots);
+    full_spans.Roots(roots_spans);
+    pruned_spans.Roots(pruned_roots);
+    BOOST_CHECK(roots == roots_spans);
+    BOOST_CHECK(roots == pruned_roots);
+
+    // Leaves without any flags are not remembered, but a flag is needed for every leaf if there are some.
+    std::vector<Leaf> more;
+    CreateTestLeaves(more, 9, 100);
+    std::vector<Hash> more_hashes;
+    for (const Leaf& leaf : more) more_hashes.push_back(leaf.first);
+    const std::vector<uint8_t> short_flags{0xFF};
+    BOOST_CHECK(!pruned_spans.Modify(pollard_undo, more_hashes, short_flags, {}));
+    BOOST_CHECK(pruned_spans.Modify(pollard_undo, more_hashes, {}, {}));
+    pruned_spans.RememberedLeaves(remembered_spans);
+    BOOST_CHECK_EQUAL(remembered_spans.size(), 2);
+}
+
+// Create the blocks of a chain with a bridge forest: every block creates outputs and spends some earlier ones.
+static void CreateTestBlocks(std::vector<BlockData>& blocks, int num_blocks)
+{
+    RamForest full(0);
+    UndoBatch undo;
+    std::vector<std::vector<uint8_t>> unspent;
+    uint32_t next_output = 0;
+
+    for (int height = 0; height < num_blocks; ++height) {
+        BlockData block;
+        for (int i = 0; i < 12; ++i, ++next_output) {
+            block.m_created.push_back({uint8_t(next_output), uint8_t(next_output >> 8), 0xAB, uint8_t(height)});
+        }
+        // Spend every third unspent output.
+        std::vector<std::vector<uint8_t>> remaining;
+        for (size_t i = 0; i < unspent.size(); ++i) {
+            if (i % 3 == 0) {
+                block.m_spent.push_back(unspent[i]);
+            } else {
+                remaining.push_back(unspent[i]);
+            }
+        }
+        unspent = remaining;
+
+        std::vector<ByteSpan> spent_data(block.m_spent.begin(), block.m_spent.end());
+        std::vector<Hash> spent_hashes(spent_data.size());
+        BOOST_CHECK(HashLeaves(spent_data, spent_hashes));
+        BatchProof proof;
+        BOOST_CHECK(full.Prove(proof, spent_hashes));
+        proof.Serialize(block.m_proof);
+
+        std::vector<ByteSpan> created_data(block.m_created.begin(), block.m_created.end());
+        std::vector<Hash> created_hashes(created_data.size());
+        BOOST_CHECK(HashLeaves(created_data, created_hashes));
+        BOOST_CHECK(full.Modify(undo, created_hashes, proof.GetSortedTargets()));
+        block.m_remember = {0x11, 0x08};
+
+        unspent.insert(unspent.end(), block.m_created.begin(), block.m_created.end());
+        blocks.push_back(block);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_processor)
+{
+    std::vector<BlockData> blocks;
+    CreateTestBlocks(blocks, 8);
+
+    // Connect every block before the next one is submitted, so nothing overlaps.
+    Pollard sequential(0);
+    PollardUndoBatch undo;
+    for (const BlockData& block : blocks) {
+        BlockProcessor processor(sequential);
+        processor.Submit(block);
+        BOOST_CHECK(processor.Connect(undo));
+    }
+
+    // Keep the next block submitted while connecting the current one.
+    Pollard pruned(0);
+    {
+        BlockProcessor processor(pruned);
+        BOOST_CHECK(!processor.Connect(undo));
+        processor.Submit(blocks[0]);
+        for (size_t i = 1; i < blocks.size(); ++i) {
+            processor.Submit(blocks[i]);
+            BOOST_CHECK(processor.Connect(undo));
+            BOOST_CHECK_EQUAL(processor.NumPending(), 1);
+        }
+        BOOST_CHECK(processor.Connect(undo));
+        BOOST_CHECK_EQUAL(processor.NumPending(), 0);
+    }
+    std::vector<Hash> roots, sequential_roots;
+    pruned.Roots(roots);
+    sequential.Roots(sequential_roots);
+    BOOST_CHECK(roots == sequential_roots);
+    BOOST_CHECK_EQUAL(pruned.NumLeaves(), sequential.NumLeaves());
+
+    // The last block can be rolled back.
+    BOOST_CHECK(pruned.Undo(undo));
+    BOOST_CHECK_EQUAL(pruned.NumLeaves(), sequential.NumLeaves() - blocks.back().m_created.size() + blocks.back().m_spent.size());
+
+    // A block with a wrong spent output is rejected, and so are the blocks after it.
+    Pollard valid(0);
+    {
+        BlockProcessor processor(valid);
+        for (int i = 0; i < 3; ++i) processor.Submit(blocks[i]);
+        for (int i = 0; i < 3; ++i) BOOST_CHECK(processor.Connect(undo));
+    }
+    Pollard invalid(0);
+    {
+        BlockProcessor processor(invalid);
+        std::vector<BlockData> invalid_blocks = blocks;
+        invalid_blocks[3].m_spent[0][0] ^= 1;
+        for (const BlockData& block : invalid_blocks) processor.Submit(block);
+        for (int i = 0; i < 3; ++i) BOOST_CHECK(processor.Connect(undo));
+        BOOST_CHECK(!processor.Connect(undo));
+        BOOST_CHECK(!processor.Connect(undo));
+        BOOST_CHECK_EQUAL(processor.NumPending(), invalid_blocks.size() - 5);
+    }
+    std::vector<Hash> valid_roots, invalid_roots;
+    valid.Roots(valid_roots);
+    invalid.Roots(invalid_roots);
+    BOOST_CHECK(invalid_roots == valid_roots);
+
+    // So is a block whose proof does not parse.
+    Pollard unparsable(0);
+    BlockProcessor processor(unparsable);
+    BlockData block = blocks[0];
+    block.m_proof.clear();
+    processor.Submit(block);
+    BOOST_CHECK(!processor.Connect(undo));
+}
+
 BOOST_AUTO_TEST_CASE(simple_posmap_updates)
 {
     RamForest full(0);
@@ -54,6 +54,41 @@ BOOST_AUTO_TEST_CASE(positions)
     BOOST_CHECK(state.LeftDescendant(25, 2) == 4);
     BOOST_CHECK(state.Cousin(4) == 6);
     BOOST_CHECK(state.Cousin(5) == 7);
+
+    // The position functions can be evaluated at compile time.
+    static_assert(ForestState(15).Parent(0) == 16);
+    static_assert(ForestState(15).RootPosition(3) == 28);
+    static_assert(ForestState(15).DetectRow(26) == 2);
+}
+
+BOOST_AUTO_TEST_CASE(rows_and_roots)
+{
+    for (uint64_t num_leaves = 0; num_leaves < 300; ++num_leaves) {
+        ForestState state(num_leaves);
+
+        // The smallest number of rows that fits all leaves.
+        uint8_t rows = 0;
+        while ((1ULL << rows) < num_leaves) ++rows;
+        BOOST_CHECK_EQUAL(state.NumRows(), rows);
+        BOOST_CHECK_EQUAL(state.MaxNodes(), (2ULL << rows) - 1);
+
+        uint8_t num_roots = 0;
+        for (uint8_t row = 0; row <= rows; ++row) {
+            if (!state.HasRoot(row)) continue;
+            ++num_roots;
+            // The root is the only node left on its row once all bigger trees are skipped.
+            uint64_t root = state.RowOffset(row) + ((num_leaves >> row) - 1);
+            BOOST_CHECK_EQUAL(state.RootPosition(row), root);
+        }
+        BOOST_CHECK_EQUAL(state.NumRoots(), num_roots);
+
+        // Every position of a row is detected as part of that row.
+        for (uint8_t row = 0; row <= rows; ++row) {
+            for (uint64_t pos = state.RowOffset(row); pos < state.RowOffset(row) + (1ULL << (rows - row)); ++pos) {
+                BOOST_CHECK_EQUAL(state.DetectRow(pos), row);
+            }
+        }
+    }
 }
 
 BOOST_AUTO_TEST_CASE(proof)
@@ -88,7 +123,48 @@ BOOST_AUTO_TEST_CASE(proof)
     BOOST_CHECK_EQUAL_COLLECTIONS(expected_computed.begin(), expected_computed.end(),
                                   output.second.begin(), output.second.end());
 
+    // The buffer overload overwrites reused buffers and matches the count-only variant.
+    std::vector<uint64_t> proof{1, 2, 3}, computed{4};
+    state.ProofPositions(targets, proof, computed);
+    BOOST_CHECK(proof == expected_proof);
+    BOOST_CHECK(computed == expected_computed);
+    BOOST_CHECK_EQUAL(state.NumProofPositions(targets), expected_proof.size());
+
+    state.ProofPositions({0}, proof, computed);
+    BOOST_CHECK(proof == std::vector<uint64_t>({1, 17, 25}));
+    BOOST_CHECK_EQUAL(state.NumProofPositions({0}), 3);
+
     // TODO: add tests with random numbers
 }
 
+BOOST_AUTO_TEST_CASE(transform)
+{
+    ForestState state(15);
+    SwapBuffer swaps;
+
+    auto check_row = [&swaps](uint8_t row, const std::vector<std::pair<uint64_t, uint64_t>>& expected) {
+        std::vector<std::pair<uint64_t, uint64_t>> row_swaps;
+        for (const ForestState::Swap* swap = swaps.RowBegin(row); swap != swaps.RowEnd(row); ++swap) {
+            row_swaps.emplace_back(swap->m_from, swap->m_to);
+        }
+        BOOST_CHECK(row_swaps == expected);
+    };
+
+    state.Transform(std::vector<uint64_t>{0, 2, 3, 6, 8, 10, 11, 14}, swaps);
+    BOOST_CHECK_EQUAL(swaps.NumRows(), 4);
+    check_row(0, {{7, 0}, {9, 6}});
+    check_row(1, {{18, 17}, {22, 18}});
+    check_row(2, {});
+    check_row(3, {});
+    // The collapses are the last swaps of their rows.
+    BOOST_CHECK(!swaps.RowBegin(0)->m_collapse && (swaps.RowEnd(0) - 1)->m_collapse);
+
+    // Reusing the buffer replaces the previous swaps.
+    state.Transform(std::vector<uint64_t>{1, 4}, swaps);
+    BOOST_CHECK_EQUAL(swaps.NumRows(), 2);
+    check_row(0, {{5, 1}, {14, 4}});
+    check_row(1, {{22, 18}});
+    BOOST_CHECK_EQUAL(swaps.Swaps().size(), 3);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
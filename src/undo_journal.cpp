@@ -0,0 +1,194 @@
+#include "undo_journal.h"
+#include "../include/batchproof.h"
+#include "counters.h"
+#include "crypto/common.h"
+
+#include <filesystem>
+
+namespace utreexo {
+
+// num leaves (8 bytes) + length (4 bytes)
+static constexpr uint64_t RECORD_HEADER_SIZE = 12;
+
+bool UndoJournal::Reopen()
+{
+    m_file.close();
+    m_file = std::fstream(m_file_path, std::fstream::in | std::fstream::out | std::fstream::binary);
+    return m_file.good();
+}
+
+bool UndoJournal::Open(const std::string& file, size_t max_blocks, uint64_t num_leaves)
+{
+    m_file_path = file;
+    m_max_blocks = max_blocks;
+    m_records.clear();
+    m_end = 0;
+
+    std::error_code ec;
+    if (!std::filesystem::exists(file, ec)) {
+        // Create an empty journal.
+        std::ofstream(file, std::fstream::binary);
+    }
+
+    uint64_t file_size = std::filesystem::file_size(file, ec);
+    if (ec || !Reopen()) return false;
+
+    // Index the complete records. Only the latest max_blocks records are kept, the file
+    // can still start with records that were dropped but not compacted away.
+    uint8_t header[RECORD_HEADER_SIZE];
+    while (m_end + RECORD_HEADER_SIZE <= file_size) {
+        m_file.seekg(m_end);
+        if (!m_file.read(reinterpret_cast<char*>(header), RECORD_HEADER_SIZE)) {
+            m_file.clear();
+            return false;
+        }
+
+        Record record{m_end, ReadBE32(header + 8), ReadBE64(header)};
+        if (m_end + RECORD_HEADER_SIZE + record.m_length > file_size) break;
+
+        m_records.push_back(record);
+        if (m_records.size() > m_max_blocks) m_records.pop_front();
+        m_end += RECORD_HEADER_SIZE + record.m_length;
+    }
+
+    if (!m_records.empty() && m_records.back().m_num_leaves != num_leaves) {
+        // The journal does not end at the current state, none of the records can be applied.
+        m_records.clear();
+        m_end = 0;
+    }
+
+    if (m_end != file_size) {
+        // Discard the partial or unusable records.
+        m_file.close();
+        std::filesystem::resize_file(file, m_end, ec);
+        if (ec || !Reopen()) return false;
+    }
+
+    return DropOldRecords();
+}
+
+bool UndoJournal::Append(uint64_t num_leaves, const UndoBatch& undo)
+{
+    std::vector<uint8_t> bytes;
+    undo.Serialize(bytes);
+
+    uint8_t header[RECORD_HEADER_SIZE];
+    WriteBE64(header, num_leaves);
+    WriteBE32(header + 8, bytes.size());
+
+    m_file.seekp(m_end);
+    m_file.write(reinterpret_cast<const char*>(header), RECORD_HEADER_SIZE);
+    m_file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    m_file.flush();
+    if (!m_file.good()) {
+        // Cut off what was written of the record.
+        m_file.close();
+        std::error_code ec;
+        std::filesystem::resize_file(m_file_path, m_end, ec);
+        Reopen();
+        return false;
+    }
+    STATS_ADD(m_bytes_committed, RECORD_HEADER_SIZE + bytes.size());
+
+    m_records.push_back(Record{m_end, static_cast<uint32_t>(bytes.size()), num_leaves});
+    m_end += RECORD_HEADER_SIZE + bytes.size();
+
+    if (!DropOldRecords()) {
+        // The caller does not apply the block, so the record must not stay.
+        Truncate(1);
+        return false;
+    }
+    return true;
+}
+
+bool UndoJournal::Read(size_t k, std::vector<UndoBatch>& undos)
+{
+    if (k > m_records.size()) return false;
+
+    undos.clear();
+    undos.reserve(k);
+
+    std::vector<uint8_t> bytes;
+    for (auto record = m_records.crbegin(); record != m_records.crbegin() + k; ++record) {
+        bytes.resize(record->m_length);
+        m_file.seekg(record->m_offset + RECORD_HEADER_SIZE);
+        if (!m_file.read(reinterpret_cast<char*>(bytes.data()), bytes.size())) {
+            // Keep the journal usable for appending.
+            m_file.clear();
+            return false;
+        }
+
+        undos.emplace_back();
+        if (!undos.back().Unserialize(bytes)) return false;
+    }
+
+    return true;
+}
+
+bool UndoJournal::Truncate(size_t k)
+{
+    if (k > m_records.size()) return false;
+    if (k == 0) return true;
+
+    m_end = m_records[m_records.size() - k].m_offset;
+    m_records.erase(m_records.end() - k, m_records.end());
+
+    m_file.close();
+    std::error_code ec;
+    std::filesystem::resize_file(m_file_path, m_end, ec);
+    return !ec && Reopen();
+}
+
+bool UndoJournal::DropOldRecords()
+{
+    while (m_records.size() > m_max_blocks) {
+        m_records.pop_front();
+    }
+
+    // The file starts with the dropped records.
+    uint64_t dropped = m_records.empty() ? m_end : m_records.front().m_offset;
+    if (dropped > 0 && dropped >= m_end - dropped) {
+        return Compact();
+    }
+
+    return true;
+}
+
+bool UndoJournal::Compact()
+{
+    uint64_t start = m_records.empty() ? m_end : m_records.front().m_offset;
+
+    std::vector<char> live(m_end - start);
+    m_file.seekg(start);
+    if (!m_file.read(live.data(), live.size())) {
+        m_file.clear();
+        return false;
+    }
+
+    // Write the live records to a new file and replace the journal with it.
+    std::string tmp_path = m_file_path + ".tmp";
+    {
+        std::ofstream tmp(tmp_path, std::fstream::binary | std::fstream::trunc);
+        tmp.write(live.data(), live.size());
+        if (!tmp.good()) return false;
+        STATS_ADD(m_bytes_committed, live.size());
+    }
+
+    m_file.close();
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, m_file_path, ec);
+    if (ec) {
+        // Keep using the uncompacted journal.
+        Reopen();
+        return false;
+    }
+
+    for (Record& record : m_records) {
+        record.m_offset -= start;
+    }
+    m_end -= start;
+
+    return Reopen();
+}
+
+}; // namespace utreexo
@@ -0,0 +1,79 @@
+#ifndef UTREEXO_UNDO_JOURNAL_H
+#define UTREEXO_UNDO_JOURNAL_H
+
+#include <deque>
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace utreexo {
+
+class UndoBatch;
+
+/**
+ * UndoJournal keeps the undo data of the latest blocks in an append-only file.
+ *
+ * Every block is stored as a record:
+ * - num leaves: 8 bytes, the number of leaves after the block was applied
+ * - length:     4 bytes, the length of the serialized UndoBatch
+ * - undo data:  the serialized UndoBatch
+ *
+ * The offsets of the records are indexed in memory. Only the latest max_blocks
+ * records are kept in the index, older ones are dropped and the file is compacted
+ * once the dropped records take up more space than the indexed ones.
+ */
+class UndoJournal
+{
+private:
+    struct Record {
+        uint64_t m_offset;
+        uint32_t m_length;
+        uint64_t m_num_leaves;
+    };
+
+    std::string m_file_path;
+    std::fstream m_file;
+
+    // The indexed records, oldest first.
+    std::deque<Record> m_records;
+    size_t m_max_blocks{0};
+    // The end of the last record.
+    uint64_t m_end{0};
+
+    bool Reopen();
+    /* Drop the records above max_blocks and compact the file if worthwhile. */
+    bool DropOldRecords();
+    /* Rewrite the file without the dropped records. */
+    bool Compact();
+
+public:
+    /**
+     * Open the journal file, creating it if it does not exist.
+     * Existing records are reused if the latest one ends at num_leaves leaves.
+     * Otherwise the journal does not belong to the current state and is emptied.
+     * A partially written last record is discarded.
+     */
+    bool Open(const std::string& file, size_t max_blocks, uint64_t num_leaves);
+
+    /** Return the number of blocks that can be undone. */
+    size_t Size() const { return m_records.size(); }
+
+    /** Return the memory held by the in-memory index. */
+    size_t MemoryUsage() const { return sizeof(UndoJournal) + m_records.size() * sizeof(Record); }
+
+    /**
+     * Append the undo data of a block that left the accumulator with num_leaves leaves.
+     * On failure the record is not kept in the journal.
+     */
+    bool Append(uint64_t num_leaves, const UndoBatch& undo);
+
+    /** Read the undo data of the k latest blocks, the latest block first. */
+    bool Read(size_t k, std::vector<UndoBatch>& undos);
+
+    /** Remove the k latest blocks from the journal. */
+    bool Truncate(size_t k);
+};
+
+};     // namespace utreexo
+#endif // UTREEXO_UNDO_JOURNAL_H
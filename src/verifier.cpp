@@ -0,0 +1,201 @@
+#include "include/verifier.h"
+#include "include/batchproof.h"
+
+#include "counters.h"
+#include "crypto/sha512.h"
+#include "prove_many.h"
+#include "state.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace utreexo {
+
+/**
+ * Verify sorted targets against the proof hashes at the proof positions.
+ *
+ * computed holds the positions of the targets followed by the positions computed from them
+ * on every row above (see ForestState::ProofPositions). nodes has room for a hash at every
+ * computed position and its first num_targets entries hold the target hashes. children has
+ * room for two hashes per target.
+ *
+ * Every node of a row is paired with its sibling, which is either the next node of the row
+ * or the next proof hash. The parents of the whole row are hashed in one batch into nodes,
+ * right behind the row.
+ */
+static VerifyResult VerifyComputed(const ForestState& state,
+                                   const std::vector<Hash>& roots,
+                                   const uint64_t* computed,
+                                   size_t num_computed,
+                                   size_t num_targets,
+                                   const uint64_t* proof_positions,
+                                   const Hash* proof_hashes,
+                                   size_t num_proof,
+                                   Hash* nodes,
+                                   Hash* children)
+{
+    size_t proof_index = 0;
+    // The roots are stored from the top row down, so the root of a row is
+    // found by counting the roots on the rows below it.
+    size_t roots_below = 0;
+    size_t row_begin = 0, row_end = num_targets;
+
+    for (uint8_t row = 0; row <= state.NumRows() && row_begin < row_end; ++row) {
+        size_t end = row_end;
+        if (state.HasRoot(row)) {
+            if (computed[end - 1] == state.RootPosition(row)) {
+                if (nodes[end - 1] != roots[roots.size() - 1 - roots_below]) return VerifyResult::ROOT_MISMATCH;
+                --end;
+            }
+            ++roots_below;
+        }
+
+        size_t num_parents = 0;
+        for (size_t i = row_begin; i < end; ++num_parents) {
+            const uint64_t pos = computed[i];
+            const uint64_t sibling = state.Sibling(pos);
+            Hash* pair = children + 2 * num_parents;
+
+            if (i + 1 < end && computed[i + 1] == sibling) {
+                // Both children are known, pos is the left one.
+                pair[0] = nodes[i];
+                pair[1] = nodes[i + 1];
+                i += 2;
+                continue;
+            }
+
+            if (proof_index >= num_proof || proof_positions[proof_index] != sibling) {
+                return VerifyResult::INVALID_PROOF;
+            }
+
+            pair[pos & 1] = nodes[i];
+            pair[sibling & 1] = proof_hashes[proof_index++];
+            ++i;
+        }
+
+        if (row_end + num_parents > num_computed) return VerifyResult::INVALID_PROOF;
+        SHA512_256_64(nodes[row_end].data(), children->data(), num_parents);
+        STATS_ADD(m_hashes, num_parents);
+
+        row_begin = row_end;
+        row_end += num_parents;
+    }
+
+    // Every node has to end up at a root and every proof hash has to be used.
+    if (row_begin < row_end || proof_index != num_proof) return VerifyResult::INVALID_PROOF;
+    STATS_ADD(m_proof_hashes_consumed, num_proof);
+    return VerifyResult::OK;
+}
+
+/** Check the roots and the targets of a proof for VerifyAgainstRoots and BatchVerifier. */
+static VerifyResult CheckTargets(const ForestState& state,
+                                 const std::vector<Hash>& roots,
+                                 const BatchProof& proof,
+                                 const std::vector<Hash>& target_hashes)
+{
+    if (roots.size() != state.NumRoots()) return VerifyResult::INVALID_ROOTS;
+    if (target_hashes.size() != proof.GetTargets().size() ||
+        !state.CheckTargetsSanity(proof.GetSortedTargets())) {
+        return VerifyResult::INVALID_TARGETS;
+    }
+
+    return VerifyResult::OK;
+}
+
+VerifyResult VerifyAgainstRoots(const std::vector<Hash>& roots,
+                                uint64_t num_leaves,
+                                const BatchProof& proof,
+                                const std::vector<Hash>& target_hashes)
+{
+    const ForestState state(num_leaves);
+    VerifyResult result = CheckTargets(state, roots, proof, target_hashes);
+    if (result != VerifyResult::OK) return result;
+
+    const BatchProofPositions positions(proof, num_leaves);
+    const std::vector<uint64_t>& proof_positions = positions.GetProofPositions();
+    const std::vector<uint64_t>& computed = positions.GetComputedPositions();
+    if (proof.GetHashes().size() != proof_positions.size()) return VerifyResult::INVALID_PROOF;
+    if (target_hashes.empty()) return VerifyResult::OK;
+
+    const size_t num_targets = target_hashes.size();
+
+    // The hashes of the computed positions, followed by the children of a row.
+    std::vector<Hash> scratch(computed.size() + 2 * num_targets);
+    std::copy(target_hashes.begin(), target_hashes.end(), scratch.begin());
+
+    return VerifyComputed(state, roots,
+                          computed.data(), computed.size(), num_targets,
+                          proof_positions.data(), proof.GetHashes().data(), proof_positions.size(),
+                          scratch.data(), scratch.data() + computed.size());
+}
+
+BatchVerifier::BatchVerifier(const std::vector<Hash>& roots, uint64_t num_leaves)
+    : m_roots(roots), m_num_leaves(num_leaves) {}
+
+bool BatchVerifier::Verify(const BatchProof& proof, const std::vector<Hash>& target_hashes, int num_threads) const
+{
+    const ForestState state(m_num_leaves);
+    if (CheckTargets(state, m_roots, proof, target_hashes) != VerifyResult::OK) return false;
+
+    // The targets of every tree are consecutive, since the trees are ordered by their leaves.
+    const std::vector<uint64_t>& sorted_targets = proof.GetSortedTargets();
+    std::vector<size_t> tree_begin;
+    for (size_t i = 0; i < sorted_targets.size(); ++i) {
+        if (i == 0 || state.RootIndex(sorted_targets[i]) != state.RootIndex(sorted_targets[i - 1])) {
+            tree_begin.push_back(i);
+        }
+    }
+    tree_begin.push_back(sorted_targets.size());
+    const size_t num_trees = tree_begin.size() - 1;
+
+    if (num_threads <= 1 || num_trees <= 1) {
+        return VerifyAgainstRoots(m_roots, m_num_leaves, proof, target_hashes) == VerifyResult::OK;
+    }
+
+    const BatchProofPositions positions(proof, m_num_leaves);
+    const std::vector<uint64_t>& proof_positions = positions.GetProofPositions();
+    if (proof.GetHashes().size() != proof_positions.size()) return false;
+
+    const std::vector<Hash>& proof_hashes = proof.GetHashes();
+
+    // The proof positions of the trees do not overlap, so every tree is verified on its own
+    // with the proof hashes of its proof positions.
+    std::atomic<bool> ok{true};
+    ParallelFor(num_trees, num_threads, [&](size_t begin, size_t end) {
+        std::vector<uint64_t> tree_targets, tree_proof_positions, tree_computed;
+        std::vector<Hash> tree_proof_hashes, scratch;
+
+        for (size_t tree = begin; tree < end && ok; ++tree) {
+            const size_t num_targets = tree_begin[tree + 1] - tree_begin[tree];
+            tree_targets.assign(sorted_targets.begin() + tree_begin[tree], sorted_targets.begin() + tree_begin[tree + 1]);
+            state.ProofPositions(tree_targets, tree_proof_positions, tree_computed);
+
+            tree_proof_hashes.clear();
+            auto proof_it = proof_positions.cbegin();
+            for (const uint64_t pos : tree_proof_positions) {
+                proof_it = std::lower_bound(proof_it, proof_positions.cend(), pos);
+                if (proof_it == proof_positions.cend() || *proof_it != pos) {
+                    ok = false;
+                    return;
+                }
+                tree_proof_hashes.push_back(proof_hashes[proof_it - proof_positions.cbegin()]);
+            }
+
+            scratch.resize(tree_computed.size() + 2 * num_targets);
+            std::copy(target_hashes.begin() + tree_begin[tree], target_hashes.begin() + tree_begin[tree + 1], scratch.begin());
+
+            VerifyResult result = VerifyComputed(state, m_roots,
+                                                 tree_computed.data(), tree_computed.size(), num_targets,
+                                                 tree_proof_positions.data(), tree_proof_hashes.data(), tree_proof_positions.size(),
+                                                 scratch.data(), scratch.data() + tree_computed.size());
+            if (result != VerifyResult::OK) {
+                ok = false;
+                return;
+            }
+        }
+    });
+
+    return ok;
+}
+
+}; // namespace utreexo